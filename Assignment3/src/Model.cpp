@@ -15,99 +15,22 @@ void Model::addModel(string filepath) {
     moveToOrigin();
 }
 
-//Following function based on:
-// http://www.opengl-tutorial.org/beginners-tutorials/tutorial-7-model-loading/
-// https://stackoverflow.com/questions/21120699/c-obj-file-parser
 void Model::openOBJ(string filename) {
-    //char_separator<char> whitespace = char_separator<char>( " \t" );
-    //char_separator<char> faceSeparator = char_separator<char>( "/" );
-    vector<int> vertexIndices, uvIndices, normalIndices;
-    vector<vec3> temp_vertices;
-    vector<vec3> temp_normals;
-    vector<vec2> temp_uvs;
-
-    // try to open the file
-    ifstream file;
-    file.open( filename, fstream::in );
-    // didn't work? fail!
-    if ( file.fail() ) {
-        cout << "ERROR: OBJmodel: Couldn't load \""
-             << filename << "\"." << endl;
+    ObjData obj;
+    if(!loadOBJ(filename, obj)){
+        return;
     }
-
-    string line; // a buffer to store lines in, and separators
-    const char* values;
-    //Process the file
-    while(getline(file,line)) {	// while we have data, read in a line
-
-        if (line.substr(0,2)=="v "){
-            vec3 vertex;
-            values = line.c_str();
-            sscanf(values, "v %f %f %f\n", &vertex.x, &vertex.y, &vertex.z);
-            //cout<<"V: "<<vertex.x<<" "<<vertex.y<<" "<<vertex.z<<endl;
-            temp_vertices.push_back(vertex);
-            updateBoundingBox(vertex);
-        }
-            //Process uv coordinates at each vertex
-        else if (line.substr(0,2)=="vt"){
-            vec2 uv;
-            values = line.c_str();
-            sscanf(values, "vt %f %f\n", &uv.x, &uv.y);
-            //cout<<"UV: "<<uv.x<<" "<<uv.y<<endl;
-            temp_uvs.push_back(uv);
-        }
-            //Process normals at each vertex
-        else if (line.substr(0,2)=="vn"){
-            vec3 normal;
-            values = line.c_str();
-            sscanf(values, "vn %f %f %f\n", &normal.x, &normal.y, &normal.z);
-            //cout<<"N: "<<normal.x<<" "<<normal.y<<" "<<normal.z<<endl;
-            temp_normals.push_back(normal);
-        }
-            //Process indices of each set of vertices, uvs, and normals.
-        else if (line.substr(0,2)=="f "){
-            //string vertex1, vertex2, vertex3;
-            values = line.c_str();
-            int vertexIndex[3], uvIndex[3], normalIndex[3];
-            sscanf(values, "f %d/%d/%d %d/%d/%d %d/%d/%d\n",
-                   &vertexIndex[0], &uvIndex[0], &normalIndex[0],
-                   &vertexIndex[1], &uvIndex[1], &normalIndex[1],
-                   &vertexIndex[2], &uvIndex[2], &normalIndex[2]);
-            //cout<<"F: "<<vertexIndex[0]<<"/"<<uvIndex[0]<<"/"<<normalIndex[0]<<" "
-            //    <<vertexIndex[1]<<"/"<<uvIndex[1]<<"/"<<normalIndex[1]<<" "
-            //    <<vertexIndex[2]<<"/"<<uvIndex[2]<<"/"<<normalIndex[2]<<endl;
-            //if (matches != 9) {
-            //    printf("File can't be read by our simple parser :( Try exporting with other options\n");
-            //}
-            vertexIndices.push_back(vertexIndex[0] - 1);
-            vertexIndices.push_back(vertexIndex[1] - 1);
-            vertexIndices.push_back(vertexIndex[2] - 1);
-            uvIndices.push_back(uvIndex[0] - 1);
-            uvIndices.push_back(uvIndex[1] - 1);
-            uvIndices.push_back(uvIndex[2] - 1);
-            normalIndices.push_back(normalIndex[0] - 1);
-            normalIndices.push_back(normalIndex[1] - 1);
-            normalIndices.push_back(normalIndex[2] - 1);
-        }
+    for (int i = 0; i < obj.positions.size(); ++i) {
+        updateBoundingBox(obj.positions[i]);
     }
-    Vertex vertex;
-
-    //Store the file's contents in proper MeshData setup
-    for (int i = 0; i < vertexIndices.size(); ++i) {
-        //vec3 vertex =
-        vertex.Position = temp_vertices[vertexIndices[i]];
-        vertex.Normal = temp_normals[normalIndices[i]];
-        vertex.uvCoords = temp_uvs[uvIndices[i]];
-        meshData.vertices.push_back(vertex);
-        //Do we even need the following?
-        //meshData.indices.push_back(vertexIndices[i]);
-        //meshData.indices.push_back(uvIndices[i]);
-        //meshData.indices.push_back(normalIndices[i]);
-        //out_vertices.push_back(vertex);
+    //the loader's vertices are already in the layout the buffers take, its indices just have to skip past the vertices
+    //of any model loaded before this one
+    GLuint firstVertex = (GLuint)meshData.vertices.size();
+    meshData.vertices.insert(meshData.vertices.end(), obj.vertices.begin(), obj.vertices.end());
+    meshData.indices.reserve(meshData.indices.size() + obj.indices.size());
+    for (int i = 0; i < obj.indices.size(); ++i) {
+        meshData.indices.push_back(firstVertex + obj.indices[i]);
     }
-    //// if we made it this far, commit what we have and continue
-    //contents = tempContents;
-    //filename = filepath;
 }
 
 void Model::addTexture(char type, string texturePath){
@@ -233,16 +156,23 @@ void Model::setupTextures(ShaderProgram shaderProgram) {
 //Actually write stuff to the correct buffers
 //Following function based on: https://learnopengl.com/code_viewer.php?code=mesh&type=header
 void Model::setupBuffers(){
-    GLuint VAO, VBO;
+    GLuint VAO, VBO, EBO;
+    if(meshData.indices.empty()){
+        return;
+    }
 
     // Create buffers/arrays
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
+    glGenBuffers(1, &EBO);
 
     glBindVertexArray(VAO);
     // Load data into vertex buffers
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
     glBufferData(GL_ARRAY_BUFFER, meshData.vertices.size() * sizeof(Vertex), &meshData.vertices[0], GL_STATIC_DRAW);
+    // The element buffer is part of the VAO's state so it has to be bound while the VAO is
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, meshData.indices.size() * sizeof(GLuint), &meshData.indices[0], GL_STATIC_DRAW);
 
     // Set the vertex attribute pointers
     // Vertex Positions
@@ -258,13 +188,14 @@ void Model::setupBuffers(){
 
     // Draw container
     glBindVertexArray(VAO);
-    glDrawArrays(GL_TRIANGLES, 0, meshData.vertices.size());
+    glDrawElements(GL_TRIANGLES, (GLsizei)meshData.indices.size(), GL_UNSIGNED_INT, 0);
     glBindVertexArray(0);
 
     // Properly de-allocate all resources once they've outlived their purpose,
     // now the program doesn't randomly crash after it's been running for a while
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &EBO);
 }
 
 void Model::updateBoundingBox(vec3 vertex) {
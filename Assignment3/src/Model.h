@@ -32,6 +32,7 @@
 
 #include "vertexArray.h"
 #include "ShaderProgram.h"
+#include "ObjLoader.h"
 //#include "ImageTexture.h"
 
 //using namespace boost;
@@ -40,11 +41,8 @@ using namespace glm;
 
 class Model {
 private:
-    struct Vertex {
-        vec3 Position;
-        vec3 Normal;
-        vec2 uvCoords;
-    };
+    //what the OBJ loader gives back
+    typedef ObjVertex Vertex;
     //struct Texture {
     //    GLuint id;
     //    //string type;
@@ -64,6 +62,8 @@ private:
 
     struct MeshData{
         vector<Vertex> vertices;
+        //three a triangle into vertices
+        vector<GLuint> indices;
         mat4 modelTransformation;
         Textures textures;
         UseTextures useTextures={false,false,false,false};
@@ -0,0 +1,70 @@
+//
+// Allocator for vectors whose data has to start on a given byte boundary
+// (used for the structure of arrays triangle data so SIMD loads are aligned)
+//
+
+#ifndef ASSIGNMENT4_ALIGNEDALLOCATOR_H
+#define ASSIGNMENT4_ALIGNEDALLOCATOR_H
+
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+template<typename T, size_t Alignment>
+class AlignedAllocator {
+public:
+    typedef T value_type;
+
+    template<typename U>
+    struct rebind {
+        typedef AlignedAllocator<U, Alignment> other;
+    };
+
+    AlignedAllocator() = default;
+
+    template<typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment> &) {}
+
+    T *allocate(size_t count) {
+        void *memory = nullptr;
+#ifdef _WIN32
+        memory = _aligned_malloc(count * sizeof(T), Alignment);
+#else
+        if(posix_memalign(&memory, Alignment, count * sizeof(T)) != 0){
+            memory = nullptr;
+        }
+#endif
+        if(memory == nullptr){
+            throw std::bad_alloc();
+        }
+        return static_cast<T *>(memory);
+    }
+
+    void deallocate(T *pointer, size_t) {
+#ifdef _WIN32
+        _aligned_free(pointer);
+#else
+        free(pointer);
+#endif
+    }
+};
+
+template<typename T, typename U, size_t Alignment>
+bool operator==(const AlignedAllocator<T, Alignment> &, const AlignedAllocator<U, Alignment> &) {
+    return true;
+}
+
+template<typename T, typename U, size_t Alignment>
+bool operator!=(const AlignedAllocator<T, Alignment> &, const AlignedAllocator<U, Alignment> &) {
+    return false;
+}
+
+//32 bytes covers both SSE and AVX loads
+template<typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T, 32>>;
+
+#endif //ASSIGNMENT4_ALIGNEDALLOCATOR_H
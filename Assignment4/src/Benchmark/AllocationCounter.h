@@ -0,0 +1,12 @@
+//
+// Counts every heap allocation the program makes (the global operator new is replaced in AllocationCounter.cpp)
+// so the benchmarks can check the render loop doesn't allocate.
+//
+
+#ifndef ASSIGNMENT4_ALLOCATIONCOUNTER_H
+#define ASSIGNMENT4_ALLOCATIONCOUNTER_H
+
+//Number of operator new calls since the program started, on any thread
+long long allocationCount();
+
+#endif //ASSIGNMENT4_ALLOCATIONCOUNTER_H
@@ -0,0 +1,1873 @@
+//
+// Benchmarks for the ray tracer, run with: ./Assignment4 --benchmark <name>
+//
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iterator>
+#include <random>
+#include <thread>
+
+#include "Benchmark.h"
+#include "AllocationCounter.h"
+#include "../Raytracer/RayTracer.h"
+#include "../Scene/SceneCache.h"
+#include "../Scene/Shading/PointLight.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+//Hardware counters like perf stat, read through perf_event_open. Counters the kernel or VM won't give us stay unavailable.
+class PerfCounters {
+private:
+    static const int counterCount = 4;
+    int descriptors[counterCount];
+    long long values[counterCount];
+
+public:
+    PerfCounters() {
+        for (int i = 0; i < counterCount; ++i) {
+            descriptors[i] = -1;
+            values[i] = -1;
+        }
+#ifdef __linux__
+        unsigned long long configs[counterCount] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                    PERF_COUNT_HW_CACHE_REFERENCES, PERF_COUNT_HW_CACHE_MISSES};
+        for (int i = 0; i < counterCount; ++i) {
+            perf_event_attr attributes;
+            memset(&attributes, 0, sizeof(attributes));
+            attributes.type = PERF_TYPE_HARDWARE;
+            attributes.size = sizeof(attributes);
+            attributes.config = configs[i];
+            attributes.disabled = 1;
+            attributes.exclude_kernel = 1;
+            attributes.exclude_hv = 1;
+            descriptors[i] = (int)syscall(__NR_perf_event_open, &attributes, 0, -1, -1, 0);
+        }
+#endif
+    }
+
+    ~PerfCounters() {
+#ifdef __linux__
+        for (int i = 0; i < counterCount; ++i) {
+            if(descriptors[i] != -1){
+                close(descriptors[i]);
+            }
+        }
+#endif
+    }
+
+    void start() {
+#ifdef __linux__
+        for (int i = 0; i < counterCount; ++i) {
+            if(descriptors[i] != -1){
+                ioctl(descriptors[i], PERF_EVENT_IOC_RESET, 0);
+                ioctl(descriptors[i], PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+#endif
+    }
+
+    void stop() {
+#ifdef __linux__
+        for (int i = 0; i < counterCount; ++i) {
+            if(descriptors[i] != -1){
+                ioctl(descriptors[i], PERF_EVENT_IOC_DISABLE, 0);
+                if(read(descriptors[i], &values[i], sizeof(long long)) != sizeof(long long)){
+                    values[i] = -1;
+                }
+            }
+        }
+#endif
+    }
+
+    //prints "cycles | instructions | cache refs | cache misses | miss %" with n/a for missing counters
+    void print() {
+        for (int i = 0; i < counterCount; ++i) {
+            if(values[i] < 0){
+                cout << " | " << setw(12) << "n/a";
+            }
+            else{
+                cout << " | " << setw(12) << values[i];
+            }
+        }
+        if(values[2] > 0 && values[3] >= 0){
+            cout << " | " << setw(6) << fixed << setprecision(2) << 100.0 * values[3] / values[2] << "%";
+        }
+        else{
+            cout << " | " << setw(7) << "n/a";
+        }
+    }
+};
+
+//Wall clock time of a function in milliseconds
+template<typename Function>
+static double timeMilliseconds(Function function) {
+    auto start = chrono::steady_clock::now();
+    function();
+    auto end = chrono::steady_clock::now();
+    return chrono::duration<double, milli>(end - start).count();
+}
+
+//Renders the scene with the camera used by main, returns the time taken in milliseconds
+static double timeRender(Scene &scene, int width, int height, int samples, int depth, int threads) {
+    ImageData imageData(width, height);
+    Camera camera(vec3(278, 273, -500), vec3(278, 273, 0), vec3(1, 0, 0), 55, (float)height / (float)width);
+    RayTracer rayTracer(samples, width, height, depth, scene, threads);
+    rayTracer.setShowProgress(false);
+    return timeMilliseconds([&] { rayTracer.cpuRender(&imageData, camera); });
+}
+
+//Speedup of the tiled renderer over a single thread for 1 to 64 threads on both built in scenes
+static int benchmarkThreads() {
+    const int width = 256, height = 256, samples = 2, depth = 4;
+    string sceneNames[2] = {"--default", "--yours"};
+    Scene scenes[2];
+    for (int i = 0; i < 2; ++i) {
+        scenes[i].setupScene(sceneNames[i]);
+    }
+
+    cout << "Render time at " << width << "x" << height << ", " << samples << "x" << samples
+         << " samples, depth " << depth << " (" << ThreadPool::hardwareThreads() << " hardware threads)" << endl;
+    cout << "threads | default ms | speedup | yours ms | speedup" << endl;
+    double singleThreaded[2] = {0, 0};
+    for (int threads = 1; threads <= 64; threads *= 2) {
+        cout << setw(7) << threads;
+        for (int i = 0; i < 2; ++i) {
+            double milliseconds = timeRender(scenes[i], width, height, samples, depth, threads);
+            if(threads == 1){
+                singleThreaded[i] = milliseconds;
+            }
+            cout << " | " << setw(10) << fixed << setprecision(1) << milliseconds
+                 << " | " << setw(6) << setprecision(2) << singleThreaded[i] / milliseconds << "x";
+        }
+        cout << endl;
+    }
+    return 0;
+}
+
+//Unit sphere tessellated into roughly triangleCount triangles
+static Mesh makeSphereMesh(int triangleCount) {
+    int stacks = std::max(2, (int)sqrt(triangleCount / 4.0));
+    int slices = std::max(3, triangleCount / (2 * stacks));
+    Mesh mesh;
+    auto point = [&](int stack, int slice) {
+        float theta = (float)stack / (float)stacks * 3.14159265f;
+        float phi = (float)slice / (float)slices * 2.0f * 3.14159265f;
+        return vec3(sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi));
+    };
+    for (int stack = 0; stack < stacks; ++stack) {
+        for (int slice = 0; slice < slices; ++slice) {
+            vec3 p0 = point(stack, slice), p1 = point(stack + 1, slice);
+            vec3 p2 = point(stack + 1, slice + 1), p3 = point(stack, slice + 1);
+            mesh.addTriangle({p0, p1, p2}, normalize(p0 + p2));
+            mesh.addTriangle({p0, p2, p3}, normalize(p0 + p2));
+        }
+    }
+    return mesh;
+}
+
+//Rays from a shell around the unit sphere aimed at random points near it, some of them miss
+static vector<Ray> makeRays(int rayCount) {
+    mt19937 generator(453);
+    uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+    vector<Ray> rays;
+    for (int i = 0; i < rayCount; ++i) {
+        vec3 origin = normalize(vec3(distribution(generator), distribution(generator), distribution(generator))) * 3.0f;
+        vec3 target = vec3(distribution(generator), distribution(generator), distribution(generator)) * 1.2f;
+        rays.emplace_back(origin, normalize(target - origin));
+    }
+    return rays;
+}
+
+//Rays per second of the linear triangle loop and the BVH against the number of triangles in the mesh
+static int benchmarkBVH() {
+    cout << "triangles | build ms | linear rays/s |    BVH rays/s | speedup | hits match" << endl;
+    for (int triangleCount = 100; triangleCount <= 1000000; triangleCount *= 10) {
+        Mesh mesh = makeSphereMesh(triangleCount);
+        double buildMilliseconds = timeMilliseconds([&] { mesh.buildBVH(); });
+
+        //keep the linear run to about the same number of triangle tests at every size
+        vector<Ray> linearRays = makeRays(std::max(20, 20000000 / mesh.meshData.triangleCount()));
+        vector<Ray> bvhRays = makeRays(200000);
+        float linearSum = 0, bvhSum = 0;
+        double linearMilliseconds = timeMilliseconds([&] {
+            for (size_t i = 0; i < linearRays.size(); ++i) {
+                float tNear = RAY_T_MAX;
+                int index;
+                vec2 uv;
+                if(mesh.intersectLinear(linearRays[i], tNear, index, uv)){
+                    linearSum += tNear;
+                }
+            }
+        });
+        double bvhMilliseconds = timeMilliseconds([&] {
+            for (size_t i = 0; i < bvhRays.size(); ++i) {
+                float tNear = RAY_T_MAX;
+                int index;
+                vec2 uv;
+                if(mesh.intersect(bvhRays[i], tNear, index, uv)){
+                    bvhSum += tNear;
+                }
+            }
+        });
+        //both paths have to agree on the closest hit for the rays they share
+        bool hitsMatch = true;
+        for (size_t i = 0; i < linearRays.size(); ++i) {
+            float linearNear = RAY_T_MAX, bvhNear = RAY_T_MAX;
+            int index;
+            vec2 uv;
+            mesh.intersectLinear(linearRays[i], linearNear, index, uv);
+            mesh.intersect(linearRays[i], bvhNear, index, uv);
+            hitsMatch &= linearNear == bvhNear;
+        }
+
+        double linearRate = linearRays.size() / (linearMilliseconds / 1000.0);
+        double bvhRate = bvhRays.size() / (bvhMilliseconds / 1000.0);
+        cout << setw(9) << mesh.meshData.triangleCount()
+             << " | " << setw(8) << fixed << setprecision(1) << buildMilliseconds
+             << " | " << setw(13) << setprecision(0) << linearRate
+             << " | " << setw(13) << bvhRate
+             << " | " << setw(6) << setprecision(1) << bvhRate / linearRate << "x"
+             << " | " << (hitsMatch ? "yes" : "NO") << endl;
+        //keeps the compiler from throwing the loops away
+        if(linearSum < 0 || bvhSum < 0){
+            cout << linearSum << bvhSum << endl;
+        }
+    }
+    return 0;
+}
+
+//Stands in for the shared mesh and counts how many times rays reach its bottom level BVH through an instance
+class CountingModel: public Model {
+private:
+    shared_ptr<Mesh> mesh;
+
+public:
+    static long long intersectCalls;
+
+    explicit CountingModel(shared_ptr<Mesh> mesh) : mesh(mesh) {}
+
+    bool intersect(Ray &ray, float &tNearI, int &indexI, vec2 &uvI) override {
+        intersectCalls++;
+        return mesh->intersect(ray, tNearI, indexI, uvI);
+    }
+    void getSurfaceProperties(vec3 &hitPoint, Ray &ray, int &index, vec2 &uv, vec3 &normal, vec2 &stCoords) override {
+        mesh->getSurfaceProperties(hitPoint, ray, index, uv, normal, stCoords);
+    }
+    AABB getBounds() override {
+        return mesh->getBounds();
+    }
+};
+long long CountingModel::intersectCalls = 0;
+
+//Memory use and traversal cost of 10,000 instances of one shared mesh with the top level BVH and the old model loop
+static int benchmarkInstances() {
+    const int gridSize = 100;
+    shared_ptr<Mesh> mesh = make_shared<Mesh>(makeSphereMesh(1000));
+    mesh->buildBVH();
+
+    mt19937 generator(453);
+    uniform_real_distribution<float> distribution(0.0f, 1.0f);
+    shared_ptr<CountingModel> countingMesh = make_shared<CountingModel>(mesh);
+    Scene scene;
+    scene.getInstances().reserve(gridSize * gridSize);
+    for (int x = 0; x < gridSize; ++x) {
+        for (int z = 0; z < gridSize; ++z) {
+            Instance instance(countingMesh);
+            instance.setPosition(vec3(x * 3.0f, 0, z * 3.0f));
+            instance.setRotation(vec3(0, distribution(generator) * 360.0f, 0));
+            instance.setScale(vec3(0.5f + distribution(generator) * 0.5f));
+            scene.addInstance(instance);
+        }
+    }
+    vector<Instance> &instances = scene.getInstances();
+    RenderContext context(scene, Camera(vec3(0), vec3(0, 0, 1), vec3(0, 1, 0), 55, 1));
+
+    RayTracer rayTracer;
+    double buildMilliseconds = timeMilliseconds([&] { rayTracer.buildSceneBVH(context); });
+
+    size_t meshBytes = mesh->meshData.vertices.capacity() * sizeof(Mesh::Vertex)
+                       + mesh->meshData.indices.capacity() * sizeof(uint32_t)
+                       + mesh->bvh.nodes.capacity() * sizeof(BVHNode) + mesh->bvh.primitiveIndices.capacity() * sizeof(int);
+    size_t instanceBytes = instances.capacity() * sizeof(Instance);
+    size_t topLevelBytes = rayTracer.getSceneBVH().nodes.capacity() * sizeof(BVHNode)
+                           + rayTracer.getSceneBVH().primitiveIndices.capacity() * sizeof(int);
+    cout << instances.size() << " instances of a " << mesh->meshData.triangleCount() << " triangle mesh" << endl;
+    cout << "shared mesh + BVH:     " << setw(12) << meshBytes << " bytes" << endl;
+    cout << "instances:             " << setw(12) << instanceBytes << " bytes" << endl;
+    cout << "top level BVH:         " << setw(12) << topLevelBytes << " bytes (built in "
+         << fixed << setprecision(1) << buildMilliseconds << " ms)" << endl;
+    cout << "total:                 " << setw(12) << meshBytes + instanceBytes + topLevelBytes << " bytes" << endl;
+    cout << "copying the mesh each: " << setw(12) << meshBytes * instances.size() + topLevelBytes << " bytes" << endl;
+
+    //rays looking down onto the grid from above at a slant
+    auto makeGridRays = [&](int rayCount) {
+        vector<Ray> rays;
+        for (int i = 0; i < rayCount; ++i) {
+            vec3 target(distribution(generator) * gridSize * 3.0f, 0, distribution(generator) * gridSize * 3.0f);
+            vec3 origin = target + vec3(-40, 60, -30);
+            rays.emplace_back(origin, normalize(target - origin));
+        }
+        return rays;
+    };
+    auto traceAll = [&](vector<Ray> &rays, bool linear) {
+        float tSum = 0;
+        for (size_t i = 0; i < rays.size(); ++i) {
+            float tNear = RAY_T_MAX;
+            int index;
+            vec2 uv;
+            int hitModel;
+            bool hit = linear ? rayTracer.traceLinear(rays[i], context, tNear, index, uv, hitModel)
+                              : rayTracer.trace(rays[i], context, tNear, index, uv, hitModel);
+            if(hit){
+                tSum += tNear;
+            }
+        }
+        return tSum;
+    };
+
+    cout << endl << "path       |       rays/s | instances tested per ray" << endl;
+    for (int linear = 1; linear >= 0; --linear) {
+        vector<Ray> rays = makeGridRays(linear ? 2000 : 200000);
+        CountingModel::intersectCalls = 0;
+        float tSum = 0;
+        double milliseconds = timeMilliseconds([&] { tSum = traceAll(rays, linear == 1); });
+        cout << (linear ? "model loop" : "two level ") << " | " << setw(12) << setprecision(0)
+             << rays.size() / (milliseconds / 1000.0) << " | " << setw(10) << setprecision(2)
+             << (double)CountingModel::intersectCalls / rays.size() << endl;
+        if(tSum < 0){
+            cout << tSum << endl;
+        }
+    }
+    return 0;
+}
+
+//Closest hit queries per second against an OBJ file (or a million triangle sphere without one), rays come from all
+//around the mesh and aim inside its bounds.
+//Compares walking the BVH with the full 96 byte triangles against the structure of arrays intersection data.
+static int benchmarkOBJ(string filepath) {
+    Mesh mesh;
+    double loadMilliseconds = timeMilliseconds([&] {
+        if(filepath.empty()){
+            filepath = "sphere";
+            mesh = makeSphereMesh(1000000);
+            mesh.buildBVH();
+        }
+        else{
+            mesh.openOBJ(filepath);
+        }
+    });
+    if(mesh.meshData.indices.empty()){
+        return 1;
+    }
+    AABB bounds = mesh.getBounds();
+    vec3 center = bounds.center();
+    float radius = length(bounds.maximum - bounds.minimum);
+
+    mt19937 generator(453);
+    uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+    vector<Ray> rays;
+    for (int i = 0; i < 1000000; ++i) {
+        vec3 origin = center + normalize(vec3(distribution(generator), distribution(generator), distribution(generator))) * radius;
+        vec3 target = center + vec3(distribution(generator), distribution(generator), distribution(generator))
+                               * (bounds.maximum - bounds.minimum) * 0.5f;
+        rays.emplace_back(origin, normalize(target - origin));
+    }
+    cout << filepath << ": " << mesh.meshData.triangleCount() << " triangles, loaded and built in "
+         << fixed << setprecision(1) << loadMilliseconds << " ms" << endl;
+
+    //the intersection loop as it was before the triangles got their structure of arrays copy (reading the vertices)
+    auto intersectTriangleStructs = [&](Ray &ray, float &tNearI, int &indexI, vec2 &uvI) {
+        return mesh.bvh.traverse(ray, tNearI, [&](int first, int count, float &tNear) {
+            bool hit = false;
+            for (int i = first; i < first + count; ++i) {
+                float tNearTemp = tNear;
+                vec2 uvTemp;
+                if (mesh.rayTriangleIntersect(i, ray, tNearTemp, uvTemp) && tNearTemp < tNear) {
+                    tNear = tNearTemp;
+                    uvI = uvTemp;
+                    indexI = i;
+                    hit = true;
+                }
+            }
+            return hit;
+        });
+    };
+
+    //the structure of arrays runs once with the scalar test (to compare layouts) and once with the widest kernel
+    SimdLevel simdLevel = getSimdLevel();
+    cout << "layout              |       rays/s |       cycles | instructions |   cache refs | cache misses |  miss %" << endl;
+    for (int run = 0; run < 3; ++run) {
+        setSimdLevel(run == 2 ? simdLevel : SIMD_SCALAR);
+        PerfCounters counters;
+        int hits = 0;
+        counters.start();
+        double milliseconds = timeMilliseconds([&] {
+            for (size_t i = 0; i < rays.size(); ++i) {
+                float tNear = RAY_T_MAX;
+                int index;
+                vec2 uv;
+                hits += run > 0 ? mesh.intersect(rays[i], tNear, index, uv) : intersectTriangleStructs(rays[i], tNear, index, uv);
+            }
+        });
+        counters.stop();
+        string layout = run == 0 ? "indexed vertices" : string("arrays, ") + simdLevelName(getSimdLevel());
+        cout << setw(19) << left << layout << right << " | " << setw(12) << setprecision(0)
+             << rays.size() / (milliseconds / 1000.0);
+        counters.print();
+        cout << endl;
+    }
+    setSimdLevel(simdLevel);
+    return 0;
+}
+
+//Ray triangle tests per second for every kernel this CPU supports, on batches the size of a BVH leaf and bigger.
+//Every kernel has to give exactly the same closest hit (t, uv and index) as the scalar one.
+static int benchmarkSIMD() {
+    const int triangleCount = 64;
+    const int rayCount = 200000;
+    mt19937 generator(812);
+    uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+    TriangleIntersectData data;
+    data.resize(triangleCount);
+    for (int i = 0; i < triangleCount; ++i) {
+        vec3 v0(distribution(generator), distribution(generator), distribution(generator));
+        vec3 v1 = v0 + vec3(distribution(generator), distribution(generator), distribution(generator)) * 0.5f;
+        vec3 v2 = v0 + vec3(distribution(generator), distribution(generator), distribution(generator)) * 0.5f;
+        data.setTriangle(i, v0, v1 - v0, v2 - v0);
+    }
+    vector<Ray> rays = makeRays(rayCount);
+
+    struct Hit {
+        float t;
+        vec2 uv;
+        int index;
+    };
+    SimdLevel detected = detectSimdLevel();
+    cout << "Detected: " << simdLevelName(detected) << endl;
+    cout << "kernel  | batch |     tests/s | speedup | hits  | matches scalar" << endl;
+    int batchSizes[] = {8, 64};
+    for (int batchSize : batchSizes) {
+        vector<Hit> scalarHits;
+        double scalarRate = 0;
+        for (int level = SIMD_SCALAR; level <= detected; ++level) {
+            setSimdLevel((SimdLevel)level);
+            vector<Hit> hits(rays.size());
+            double milliseconds = timeMilliseconds([&] {
+                for (size_t i = 0; i < rays.size(); ++i) {
+                    Hit hit = {RAY_T_MAX, vec2(0), -1};
+                    for (int first = 0; first < triangleCount; first += batchSize) {
+                        intersectTriangles(data, first, batchSize, rays[i].getOrigin(), rays[i].getDirection(),
+                                           hit.t, hit.uv, hit.index);
+                    }
+                    hits[i] = hit;
+                }
+            });
+            double rate = (double)rays.size() * triangleCount / (milliseconds / 1000.0);
+            int hitCount = 0;
+            bool matches = true;
+            if(level == SIMD_SCALAR){
+                scalarHits = hits;
+                scalarRate = rate;
+            }
+            for (size_t i = 0; i < hits.size(); ++i) {
+                hitCount += hits[i].index >= 0;
+                matches &= memcmp(&hits[i], &scalarHits[i], sizeof(Hit)) == 0;
+            }
+            cout << setw(7) << left << simdLevelName((SimdLevel)level) << right << " | " << setw(5) << batchSize
+                 << " | " << setw(11) << fixed << setprecision(0) << rate << " | " << setw(6) << setprecision(2)
+                 << rate / scalarRate << "x | " << setw(5) << hitCount << " | " << (matches ? "yes" : "NO") << endl;
+            if(!matches){
+                setSimdLevel(detected);
+                return 1;
+            }
+        }
+    }
+    setSimdLevel(detected);
+    return 0;
+}
+
+//Primary visibility rays per second traced one at a time and in 2x2, 4x4 and 8x8 packets on both built in scenes,
+//then whole renders at each packet size. Hits and images have to match the single ray ones exactly.
+static int benchmarkPackets() {
+    const int width = 1024, height = 1024;
+    string sceneNames[2] = {"--default", "--yours"};
+    int packetSizes[4] = {1, 2, 4, 8};
+    bool allMatch = true;
+    cout << "Primary rays at " << width << "x" << height << ", 1 sample" << endl;
+    cout << "scene     | packet |      rays/s | speedup | hits match" << endl;
+    for (int s = 0; s < 2; ++s) {
+        Scene scene;
+        string sceneName = sceneNames[s];
+        scene.setupScene(sceneName);
+        Camera camera(vec3(278, 273, -500), vec3(278, 273, 0), vec3(1, 0, 0), 55, (float)height / (float)width);
+        RenderContext context(scene, camera);
+        RayTracer rayTracer(1, width, height, 4, scene, 1);
+        rayTracer.buildSceneBVH(context);
+
+        //what each pixel's ray hit, as (model, triangle, t)
+        vector<int> singleModels(width * height);
+        vector<int> singleIndices(width * height);
+        vector<float> singleT(width * height);
+        double singleRate = 0;
+        for (int packetSize : packetSizes) {
+            bool match = true;
+            RayPacket packet;
+            int hitModels[RayPacket::maxRays];
+            double milliseconds = timeMilliseconds([&] {
+                for (int blockY = 0; blockY < height; blockY += packetSize) {
+                    for (int blockX = 0; blockX < width; blockX += packetSize) {
+                        rayTracer.makePrimaryPacket(packet, camera, blockX, blockY, packetSize, packetSize, 0);
+                        if(packetSize == 1){
+                            Ray ray(packet.origin, packet.direction[0]);
+                            packet.tNear[0] = RAY_T_MAX;
+                            rayTracer.trace(ray, context, packet.tNear[0], packet.index[0], packet.uv[0], hitModels[0]);
+                        }
+                        else{
+                            rayTracer.tracePacket(packet, context, hitModels);
+                        }
+                        for (int k = 0; k < packet.rayCount; ++k) {
+                            int pixel = (blockY + k / packetSize) * width + blockX + k % packetSize;
+                            if(packetSize == 1){
+                                singleModels[pixel] = hitModels[k];
+                                singleIndices[pixel] = packet.index[k];
+                                singleT[pixel] = packet.tNear[k];
+                            }
+                            //spheres don't set the triangle index so only the meshes' are compared
+                            else if(hitModels[k] != singleModels[pixel] || (hitModels[k] >= 0
+                                    && (packet.tNear[k] != singleT[pixel] || (context.modelType(hitModels[k]) != SPHERE_MODEL
+                                                                               && packet.index[k] != singleIndices[pixel])))){
+                                match = false;
+                            }
+                        }
+                    }
+                }
+            });
+            double rate = (double)width * height / (milliseconds / 1000.0);
+            if(packetSize == 1){
+                singleRate = rate;
+            }
+            allMatch &= match;
+            cout << setw(9) << left << sceneNames[s].substr(2) << right << " | " << setw(3) << packetSize << "x"
+                 << setw(2) << left << packetSize << right << " | " << setw(11) << fixed << setprecision(0) << rate
+                 << " | " << setw(6) << setprecision(2) << rate / singleRate << "x | " << (match ? "yes" : "NO") << endl;
+        }
+    }
+
+    const int renderWidth = 512, renderHeight = 512, samples = 2, depth = 4;
+    cout << endl << "Whole renders at " << renderWidth << "x" << renderHeight << ", " << samples << "x" << samples
+         << " samples, depth " << depth << ", 1 thread" << endl;
+    cout << "scene     | packet |     ms | speedup | image matches" << endl;
+    for (int s = 0; s < 2; ++s) {
+        Scene scene;
+        string sceneName = sceneNames[s];
+        scene.setupScene(sceneName);
+        Camera camera(vec3(278, 273, -500), vec3(278, 273, 0), vec3(1, 0, 0), 55,
+                      (float)renderHeight / (float)renderWidth);
+        ImageData singleImage(renderWidth, renderHeight);
+        double singleMilliseconds = 0;
+        for (int packetSize : packetSizes) {
+            ImageData imageData(renderWidth, renderHeight);
+            RayTracer rayTracer(samples, renderWidth, renderHeight, depth, scene, 1);
+            rayTracer.setShowProgress(false);
+            rayTracer.setPacketSize(packetSize);
+            double milliseconds = timeMilliseconds([&] { rayTracer.cpuRender(&imageData, camera); });
+            bool match = true;
+            if(packetSize == 1){
+                singleImage = imageData;
+                singleMilliseconds = milliseconds;
+            }
+            for (int y = 0; y < renderHeight; ++y) {
+                for (int x = 0; x < renderWidth; ++x) {
+                    match &= imageData.getPixel(x, y) == singleImage.getPixel(x, y);
+                }
+            }
+            allMatch &= match;
+            cout << setw(9) << left << sceneNames[s].substr(2) << right << " | " << setw(3) << packetSize << "x"
+                 << setw(2) << left << packetSize << right << " | " << setw(6) << fixed << setprecision(0) << milliseconds
+                 << " | " << setw(6) << setprecision(2) << singleMilliseconds / milliseconds << "x | "
+                 << (match ? "yes" : "NO") << endl;
+        }
+    }
+    return allMatch ? 0 : 1;
+}
+
+//Shadow rays per second with the closest hit trace the renderer used to do (then comparing the distance to the light)
+//and with the any hit occlusion query. The shadow rays are the ones computeDiffuse makes for the first hit of every
+//pixel at 512x512, and both ways have to agree on every one of them.
+static int benchmarkShadows() {
+    const int width = 512, height = 512;
+    string sceneNames[2] = {"--default", "--yours"};
+    bool allMatch = true;
+    cout << "scene     | shadow rays | blocked | closest hit rays/s | any hit rays/s | speedup | match" << endl;
+    for (int s = 0; s < 2; ++s) {
+        Scene scene;
+        string sceneName = sceneNames[s];
+        scene.setupScene(sceneName);
+        Camera camera(vec3(278, 273, -500), vec3(278, 273, 0), vec3(1, 0, 0), 55, (float)height / (float)width);
+        RenderContext context(scene, camera);
+        const vector<Light*> &lights = context.lights;
+        RayTracer rayTracer(1, width, height, 4, scene, 1);
+        rayTracer.buildSceneBVH(context);
+
+        vector<Ray> shadowRays;
+        vector<float> lightDistances;
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                Ray ray = camera.generateRay(rayTracer.sampleCoord(x, y, 0));
+                float tNear = RAY_T_MAX;
+                int index = 0;
+                vec2 uv;
+                int hitModel;
+                if(!rayTracer.trace(ray, context, tNear, index, uv, hitModel)){
+                    continue;
+                }
+                vec3 hitPoint = ray.calculate(tNear);
+                vec3 normal;
+                vec2 stCoords;
+                context.getSurfaceProperties(hitModel, hitPoint, ray, index, uv, normal, stCoords);
+                for (size_t i = 0; i < lights.size(); ++i) {
+                    vec3 lightDirection = lights[i]->getDirection(hitPoint);
+                    Ray shadowRay(hitPoint + normal, normalize(lightDirection));
+                    shadowRay.visibilityMask = CASTS_SHADOWS;
+                    shadowRays.push_back(shadowRay);
+                    lightDistances.push_back(lengthSquared(lightDirection));
+                }
+            }
+        }
+
+        vector<char> closestBlocked(shadowRays.size()), anyBlocked(shadowRays.size());
+        double closestMilliseconds = timeMilliseconds([&] {
+            for (size_t i = 0; i < shadowRays.size(); ++i) {
+                float tNear = RAY_T_MAX;
+                int index;
+                vec2 uv;
+                int hitModel;
+                closestBlocked[i] = rayTracer.trace(shadowRays[i], context, tNear, index, uv, hitModel)
+                                    && square(tNear) < lightDistances[i];
+            }
+        });
+        //turning the squared light distance into a ray length is part of the cost so it's timed too
+        double anyMilliseconds = timeMilliseconds([&] {
+            for (size_t i = 0; i < shadowRays.size(); ++i) {
+                anyBlocked[i] = rayTracer.occluded(shadowRays[i], RayTracer::shadowRayLength(lightDistances[i]), context);
+            }
+        });
+        bool match = closestBlocked == anyBlocked;
+        allMatch &= match;
+        double closestRate = shadowRays.size() / (closestMilliseconds / 1000.0);
+        double anyRate = shadowRays.size() / (anyMilliseconds / 1000.0);
+        cout << setw(9) << left << sceneNames[s].substr(2) << right << " | " << setw(11) << shadowRays.size()
+             << " | " << setw(6) << fixed << setprecision(1)
+             << 100.0 * count(anyBlocked.begin(), anyBlocked.end(), 1) / shadowRays.size() << "%"
+             << " | " << setw(18) << setprecision(0) << closestRate << " | " << setw(14) << anyRate
+             << " | " << setw(6) << setprecision(2) << anyRate / closestRate << "x | " << (match ? "yes" : "NO") << endl;
+    }
+    return allMatch ? 0 : 1;
+}
+
+//Heap allocations made while rendering every tile of both scenes once everything is warmed up (the first tile is
+//rendered once beforehand), with and without packets. Once warm the render loop shouldn't allocate at all.
+static int benchmarkAllocations() {
+    const int width = 256, height = 256, samples = 2, depth = 4;
+    string sceneNames[2] = {"--default", "--yours"};
+    bool allocationFree = true;
+    cout << "Rendering " << width << "x" << height << ", " << samples << "x" << samples << " samples, depth " << depth
+         << " one tile at a time" << endl;
+    cout << "scene     | packet | allocations | per pixel | whole cpuRender (setup included)" << endl;
+    string modeNames[3] = {"  1x1 ", "  8x8 ", " wave "};
+    for (int s = 0; s < 2; ++s) {
+        Scene scene;
+        string sceneName = sceneNames[s];
+        scene.setupScene(sceneName);
+        Camera camera(vec3(278, 273, -500), vec3(278, 273, 0), vec3(1, 0, 0), 55, (float)height / (float)width);
+        //packets of 1 and 8x8, then wavefront (whose queues only stop growing after the tile needing the most, the
+        //cpuRender before has been through all of them)
+        for (int mode = 0; mode < 3; ++mode) {
+            RayTracer rayTracer(samples, width, height, depth, scene, 1);
+            rayTracer.setShowProgress(false);
+            rayTracer.setPacketSize(mode == 1 ? 8 : 1);
+            rayTracer.setWavefront(mode == 2);
+
+            ImageData imageData(width, height);
+            long long renderStart = allocationCount();
+            rayTracer.cpuRender(&imageData, camera);
+            long long renderAllocations = allocationCount() - renderStart;
+
+            const RenderContext context(scene, camera);
+            rayTracer.buildSceneBVH(context);
+            rayTracer.renderTile(0, &imageData, context);
+            long long start = allocationCount();
+            for (int tileIndex = 0; tileIndex < rayTracer.getTileCount(); ++tileIndex) {
+                rayTracer.renderTile(tileIndex, &imageData, context);
+            }
+            long long allocations = allocationCount() - start;
+            allocationFree &= allocations == 0;
+            cout << setw(9) << left << sceneNames[s].substr(2) << right << " | " << modeNames[mode] << " | "
+                 << setw(11) << allocations << " | " << setw(9)
+                 << fixed << setprecision(3) << (double)allocations / (width * height) << " | " << setw(6)
+                 << renderAllocations << endl;
+        }
+    }
+    return allocationFree ? 0 : 1;
+}
+
+//Closest hits through the scene BVH calling every model through Model's vtable the way the tracer used to, and through
+//the render context's type switch. Primary rays at 1024x1024 on both built in scenes and on a wall of 10,000 spheres
+//(where the sphere test is most of the work). Both ways have to find the same hits.
+static int benchmarkDispatch() {
+    const int width = 1024, height = 1024;
+    string sceneNames[3] = {"--default", "--yours", "--spheres"};
+    bool allMatch = true;
+    cout << "scene     | models |  virtual rays/s | type switch rays/s | speedup | hits match" << endl;
+    for (int s = 0; s < 3; ++s) {
+        Scene scene;
+        if(s < 2){
+            string sceneName = sceneNames[s];
+            scene.setupScene(sceneName);
+        }
+        else{
+            mt19937 generator(453);
+            uniform_real_distribution<float> distribution(0.0f, 1.0f);
+            Material material;
+            for (int i = 0; i < 10000; ++i) {
+                vec3 position(distribution(generator) * 556, distribution(generator) * 546, distribution(generator) * 600);
+                scene.addSphere(position, 3 + (int)(distribution(generator) * 6), material);
+            }
+        }
+        Camera camera(vec3(278, 273, -500), vec3(278, 273, 0), vec3(1, 0, 0), 55, (float)height / (float)width);
+        RenderContext context(scene, camera);
+        RayTracer rayTracer(1, width, height, 4, scene, 1);
+        rayTracer.buildSceneBVH(context);
+        BVH &sceneBVH = rayTracer.getSceneBVH();
+
+        vector<Model*> modelSet;
+        for (int i = 0; i < context.modelCount(); ++i) {
+            modelSet.push_back(&context.getModel(i));
+        }
+        //the tracer's closest hit loop before the type switch, every model is a Model* so every call is virtual
+        auto traceVirtual = [&](Ray &ray, float &tNear, int &index, vec2 &uv) {
+            int hitModel = -1;
+            sceneBVH.traverse(ray, tNear, [&](int first, int count, float &tClosest) {
+                bool hit = false;
+                for (int i = first; i < first + count; ++i) {
+                    int model = sceneBVH.primitiveIndices[i];
+                    if((modelSet[model]->visibilityMask & ray.visibilityMask) == 0){
+                        continue;
+                    }
+                    float tNearI = nextafterf(tClosest, RAY_T_MAX);
+                    int indexI;
+                    vec2 uvI;
+                    if(modelSet[model]->intersect(ray, tNearI, indexI, uvI)
+                       && (tNearI < tClosest || (tNearI == tClosest && model < hitModel))){
+                        hitModel = model;
+                        tClosest = tNearI;
+                        index = indexI;
+                        uv = uvI;
+                        hit = true;
+                    }
+                }
+                return hit;
+            });
+            return hitModel;
+        };
+
+        vector<Ray> rays;
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                rays.push_back(camera.generateRay(rayTracer.sampleCoord(x, y, 0)));
+            }
+        }
+        vector<int> virtualModels(rays.size()), virtualIndices(rays.size()), switchModels(rays.size()),
+                switchIndices(rays.size());
+        vector<float> virtualT(rays.size()), switchT(rays.size());
+        //taking turns and keeping the best of 3 since the gap is small next to the noise on a shared machine
+        double virtualMilliseconds = INFINITY, switchMilliseconds = INFINITY;
+        for (int run = 0; run < 3; ++run) {
+            virtualMilliseconds = std::min(virtualMilliseconds, timeMilliseconds([&] {
+                for (size_t i = 0; i < rays.size(); ++i) {
+                    virtualT[i] = RAY_T_MAX;
+                    vec2 uv;
+                    virtualModels[i] = traceVirtual(rays[i], virtualT[i], virtualIndices[i], uv);
+                }
+            }));
+            switchMilliseconds = std::min(switchMilliseconds, timeMilliseconds([&] {
+                for (size_t i = 0; i < rays.size(); ++i) {
+                    switchT[i] = RAY_T_MAX;
+                    vec2 uv;
+                    rayTracer.trace(rays[i], context, switchT[i], switchIndices[i], uv, switchModels[i]);
+                }
+            }));
+        }
+        bool match = true;
+        for (size_t i = 0; i < rays.size(); ++i) {
+            //spheres don't set the triangle index so only the meshes' are compared
+            if(virtualModels[i] != switchModels[i] || (switchModels[i] >= 0 && (virtualT[i] != switchT[i]
+                    || (context.modelType(switchModels[i]) != SPHERE_MODEL && virtualIndices[i] != switchIndices[i])))){
+                match = false;
+            }
+        }
+        allMatch &= match;
+        double virtualRate = rays.size() / (virtualMilliseconds / 1000.0);
+        double switchRate = rays.size() / (switchMilliseconds / 1000.0);
+        cout << setw(9) << left << sceneNames[s].substr(2) << right << " | " << setw(6) << context.modelCount()
+             << " | " << setw(15) << fixed << setprecision(0) << virtualRate << " | " << setw(18) << switchRate
+             << " | " << setw(6) << setprecision(2) << switchRate / virtualRate << "x | " << (match ? "yes" : "NO") << endl;
+    }
+    return allMatch ? 0 : 1;
+}
+
+//Peak signal to noise ratio in dB of an image against a reference, on the 0-1 values writeToPPM would save
+static double psnr(ImageData &image, ImageData &reference, int width, int height) {
+    double squaredError = 0;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            vec3 imageColor = image.getPixel(x, y);
+            vec3 referenceColor = reference.getPixel(x, y);
+            Color pixel(imageColor.r, imageColor.g, imageColor.b, 1.0f);
+            Color referencePixel(referenceColor.r, referenceColor.g, referenceColor.b, 1.0f);
+            pixel.applyGammaCorrection(1.2f, 0.75f);
+            referencePixel.applyGammaCorrection(1.2f, 0.75f);
+            pixel.clampColor();
+            referencePixel.clampColor();
+            squaredError += square(pixel.r - referencePixel.r) + square(pixel.g - referencePixel.g)
+                            + square(pixel.b - referencePixel.b);
+        }
+    }
+    double meanSquaredError = squaredError / (3.0 * width * height);
+    return meanSquaredError > 0 ? 10.0 * log10(1.0 / meanSquaredError) : INFINITY;
+}
+
+//Samples per pixel, time and PSNR against a 16x16 sample reference for the fixed stratified grid at 1x1 to 4x4 and the
+//adaptive sampler capped at 4x4 and 6x6, on both built in scenes
+static int benchmarkAdaptive() {
+    const int width = 256, height = 256, depth = 4, referenceSamples = 16;
+    string sceneNames[2] = {"--default", "--yours"};
+    cout << "Rendering " << width << "x" << height << ", depth " << depth << ", PSNR against a " << referenceSamples
+         << "x" << referenceSamples << " sample render" << endl;
+    cout << "scene     | sampler        | samples/pixel |      ms | PSNR dB" << endl;
+    for (int s = 0; s < 2; ++s) {
+        Scene scene;
+        string sceneName = sceneNames[s];
+        scene.setupScene(sceneName);
+        Camera camera(vec3(278, 273, -500), vec3(278, 273, 0), vec3(1, 0, 0), 55, (float)height / (float)width);
+        auto render = [&](ImageData &image, int samples, bool adaptive, double &samplesPerPixel) {
+            RayTracer rayTracer(samples, width, height, depth, scene, 0);
+            rayTracer.setShowProgress(false);
+            rayTracer.setAdaptive(adaptive);
+            double milliseconds = timeMilliseconds([&] { rayTracer.cpuRender(&image, camera); });
+            samplesPerPixel = (double)rayTracer.getSampleCount() / (width * height);
+            return milliseconds;
+        };
+        ImageData reference(width, height);
+        double referenceSamplesPerPixel;
+        render(reference, referenceSamples, false, referenceSamplesPerPixel);
+
+        int gridSizes[6] = {1, 2, 3, 4, 4, 6};
+        for (int i = 0; i < 6; ++i) {
+            bool adaptive = i >= 4;
+            ImageData image(width, height);
+            double samplesPerPixel;
+            double milliseconds = render(image, gridSizes[i], adaptive, samplesPerPixel);
+            string sampler = string(adaptive ? "adaptive " : "fixed    ") + to_string(gridSizes[i]) + "x"
+                             + to_string(gridSizes[i]);
+            cout << setw(9) << left << sceneNames[s].substr(2) << " | " << setw(14) << sampler << right << " | "
+                 << setw(13) << fixed << setprecision(2) << samplesPerPixel << " | " << setw(7) << setprecision(1)
+                 << milliseconds << " | " << setw(7) << setprecision(2) << psnr(image, reference, width, height) << endl;
+        }
+    }
+    return 0;
+}
+
+//The framebuffer the way ImageData used to keep it: a vector of columns, each one built in a temporary and copied in
+class ColumnImage {
+public:
+    int width, height;
+    vector<vector<Color>> framebuffer;
+
+    ColumnImage(int width, int height) : width(width), height(height) {
+        for (int i = 0; i < width; ++i) {
+            vector<Color> tempframebuffer;
+            for (int j = 0; j < height; ++j) {
+                tempframebuffer.emplace_back(0);
+            }
+            framebuffer.push_back(tempframebuffer);
+        }
+    }
+
+    void storePixel(int x, int y, vec3 color) {
+        framebuffer[x][y] = Color(color.r, color.g, color.b, 1.0f);
+    }
+
+    size_t getMemoryUsage() {
+        size_t bytes = framebuffer.capacity() * sizeof(vector<Color>);
+        for (int i = 0; i < width; ++i) {
+            bytes += framebuffer[i].capacity() * sizeof(Color);
+        }
+        return bytes;
+    }
+
+    void writeToPPM(string name, float exposure = 1.2f, float gamma = 0.75f) {
+        FILE *fp = fopen((name + ".ppm").c_str(), "wb");
+        fprintf(fp, "P6\n%d %d\n255\n", width, height);
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                Color currentColor = framebuffer[x][y];
+                currentColor.applyGammaCorrection(exposure, gamma);
+                currentColor.clampColor();
+                static unsigned char color[3];
+                color[0] = (unsigned char)(currentColor.r * 255);
+                color[1] = (unsigned char)(currentColor.g * 255);
+                color[2] = (unsigned char)(currentColor.b * 255);
+                fwrite(color, 1, 3, fp);
+            }
+        }
+        fclose(fp);
+    }
+};
+
+//Memory, heap allocations and time to set up, fill (32x32 tiles in order, like cpuRender) and save a size x size image
+//with the old column vectors and the flat framebuffer row by row and in 8x8 blocks. Every layout has to save the same
+//file. One image exists at a time, 16384x16384 needs 4GB.
+static int benchmarkFramebuffer(string argument) {
+    int size = argument.empty() ? 16384 : atoi(argument.c_str());
+    const int tileSize = 32;
+    string path = "framebuffer_benchmark";
+    cout << size << "x" << size << " image, " << (double)size * size * 3 / (1024.0 * 1024.0) << " MB ppm" << endl;
+    cout << "layout       | memory MB | allocations | setup ms |  fill ms |  save ms | same file" << endl;
+
+    auto fill = [&](function<void(int, int, vec3)> storePixel) {
+        for (int startY = 0; startY < size; startY += tileSize) {
+            for (int startX = 0; startX < size; startX += tileSize) {
+                for (int y = startY; y < std::min(startY + tileSize, size); ++y) {
+                    for (int x = startX; x < std::min(startX + tileSize, size); ++x) {
+                        storePixel(x, y, vec3((float)x / (float)size, (float)y / (float)size, 0.5f));
+                    }
+                }
+            }
+        }
+    };
+    auto millisecondsSince = [](chrono::steady_clock::time_point start) {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    };
+    auto readFile = [](const string &name) {
+        ifstream file(name, ios::binary);
+        return string((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    };
+
+    string firstFile;
+    bool allMatch = true;
+    for (int layout = 0; layout < 3; ++layout) {
+        string layoutName[3] = {"columns", "flat rows", "flat 8x8"};
+        size_t bytes;
+        long long allocations;
+        double setupTime, fillTime, saveTime;
+        auto start = chrono::steady_clock::now();
+        long long allocationsBefore = allocationCount();
+        //the fill goes through a std::function either way so the comparison is fair
+        if(layout == 0){
+            ColumnImage image(size, size);
+            allocations = allocationCount() - allocationsBefore;
+            setupTime = millisecondsSince(start);
+            start = chrono::steady_clock::now();
+            fill([&](int x, int y, vec3 color) { image.storePixel(x, y, color); });
+            fillTime = millisecondsSince(start);
+            start = chrono::steady_clock::now();
+            image.writeToPPM(path);
+            saveTime = millisecondsSince(start);
+            bytes = image.getMemoryUsage();
+        }
+        else{
+            ImageData image(size, size, layout == 2);
+            allocations = allocationCount() - allocationsBefore;
+            setupTime = millisecondsSince(start);
+            start = chrono::steady_clock::now();
+            fill([&](int x, int y, vec3 color) { image.storePixel(x, y, color); });
+            fillTime = millisecondsSince(start);
+            start = chrono::steady_clock::now();
+            image.writeToPPM(path);
+            saveTime = millisecondsSince(start);
+            bytes = image.getMemoryUsage();
+        }
+        //only keep the first file around (a 16k one is 768MB), later ones get compared to it
+        bool match = true;
+        if(layout == 0){
+            firstFile = readFile(path + ".ppm");
+        }
+        else{
+            match = readFile(path + ".ppm") == firstFile;
+        }
+        allMatch &= match;
+        cout << setw(12) << left << layoutName[layout] << right << " | " << setw(9) << fixed << setprecision(1)
+             << (double)bytes / (1024.0 * 1024.0) << " | " << setw(11) << allocations << " | " << setw(8)
+             << setupTime << " | " << setw(8) << fillTime << " | " << setw(8) << saveTime << " | "
+             << (match ? "yes" : "NO") << endl;
+    }
+    remove((path + ".ppm").c_str());
+    return allMatch ? 0 : 1;
+}
+
+//Starting a config scene from its text and OBJs against starting it from its compiled cache (see SceneCache.h). The
+//cached scene has to hold exactly the same triangles, intersection arrays and BVH as the parsed one.
+static int benchmarkSceneCache(string configPath) {
+    if(configPath.empty()){
+        configPath = "data/config.txt";
+    }
+    //the benchmark writes its own cache where the config's is, whatever was there gets put back at the end
+    string cachePath = SceneCache::cachePath(configPath);
+    ifstream existingCache(cachePath, ios::binary);
+    bool hadCache = (bool)existingCache;
+    string savedCache;
+    if(hadCache){
+        savedCache.assign(istreambuf_iterator<char>(existingCache), istreambuf_iterator<char>());
+    }
+    existingCache.close();
+    remove(cachePath.c_str());
+    auto sameBytes = [](const void *a, const void *b, size_t bytes) {
+        return bytes == 0 || memcmp(a, b, bytes) == 0;
+    };
+    auto sameMesh = [&](Mesh &a, Mesh &b) {
+        bool same = a.meshData.vertices.size() == b.meshData.vertices.size()
+                    && sameBytes(a.meshData.vertices.data(), b.meshData.vertices.data(),
+                                 a.meshData.vertices.size() * sizeof(Mesh::Vertex))
+                    && a.meshData.indices == b.meshData.indices
+                    && a.bvh.nodes.size() == b.bvh.nodes.size()
+                    && sameBytes(a.bvh.nodes.data(), b.bvh.nodes.data(), a.bvh.nodes.size() * sizeof(BVHNode))
+                    && a.bvh.primitiveIndices == b.bvh.primitiveIndices && a.materialIndex == b.materialIndex
+                    && a.visibilityMask == b.visibilityMask;
+        for (int axis = 0; axis < 3; ++axis) {
+            same &= a.intersectData.v0[axis] == b.intersectData.v0[axis]
+                    && a.intersectData.edge1[axis] == b.intersectData.edge1[axis]
+                    && a.intersectData.edge2[axis] == b.intersectData.edge2[axis];
+        }
+        return same;
+    };
+
+    //parsed without the cache, parsed and saved to it, then started from it (the scenes are gone before the cache is
+    //put back, the last one may still have it mapped)
+    bool allMatch = true;
+    {
+        Scene scenes[3];
+        string runName[3] = {"parse", "parse + save", "from cache"};
+        cout << "start        |    load ms | same scene" << endl;
+        for (int run = 0; run < 3; ++run) {
+            Scene::setSceneCacheEnabled(run > 0);
+            string sceneType = configPath;
+            double milliseconds = timeMilliseconds([&] { scenes[run].setupScene(sceneType); });
+            Scene &parsed = scenes[0], &scene = scenes[run];
+            bool match = scene.getMeshes().size() == parsed.getMeshes().size()
+                         && scene.getInstances().size() == parsed.getInstances().size()
+                         && scene.getMaterials() == parsed.getMaterials();
+            for (size_t i = 0; match && i < scene.getMeshes().size(); ++i) {
+                match = sameMesh(scene.getMeshes()[i], parsed.getMeshes()[i]);
+            }
+            for (size_t i = 0; match && i < scene.getInstances().size(); ++i) {
+                Instance &instance = scene.getInstances()[i], &parsedInstance = parsed.getInstances()[i];
+                match = instance.getPosition() == parsedInstance.getPosition()
+                        && instance.getRotation() == parsedInstance.getRotation()
+                        && instance.getScale() == parsedInstance.getScale()
+                        && instance.materialIndex == parsedInstance.materialIndex
+                        && sameMesh(*(Mesh *)instance.getModel(), *(Mesh *)parsedInstance.getModel());
+            }
+            allMatch &= match;
+            cout << setw(12) << left << runName[run] << right << " | " << setw(10) << fixed << setprecision(1)
+                 << milliseconds << " | " << (match ? "yes" : "NO") << endl;
+        }
+    }
+    Scene::setSceneCacheEnabled(true);
+
+    remove(cachePath.c_str());
+    if(hadCache){
+        ofstream restored(cachePath, ios::binary);
+        restored.write(savedCache.data(), savedCache.size());
+        if(!restored){
+            cout << "Couldn't put the old cache back at \"" << cachePath << "\"" << endl;
+            allMatch = false;
+        }
+    }
+    return allMatch ? 0 : 1;
+}
+
+//The OBJ reader meshes had before the shared loader: getline, substr and sscanf on every line, v/vt/vn triangles only
+static void openOBJLineByLine(const string &filename, vector<ObjVertex> &triangles) {
+    vector<int> vertexIndices, uvIndices, normalIndices;
+    vector<vec3> temp_vertices;
+    vector<vec3> temp_normals;
+    vector<vec2> temp_uvs;
+    ifstream file(filename);
+    string line;
+    const char *values;
+    while(getline(file, line)){
+        if(line.substr(0,2) == "v "){
+            vec3 vertex;
+            values = line.c_str();
+            sscanf(values, "v %f %f %f\n", &vertex.x, &vertex.y, &vertex.z);
+            temp_vertices.push_back(vertex);
+        }
+        else if(line.substr(0,2) == "vt"){
+            vec2 uv;
+            values = line.c_str();
+            sscanf(values, "vt %f %f\n", &uv.x, &uv.y);
+            temp_uvs.push_back(uv);
+        }
+        else if(line.substr(0,2) == "vn"){
+            vec3 normal;
+            values = line.c_str();
+            sscanf(values, "vn %f %f %f\n", &normal.x, &normal.y, &normal.z);
+            temp_normals.push_back(normal);
+        }
+        else if(line.substr(0,2) == "f "){
+            values = line.c_str();
+            int vertexIndex[3], uvIndex[3], normalIndex[3];
+            sscanf(values, "f %d/%d/%d %d/%d/%d %d/%d/%d\n",
+                   &vertexIndex[0], &uvIndex[0], &normalIndex[0],
+                   &vertexIndex[1], &uvIndex[1], &normalIndex[1],
+                   &vertexIndex[2], &uvIndex[2], &normalIndex[2]);
+            for (int i = 0; i < 3; ++i) {
+                vertexIndices.push_back(vertexIndex[i] - 1);
+                uvIndices.push_back(uvIndex[i] - 1);
+                normalIndices.push_back(normalIndex[i] - 1);
+            }
+        }
+    }
+    ObjVertex vertex;
+    for (size_t i = 0; i < vertexIndices.size(); ++i) {
+        vertex.Position = temp_vertices[vertexIndices[i]];
+        vertex.Normal = temp_normals[normalIndices[i]];
+        vertex.uvCoords = temp_uvs[uvIndices[i]];
+        triangles.push_back(vertex);
+    }
+}
+
+//Reading OBJs (without building their BVH) with the line by line reader meshes used to have and with the shared loader
+//on one thread and on every hardware thread. Every way has to give exactly the same triangles (the loader leaves out
+//the ones without any area).
+static int benchmarkOBJParse(string filepath) {
+    vector<string> paths = {"../Assignment3/data/chessPieces/knight/knight.obj",
+                            "../Assignment3/data/models/provided/oak_chair/oak_chair.obj"};
+    if(!filepath.empty()){
+        paths = {filepath};
+    }
+    const int repeats = 5;
+    int hardwareThreads = std::max((int)thread::hardware_concurrency(), 1);
+    cout << "file                 |  triangles |   line by line ms |  loader 1 thread ms | loader " << setw(2)
+         << hardwareThreads << " threads ms | same" << endl;
+    bool allMatch = true;
+    auto sameTriangles = [](const ObjData &obj, const vector<ObjVertex> &reference) {
+        size_t triangle = 0;
+        for (size_t i = 0; i < reference.size(); i += 3) {
+            const ObjVertex *vertex = &reference[i];
+            if(cross(vertex[1].Position - vertex[0].Position, vertex[2].Position - vertex[0].Position) == vec3(0)){
+                continue;
+            }
+            for (int j = 0; j < 3; ++j) {
+                if(triangle * 3 + j >= obj.indices.size()
+                   || memcmp(&obj.vertices[obj.indices[triangle * 3 + j]], &vertex[j], sizeof(ObjVertex)) != 0){
+                    return false;
+                }
+            }
+            triangle++;
+        }
+        return triangle * 3 == obj.indices.size();
+    };
+    for (const string &path : paths) {
+        vector<ObjVertex> reference;
+        double lineByLine = 1e30;
+        for (int repeat = 0; repeat < repeats; ++repeat) {
+            reference.clear();
+            lineByLine = std::min(lineByLine, timeMilliseconds([&] { openOBJLineByLine(path, reference); }));
+        }
+        if(reference.empty()){
+            cout << "Couldn't read any triangles from \"" << path << "\"" << endl;
+            return 1;
+        }
+        double loader[2] = {1e30, 1e30};
+        bool match = true;
+        for (int run = 0; run < 2; ++run) {
+            for (int repeat = 0; repeat < repeats; ++repeat) {
+                ObjData obj;
+                loader[run] = std::min(loader[run], timeMilliseconds([&] { loadOBJ(path, obj, run == 0 ? 1 : 0); }));
+                match &= sameTriangles(obj, reference);
+            }
+        }
+        allMatch &= match;
+        string name = path.substr(path.find_last_of('/') + 1);
+        cout << setw(20) << left << name << right << " | " << setw(10) << reference.size() / 3 << " | " << setw(17)
+             << fixed << setprecision(1) << lineByLine << " | " << setw(18) << loader[0] << " | " << setw(18)
+             << loader[1] << " | " << (match ? "yes" : "NO") << endl;
+    }
+    return allMatch ? 0 : 1;
+}
+
+//What a triangle costs with every corner its own vertex (the line by line reader, 3 x 32 bytes) and welded into shared
+//vertices plus 32 bit indices, for the GL viewer's buffers and for a ray traced mesh (which adds its intersection
+//arrays and BVH either way)
+static int benchmarkMeshMemory(string filepath) {
+    vector<string> paths;
+    if(filepath.empty()){
+        for (string piece : {"bishop", "king", "knight", "pawn", "queen", "rook"}) {
+            paths.push_back("../Assignment3/data/models/provided/chess_" + piece + "/" + piece + ".obj");
+            paths.push_back("../Assignment3/data/chessPieces/" + piece + "/" + piece + ".obj");
+        }
+        paths.push_back("../Assignment3/data/models/provided/chess_board/board.obj");
+    }
+    else{
+        paths = {filepath};
+    }
+    cout << "file                                    | triangles | vertices | dropped | per corner B/tri | indexed B/tri |"
+            " traced before | traced after" << endl;
+    for (const string &path : paths) {
+        vector<ObjVertex> corners;
+        openOBJLineByLine(path, corners);
+        Mesh mesh;
+        mesh.openOBJ(path);
+        int triangleCount = mesh.meshData.triangleCount();
+        if(triangleCount == 0){
+            cout << "Couldn't read any triangles from \"" << path << "\"" << endl;
+            return 1;
+        }
+        double perCorner = (double)corners.size() * sizeof(ObjVertex) / (double)(corners.size() / 3);
+        double indexed = (double)(mesh.meshData.vertices.size() * sizeof(Mesh::Vertex)
+                                  + mesh.meshData.indices.size() * sizeof(uint32_t)) / triangleCount;
+        //the intersection arrays (nine floats a triangle plus padding) and the BVH
+        double tracing = (double)(mesh.intersectData.v0[0].size() * 9 * sizeof(float)
+                                  + mesh.bvh.nodes.size() * sizeof(BVHNode)
+                                  + mesh.bvh.primitiveIndices.size() * sizeof(int)) / triangleCount;
+        string name = path.substr(path.find("data/") + 5);
+        cout << setw(39) << left << name << right << " | " << setw(9) << triangleCount << " | " << setw(8)
+             << mesh.meshData.vertices.size() << " | " << setw(7) << corners.size() / 3 - triangleCount << " | "
+             << setw(16) << fixed << setprecision(1) << perCorner << " | " << setw(13) << indexed << " | "
+             << setw(13) << perCorner + tracing << " | " << setw(12) << indexed + tracing << endl;
+    }
+    return 0;
+}
+
+//The default scene with 1 to 10,000 more point lights (random colours, the same total power however many there are)
+//spread through the space above and in front of the box. Renders with a shadow ray to every light and with 1 and 4
+//lights picked from the light tree at every hit: PSNR against the every light render and the ratio of their mean
+//brightness, which should stay at 1 since the picked lights are weighted to be unbiased. The probabilities the tree
+//gives every light at random shading points also have to add up to 1 with none of the lights left out.
+static int benchmarkLights(string argument) {
+    const int width = 64, height = 64, samples = 2, depth = 4;
+    int maxLights = argument.empty() ? 10000 : atoi(argument.c_str());
+    int lightSampleCounts[2] = {1, 4};
+    bool allValid = true;
+    cout << "Rendering the default scene " << width << "x" << height << ", " << samples << "x" << samples
+         << " samples, depth " << depth << " with its 2 lights and this many more" << endl;
+    cout << " lights | every light ms | tree 1 ms | PSNR dB | mean | tree 4 ms | PSNR dB | mean | probabilities" << endl;
+    for (int lightCount = 1; lightCount <= maxLights; lightCount *= 10) {
+        Scene scene;
+        string sceneName = "--default";
+        scene.setupScene(sceneName);
+        mt19937 random(lightCount);
+        uniform_real_distribution<float> unit(0.0f, 1.0f);
+        for (int i = 0; i < lightCount; ++i) {
+            vec3 position(-200 + 955 * unit(random), 300 + 1700 * unit(random), -300 + 855 * unit(random));
+            vec3 color(0.2f + 0.8f * unit(random), 0.2f + 0.8f * unit(random), 0.2f + 0.8f * unit(random));
+            color *= 2.0f / ((float)lightCount * (0.2126f * color.r + 0.7152f * color.g + 0.0722f * color.b));
+            scene.addLight(new PointLight(position, color));
+        }
+        Camera camera(vec3(278, 273, -500), vec3(278, 273, 0), vec3(1, 0, 0), 55, (float)height / (float)width);
+        auto render = [&](ImageData &image, int lightSamples) {
+            RayTracer rayTracer(samples, width, height, depth, scene, 0);
+            rayTracer.setShowProgress(false);
+            rayTracer.setAdaptive(false);
+            rayTracer.setLightSamples(lightSamples);
+            return timeMilliseconds([&] { rayTracer.cpuRender(&image, camera); });
+        };
+        auto meanLuminance = [&](ImageData &image) {
+            double sum = 0;
+            for (int y = 0; y < height; ++y) {
+                for (int x = 0; x < width; ++x) {
+                    vec3 color = image.getPixel(x, y);
+                    sum += 0.2126 * color.r + 0.7152 * color.g + 0.0722 * color.b;
+                }
+            }
+            return sum / (width * height);
+        };
+        ImageData reference(width, height);
+        double referenceMilliseconds = render(reference, 0);
+        double referenceMean = meanLuminance(reference);
+        cout << setw(7) << lightCount << " | " << setw(14) << fixed << setprecision(1) << referenceMilliseconds;
+        for (int i = 0; i < 2; ++i) {
+            ImageData image(width, height);
+            double milliseconds = render(image, lightSampleCounts[i]);
+            cout << " | " << setw(9) << setprecision(1) << milliseconds << " | " << setw(7) << setprecision(2)
+                 << psnr(image, reference, width, height) << " | " << setw(4) << meanLuminance(image) / referenceMean;
+        }
+
+        RenderContext context(scene, camera);
+        vector<float> probabilities;
+        bool valid = true;
+        for (int i = 0; i < 1000 && valid; ++i) {
+            vec3 point(555 * unit(random), 555 * unit(random), 555 * unit(random));
+            vec3 normal = normalize(vec3(unit(random) - 0.5f, unit(random) - 0.5f, unit(random) - 0.5f));
+            context.lightTree.probabilities(point, normal, probabilities);
+            double sum = 0;
+            for (size_t light = 0; light < context.lightTree.lightIndices.size(); ++light) {
+                float probability = probabilities[context.lightTree.lightIndices[light]];
+                valid &= probability > 0;
+                sum += probability;
+            }
+            valid &= fabs(sum - 1) < 1e-4;
+        }
+        allValid &= valid;
+        cout << " | " << (valid ? "sum to 1" : "WRONG") << endl;
+    }
+    return allValid ? 0 : 1;
+}
+
+//Render time of the default scene (glass sphere and mirror wall) at depth 4 to 16 tracing every reflection and
+//refraction (the whole ray tree, like the recursive tracer), with branches under the 0.01 default ended by russian
+//roulette and with them dropped. PSNR is against the whole tree.
+static int benchmarkRayTree() {
+    const int width = 256, height = 256, samples = 2;
+    int depths[4] = {4, 8, 12, 16};
+    cout << "Rendering the default scene " << width << "x" << height << ", " << samples << "x" << samples
+         << " samples, one thread" << endl;
+    cout << "depth | whole tree ms | roulette ms | speedup | PSNR dB | dropped ms | speedup | PSNR dB" << endl;
+    Scene scene;
+    string sceneName = "--default";
+    scene.setupScene(sceneName);
+    Camera camera(vec3(278, 273, -500), vec3(278, 273, 0), vec3(1, 0, 0), 55, (float)height / (float)width);
+    for (int i = 0; i < 4; ++i) {
+        auto render = [&](ImageData &image, float threshold, bool roulette) {
+            RayTracer rayTracer(samples, width, height, depths[i], scene, 1);
+            rayTracer.setShowProgress(false);
+            rayTracer.setAdaptive(false);
+            rayTracer.setBranchThreshold(threshold);
+            rayTracer.setRussianRoulette(roulette);
+            return timeMilliseconds([&] { rayTracer.cpuRender(&image, camera); });
+        };
+        ImageData reference(width, height), roulette(width, height), dropped(width, height);
+        double referenceMilliseconds = render(reference, 0, true);
+        double rouletteMilliseconds = render(roulette, 0.01f, true);
+        double droppedMilliseconds = render(dropped, 0.01f, false);
+        cout << setw(5) << depths[i] << " | " << setw(13) << fixed << setprecision(1) << referenceMilliseconds << " | "
+             << setw(11) << rouletteMilliseconds << " | " << setw(6) << setprecision(2)
+             << referenceMilliseconds / rouletteMilliseconds << "x | " << setw(7) << psnr(roulette, reference, width, height)
+             << " | " << setw(10) << setprecision(1) << droppedMilliseconds << " | " << setw(6) << setprecision(2)
+             << referenceMilliseconds / droppedMilliseconds << "x | " << setw(7)
+             << psnr(dropped, reference, width, height) << endl;
+    }
+    return 0;
+}
+
+//Depth first (a sample at a time) against wavefront rendering of both built in scenes at depth 8 on one thread, with
+//the default 0.01 branch weight and roulette. Best of 5, both have to give the same image (within a level for the
+//colours adding up in a different order).
+static int benchmarkWavefront() {
+    const int width = 256, height = 256, samples = 2, depth = 8;
+    string sceneNames[2] = {"--default", "--yours"};
+    bool allMatch = true;
+    cout << "Rendering " << width << "x" << height << ", " << samples << "x" << samples << " samples, depth " << depth
+         << ", one thread" << endl;
+    cout << "scene     | depth first ms | samples/s | wavefront ms | samples/s | speedup | pixels off | image matches"
+         << endl;
+    for (int s = 0; s < 2; ++s) {
+        Scene scene;
+        string sceneName = sceneNames[s];
+        scene.setupScene(sceneName);
+        Camera camera(vec3(278, 273, -500), vec3(278, 273, 0), vec3(1, 0, 0), 55, (float)height / (float)width);
+        auto render = [&](ImageData &image, bool wavefront) {
+            RayTracer rayTracer(samples, width, height, depth, scene, 1);
+            rayTracer.setShowProgress(false);
+            rayTracer.setAdaptive(false);
+            rayTracer.setWavefront(wavefront);
+            double best = 1e30;
+            for (int run = 0; run < 5; ++run) {
+                best = std::min(best, timeMilliseconds([&] { rayTracer.cpuRender(&image, camera); }));
+            }
+            return best;
+        };
+        ImageData depthFirst(width, height), wavefront(width, height);
+        double depthFirstMilliseconds = render(depthFirst, false);
+        double wavefrontMilliseconds = render(wavefront, true);
+        int pixelsOff = 0;
+        bool match = true;
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                vec3 difference = abs(wavefront.getPixel(x, y) - depthFirst.getPixel(x, y));
+                float largest = std::max(difference.x, std::max(difference.y, difference.z));
+                pixelsOff += largest > 0;
+                match &= largest < 1.0f / 255.0f;
+            }
+        }
+        allMatch &= match;
+        double sampleCount = (double)width * height * samples * samples;
+        cout << setw(9) << left << sceneNames[s].substr(2) << right << " | " << setw(14) << fixed << setprecision(1)
+             << depthFirstMilliseconds << " | " << setw(9) << setprecision(0)
+             << sampleCount / (depthFirstMilliseconds / 1000) << " | " << setw(12) << setprecision(1)
+             << wavefrontMilliseconds << " | " << setw(9) << setprecision(0)
+             << sampleCount / (wavefrontMilliseconds / 1000) << " | " << setw(6) << setprecision(2)
+             << depthFirstMilliseconds / wavefrontMilliseconds << "x | " << setw(10) << pixelsOff << " | "
+             << (match ? "yes" : "NO") << endl;
+    }
+    return allMatch ? 0 : 1;
+}
+
+//Wavefront rendering of a mirror heavy scene (the default scene's mirror wall plus 12 mirror spheres) at depth 8 on one
+//thread, tracing the reflection/refraction waves in queue order, sorted for the first bounce only and sorted for every
+//bounce. Best of 5, sorting only changes the order the rays are traced in so the images have to be identical.
+static int benchmarkRaySort() {
+    const int width = 256, height = 256, samples = 2, depth = 8;
+    Scene scene;
+    string sceneName = "--default";
+    scene.setupScene(sceneName);
+    mt19937 generator(91);
+    uniform_real_distribution<float> distribution(0.0f, 1.0f);
+    Material mirror;
+    mirror.setMaterialType(REFLECTION);
+    mirror.setKR(0.85f);
+    for (int i = 0; i < 12; ++i) {
+        vec3 position(60 + distribution(generator) * 430, 60 + distribution(generator) * 430,
+                      100 + distribution(generator) * 400);
+        scene.addSphere(position, 25 + (int)(distribution(generator) * 30), mirror);
+    }
+    Camera camera(vec3(278, 273, -500), vec3(278, 273, 0), vec3(1, 0, 0), 55, (float)height / (float)width);
+    cout << "Rendering the default scene with 12 mirror spheres " << width << "x" << height << ", " << samples << "x"
+         << samples << " samples, depth " << depth << ", wavefront on one thread" << endl;
+    cout << "sorted   |     ms |       rays/s | speedup |       cycles | instructions |   cache refs | cache misses |  miss %"
+            " | image matches" << endl;
+    string names[3] = {"none", "depth 1", "all"};
+    unsigned int sortedDepths[3] = {0, 1u << 1, ~1u};
+    ImageData reference(width, height);
+    double referenceMilliseconds = 0;
+    bool allMatch = true;
+    for (int i = 0; i < 3; ++i) {
+        ImageData image(width, height);
+        RayTracer rayTracer(samples, width, height, depth, scene, 1);
+        rayTracer.setShowProgress(false);
+        rayTracer.setAdaptive(false);
+        rayTracer.setWavefront(true);
+        rayTracer.setSortedDepths(sortedDepths[i]);
+        //the first render warms up the queues and gets the counters
+        PerfCounters counters;
+        long long raysBefore = rayTracer.getWavefrontRays();
+        counters.start();
+        rayTracer.cpuRender(&image, camera);
+        counters.stop();
+        long long rays = rayTracer.getWavefrontRays() - raysBefore;
+        double best = 1e30;
+        for (int run = 0; run < 5; ++run) {
+            best = std::min(best, timeMilliseconds([&] { rayTracer.cpuRender(&image, camera); }));
+        }
+        bool match = true;
+        if(i == 0){
+            reference = image;
+            referenceMilliseconds = best;
+        }
+        else{
+            for (int y = 0; y < height; ++y) {
+                for (int x = 0; x < width; ++x) {
+                    match &= image.getPixel(x, y) == reference.getPixel(x, y);
+                }
+            }
+        }
+        allMatch &= match;
+        cout << setw(8) << left << names[i] << right << " | " << setw(6) << fixed << setprecision(1) << best << " | "
+             << setw(12) << setprecision(0) << rays / (best / 1000) << " | " << setw(6) << setprecision(2)
+             << referenceMilliseconds / best << "x";
+        counters.print();
+        cout << " | " << (match ? "yes" : "NO") << endl;
+    }
+    return allMatch ? 0 : 1;
+}
+
+//least squares slope of log2(error) against log2(sample count), -0.5 is plain random sampling
+static double convergenceSlope(const vector<int> &counts, const vector<double> &errors) {
+    double meanX = 0, meanY = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        meanX += log2((double)counts[i]) / counts.size();
+        meanY += log2(errors[i]) / counts.size();
+    }
+    double covariance = 0, variance = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        double x = log2((double)counts[i]) - meanX;
+        covariance += x * (log2(errors[i]) - meanY);
+        variance += x * x;
+    }
+    return covariance / variance;
+}
+
+//log-log plot of error against sample count, one letter a sampler (a later one wins where they overlap)
+static void printConvergencePlot(const vector<int> &counts, const vector<vector<double>> &errors, const string &letters) {
+    const int rows = 16, columnWidth = 6;
+    double lowest = INFINITY, highest = -INFINITY;
+    for (size_t s = 0; s < errors.size(); ++s) {
+        for (size_t i = 0; i < counts.size(); ++i) {
+            lowest = std::min(lowest, log10(errors[s][i]));
+            highest = std::max(highest, log10(errors[s][i]));
+        }
+    }
+    vector<string> plot(rows, string(counts.size() * columnWidth, ' '));
+    for (size_t s = 0; s < errors.size(); ++s) {
+        for (size_t i = 0; i < counts.size(); ++i) {
+            int row = (int)round((highest - log10(errors[s][i])) / (highest - lowest) * (rows - 1));
+            plot[row][i * columnWidth + columnWidth / 2] = letters[s];
+        }
+    }
+    for (int row = 0; row < rows; ++row) {
+        double error = pow(10.0, highest - (highest - lowest) * row / (rows - 1));
+        cout << setw(9) << scientific << setprecision(1) << error << " |" << plot[row] << endl;
+    }
+    cout << setw(9) << "" << " +" << string(counts.size() * columnWidth, '-') << endl << setw(11) << "";
+    for (size_t i = 0; i < counts.size(); ++i) {
+        cout << setw(columnWidth / 2 + 1) << counts[i] << setw(columnWidth / 2 - 1) << "";
+    }
+    cout << " samples" << fixed << endl;
+}
+
+//Error against samples per pixel for every sampler.
+//First integrating two functions over a pixel whose integrals are known, for 64x64 pixels each with its own scrambling.
+//One is a quarter disc of radius 0.75 (an edge, like a model's silhouette), the other a gaussian bump (smooth, like
+//shading). Stratified is run two ways: as the prefix of a 16x16 grid (what adaptive sampling with --samples 16 takes)
+//and with the grid fitted to the count (what a fixed --samples n takes).
+//Then rendering the default scene at 64x64, depth 4, without adaptive sampling, against a 32x32 sample stratified
+//reference.
+static int benchmarkSamplers() {
+    const int pixelCount = 64;
+    vector<int> counts;
+    for (int count = 1; count <= 256; count *= 2) {
+        counts.push_back(count);
+    }
+    string names[5] = {"stratified 16x16", "stratified fitted", "sobol", "r2", "bluenoise"};
+    string letters = "Sforb";
+    auto offsetFor = [&](int sampler, int x, int y, int sample, int count) {
+        if(sampler == 0){
+            return pixelSample(STRATIFIED_SAMPLER, x, y, sample, 16);
+        }
+        if(sampler == 1){
+            return pixelSample(STRATIFIED_SAMPLER, x, y, sample, (int)ceil(sqrt((double)count)));
+        }
+        return pixelSample((SamplerType)(sampler - 1), x, y, sample, 1);
+    };
+    const double discArea = 3.14159265358979 * 0.75 * 0.75 / 4;
+    const double sigma = 0.2;
+    const double bumpSide = sigma * sqrt(2 * 3.14159265358979) * erf(0.5 / (sigma * sqrt(2.0)));
+    const double bumpArea = bumpSide * bumpSide;
+    function<double(vec2)> functions[2] = {
+            [](vec2 p) { return p.x * p.x + p.y * p.y < 0.75f * 0.75f ? 1.0 : 0.0; },
+            [&](vec2 p) { return exp(-(square(p.x - 0.5) + square(p.y - 0.5)) / (2 * sigma * sigma)); }};
+    double integrals[2] = {discArea, bumpArea};
+    string functionNames[2] = {"quarter disc (edge)", "gaussian bump (smooth)"};
+    for (int f = 0; f < 2; ++f) {
+        cout << "RMS error integrating a " << functionNames[f] << " over " << pixelCount << "x" << pixelCount
+             << " pixels" << endl;
+        cout << "sampler           |";
+        for (size_t i = 0; i < counts.size(); ++i) {
+            cout << setw(8) << counts[i] << " |";
+        }
+        cout << " slope" << endl;
+        vector<vector<double>> errors(5, vector<double>(counts.size()));
+        for (int s = 0; s < 5; ++s) {
+            cout << setw(17) << left << names[s] << right << " |";
+            for (size_t i = 0; i < counts.size(); ++i) {
+                double squaredError = 0;
+                for (int y = 0; y < pixelCount; ++y) {
+                    for (int x = 0; x < pixelCount; ++x) {
+                        double sum = 0;
+                        for (int sample = 0; sample < counts[i]; ++sample) {
+                            sum += functions[f](offsetFor(s, x, y, sample, counts[i]));
+                        }
+                        squaredError += square(sum / counts[i] - integrals[f]);
+                    }
+                }
+                errors[s][i] = sqrt(squaredError / (pixelCount * pixelCount));
+                cout << setw(8) << setprecision(5) << fixed << errors[s][i] << " |";
+            }
+            cout << setw(6) << setprecision(2) << convergenceSlope(counts, errors[s]) << endl;
+        }
+        printConvergencePlot(counts, errors, letters);
+        cout << "(S stratified 16x16, f stratified fitted, o sobol, r r2, b bluenoise)" << endl << endl;
+    }
+
+    const int width = 64, height = 64, depth = 4;
+    Scene scene;
+    string sceneName = "--default";
+    scene.setupScene(sceneName);
+    Camera camera(vec3(278, 273, -500), vec3(278, 273, 0), vec3(1, 0, 0), 55, (float)height / (float)width);
+    auto render = [&](ImageData &image, SamplerType sampler, int gridSize) {
+        RayTracer rayTracer(gridSize, width, height, depth, scene, 0);
+        rayTracer.setShowProgress(false);
+        rayTracer.setAdaptive(false);
+        rayTracer.setSampler(sampler);
+        rayTracer.cpuRender(&image, camera);
+    };
+    ImageData reference(width, height);
+    render(reference, STRATIFIED_SAMPLER, 32);
+    int grids[4] = {1, 2, 4, 8};
+    cout << "PSNR in dB of the default scene at " << width << "x" << height << ", depth " << depth
+         << " against 32x32 stratified samples" << endl;
+    cout << "sampler           |";
+    for (int i = 0; i < 4; ++i) {
+        cout << setw(8) << grids[i] * grids[i] << " |";
+    }
+    cout << " dB a doubling" << endl;
+    for (int s = 0; s < samplerTypeCount; ++s) {
+        cout << setw(17) << left << samplerName((SamplerType)s) << right << " |";
+        double first = 0, last = 0;
+        for (int i = 0; i < 4; ++i) {
+            ImageData image(width, height);
+            render(image, (SamplerType)s, grids[i]);
+            double decibels = psnr(image, reference, width, height);
+            cout << setw(8) << setprecision(2) << decibels << " |";
+            first = i == 0 ? decibels : first;
+            last = decibels;
+        }
+        //plain random sampling gains 3.01 dB every time the sample count doubles
+        cout << setw(14) << (last - first) / 6 << endl;
+    }
+    return 0;
+}
+
+//Samples per pixel it takes to get within a PSNR of a 16x16 sample render with and without --denoise, on the default
+//scene (its 2 lights, so the noise is mostly edges and the glass) and with 100 more lights picked 1 at a time (noisy
+//shadows and shading everywhere). Then the time the filter takes on its own, scalar and AVX2 (which have to match).
+static int benchmarkDenoise() {
+    const int width = 128, height = 128, depth = 4, referenceSamples = 16, maxGrid = 8;
+    const double targets[3] = {25, 30, 35};
+    DenoiseSettings settings;
+    Camera camera(vec3(278, 273, -500), vec3(278, 273, 0), vec3(1, 0, 0), 55, (float)height / (float)width);
+    string sceneNames[2] = {"default", "102 lights"};
+    cout << "Rendering " << width << "x" << height << ", depth " << depth << ", PSNR against a " << referenceSamples
+         << "x" << referenceSamples << " sample render (every light)" << endl;
+    for (int s = 0; s < 2; ++s) {
+        Scene scene;
+        string sceneName = "--default";
+        scene.setupScene(sceneName);
+        int lightSamples = 0;
+        if(s == 1){
+            mt19937 random(100);
+            uniform_real_distribution<float> unit(0.0f, 1.0f);
+            for (int i = 0; i < 100; ++i) {
+                vec3 position(-200 + 955 * unit(random), 300 + 1700 * unit(random), -300 + 855 * unit(random));
+                vec3 color(0.2f + 0.8f * unit(random), 0.2f + 0.8f * unit(random), 0.2f + 0.8f * unit(random));
+                color *= 2.0f / (100.0f * (0.2126f * color.r + 0.7152f * color.g + 0.0722f * color.b));
+                scene.addLight(new PointLight(position, color));
+            }
+            lightSamples = 1;
+        }
+        auto render = [&](ImageData &image, int gridSize, int lights, GBuffer *gBuffer) {
+            RayTracer rayTracer(gridSize, width, height, depth, scene, 0);
+            rayTracer.setShowProgress(false);
+            rayTracer.setAdaptive(false);
+            rayTracer.setLightSamples(lights);
+            rayTracer.setGBuffer(gBuffer);
+            double milliseconds = timeMilliseconds([&] { rayTracer.cpuRender(&image, camera); });
+            if(gBuffer){
+                milliseconds += timeMilliseconds([&] { rayTracer.denoise(&image, settings); });
+            }
+            return milliseconds;
+        };
+        ImageData reference(width, height);
+        render(reference, referenceSamples, 0, nullptr);
+
+        cout << sceneNames[s] << (lightSamples > 0 ? " (1 light sample a hit)" : "") << endl;
+        cout << " samples/pixel |     ms | PSNR dB | denoised ms | PSNR dB" << endl;
+        double reached[2][3];
+        for (int t = 0; t < 3; ++t) {
+            reached[0][t] = reached[1][t] = 0;
+        }
+        for (int grid = 1; grid <= maxGrid; ++grid) {
+            cout << setw(14) << grid * grid;
+            for (int denoised = 0; denoised < 2; ++denoised) {
+                ImageData image(width, height);
+                GBuffer gBuffer(width, height);
+                double milliseconds = render(image, grid, lightSamples, denoised ? &gBuffer : nullptr);
+                double decibels = psnr(image, reference, width, height);
+                cout << " | " << setw(denoised ? 11 : 6) << fixed << setprecision(1) << milliseconds << " | "
+                     << setw(7) << setprecision(2) << decibels;
+                for (int t = 0; t < 3; ++t) {
+                    if(reached[denoised][t] == 0 && decibels >= targets[t]){
+                        reached[denoised][t] = grid * grid;
+                    }
+                }
+            }
+            cout << endl;
+        }
+        for (int t = 0; t < 3; ++t) {
+            cout << "  " << setprecision(0) << targets[t] << " dB takes ";
+            for (int denoised = 0; denoised < 2; ++denoised) {
+                if(reached[denoised][t] > 0){
+                    cout << reached[denoised][t];
+                }else{
+                    cout << "more than " << maxGrid * maxGrid;
+                }
+                cout << (denoised ? " denoised" : " samples/pixel, ");
+            }
+            cout << endl;
+        }
+    }
+
+    //the filter alone on a 1 sample render, a few times at a bigger size
+    const int filterWidth = 512, filterHeight = 512, runs = 5;
+    Scene scene;
+    string sceneName = "--default";
+    scene.setupScene(sceneName);
+    Camera filterCamera(vec3(278, 273, -500), vec3(278, 273, 0), vec3(1, 0, 0), 55,
+                        (float)filterHeight / (float)filterWidth);
+    ImageData noisy(filterWidth, filterHeight);
+    GBuffer gBuffer(filterWidth, filterHeight);
+    RayTracer rayTracer(1, filterWidth, filterHeight, depth, scene, 0);
+    rayTracer.setShowProgress(false);
+    rayTracer.setAdaptive(false);
+    rayTracer.setGBuffer(&gBuffer);
+    rayTracer.cpuRender(&noisy, filterCamera);
+    ThreadPool workers;
+    Denoiser denoiser;
+    ImageData filtered[2] = {noisy, noisy};
+    double milliseconds[2];
+    for (int simd = 0; simd < 2; ++simd) {
+        denoiser.denoise(filtered[simd], gBuffer, workers, settings, simd == 1);
+        milliseconds[simd] = timeMilliseconds([&] {
+            for (int run = 0; run < runs; ++run) {
+                ImageData image = noisy;
+                denoiser.denoise(image, gBuffer, workers, settings, simd == 1);
+            }
+        }) / runs;
+    }
+    bool match = true;
+    for (int y = 0; y < filterHeight; ++y) {
+        for (int x = 0; x < filterWidth; ++x) {
+            match &= filtered[0].getPixel(x, y) == filtered[1].getPixel(x, y);
+        }
+    }
+    cout << "Filtering " << filterWidth << "x" << filterHeight << " (" << settings.passes << " passes, "
+         << workers.getThreadCount() << " threads): scalar " << setprecision(1) << milliseconds[0] << " ms, "
+         << (getSimdLevel() >= SIMD_AVX2 ? "AVX2 " : "AVX2 not supported, scalar again ") << milliseconds[1]
+         << " ms, " << (match ? "same image" : "DIFFERENT IMAGES") << endl;
+    return match ? 0 : 1;
+}
+
+//Render time of both built in scenes with and without the G-buffer being filled in (the AOVs come out of the same pass
+//as the image, the other way to get them would be a second render), how long writing them takes either way and that
+//the image doesn't change
+static int benchmarkAOV() {
+    const int width = 256, height = 256, samples = 2, depth = 4, runs = 5;
+    string sceneNames[2] = {"--default", "--yours"};
+    bool allMatch = true;
+    cout << "Rendering " << width << "x" << height << ", " << samples << "x" << samples << " samples, depth " << depth
+         << ", best of " << runs << endl;
+    cout << "scene     | render ms | with AOVs ms | overhead | write separate ms | write combined ms | image matches"
+         << endl;
+    for (int s = 0; s < 2; ++s) {
+        Scene scene;
+        string sceneName = sceneNames[s];
+        scene.setupScene(sceneName);
+        Camera camera(vec3(278, 273, -500), vec3(278, 273, 0), vec3(1, 0, 0), 55, (float)height / (float)width);
+        RayTracer rayTracer(samples, width, height, depth, scene, 0);
+        rayTracer.setShowProgress(false);
+        GBuffer gBuffer(width, height);
+        ImageData images[2] = {ImageData(width, height), ImageData(width, height)};
+        double best[2] = {INFINITY, INFINITY};
+        for (int run = 0; run < runs; ++run) {
+            for (int aovs = 0; aovs < 2; ++aovs) {
+                gBuffer.clear();
+                rayTracer.setGBuffer(aovs ? &gBuffer : nullptr);
+                best[aovs] = std::min(best[aovs], timeMilliseconds([&] { rayTracer.cpuRender(&images[aovs], camera); }));
+            }
+        }
+        rayTracer.setGBuffer(nullptr);
+        bool match = true;
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                match &= images[0].getPixel(x, y) == images[1].getPixel(x, y);
+            }
+        }
+        allMatch &= match;
+        string name = "benchmark_aov_" + sceneNames[s].substr(2);
+        double writeMilliseconds[2];
+        AovLayout layouts[2] = {SEPARATE_AOVS, COMBINED_AOVS};
+        for (int l = 0; l < 2; ++l) {
+            writeMilliseconds[l] = timeMilliseconds([&] { allMatch &= gBuffer.write(name, layouts[l]); });
+        }
+        string aovNames[6] = {"depth", "normal", "albedo", "objectid", "material", "triangle"};
+        for (int i = 0; i < 6; ++i) {
+            remove((name + "." + aovNames[i] + ".pfm").c_str());
+        }
+        remove((name + ".aov").c_str());
+        cout << setw(9) << left << sceneNames[s].substr(2) << right << " | " << setw(9) << fixed << setprecision(1)
+             << best[0] << " | " << setw(12) << best[1] << " | " << setw(7) << (best[1] / best[0] - 1) * 100 << "% | "
+             << setw(17) << writeMilliseconds[0] << " | " << setw(17) << writeMilliseconds[1] << " | "
+             << (match ? "yes" : "NO") << endl;
+    }
+    return allMatch ? 0 : 1;
+}
+
+int runBenchmark(string name, string argument) {
+    if(name == "threads"){
+        return benchmarkThreads();
+    }
+    if(name == "bvh"){
+        return benchmarkBVH();
+    }
+    if(name == "instances"){
+        return benchmarkInstances();
+    }
+    if(name == "obj"){
+        return benchmarkOBJ(argument);
+    }
+    if(name == "simd"){
+        return benchmarkSIMD();
+    }
+    if(name == "packets"){
+        return benchmarkPackets();
+    }
+    if(name == "shadows"){
+        return benchmarkShadows();
+    }
+    if(name == "allocations"){
+        return benchmarkAllocations();
+    }
+    if(name == "dispatch"){
+        return benchmarkDispatch();
+    }
+    if(name == "adaptive"){
+        return benchmarkAdaptive();
+    }
+    if(name == "framebuffer"){
+        return benchmarkFramebuffer(argument);
+    }
+    if(name == "scenecache"){
+        return benchmarkSceneCache(argument);
+    }
+    if(name == "objparse"){
+        return benchmarkOBJParse(argument);
+    }
+    if(name == "meshmemory"){
+        return benchmarkMeshMemory(argument);
+    }
+    if(name == "lights"){
+        return benchmarkLights(argument);
+    }
+    if(name == "raytree"){
+        return benchmarkRayTree();
+    }
+    if(name == "wavefront"){
+        return benchmarkWavefront();
+    }
+    if(name == "raysort"){
+        return benchmarkRaySort();
+    }
+    if(name == "samplers"){
+        return benchmarkSamplers();
+    }
+    if(name == "denoise"){
+        return benchmarkDenoise();
+    }
+    if(name == "aov"){
+        return benchmarkAOV();
+    }
+    cout << "Unknown benchmark \"" << name << "\". Available benchmarks: threads, bvh, instances, obj, simd, packets, shadows, "
+            "allocations, dispatch, adaptive, framebuffer, scenecache, objparse, meshmemory, lights, raytree, wavefront, raysort, samplers, denoise, aov" << endl;
+    return 1;
+}
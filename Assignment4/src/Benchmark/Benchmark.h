@@ -0,0 +1,16 @@
+//
+// Benchmarks for the ray tracer, run with: ./Assignment4 --benchmark <name>
+//
+
+#ifndef ASSIGNMENT4_BENCHMARK_H
+#define ASSIGNMENT4_BENCHMARK_H
+
+#include <string>
+
+using namespace std;
+
+//Runs the named benchmark and prints its results as a table, returns the exit code for main
+//argument is passed to benchmarks that need one (like the OBJ file to load)
+int runBenchmark(string name, string argument = "");
+
+#endif //ASSIGNMENT4_BENCHMARK_H
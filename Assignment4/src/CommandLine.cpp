@@ -0,0 +1,354 @@
+//
+// Command line flags and batch manifests
+//
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "CommandLine.h"
+
+enum OptionResult {
+    OPTION_READ,
+    OPTION_UNKNOWN,
+    OPTION_INVALID
+};
+
+static bool parseInt(const string &text, int &value, int minimum) {
+    char *end;
+    long parsed = strtol(text.c_str(), &end, 10);
+    if(text.empty() || *end != '\0' || parsed < minimum){
+        return false;
+    }
+    value = (int)parsed;
+    return true;
+}
+
+static bool parseFloat(const string &text, float &value) {
+    char *end;
+    value = strtof(text.c_str(), &end);
+    return !text.empty() && *end == '\0';
+}
+
+//"all" or depths and ranges of them like "1,2,5-8" (1 to 31) as a bit mask
+static bool parseDepths(const string &text, unsigned int &depths) {
+    if(text == "all"){
+        depths = ~1u;
+        return true;
+    }
+    depths = 0;
+    stringstream stream(text);
+    string part;
+    while(getline(stream, part, ',')){
+        int first, last;
+        char extra;
+        int read = sscanf(part.c_str(), "%d-%d%c", &first, &last, &extra);
+        if(read == 1){
+            last = first;
+        }
+        else if(read != 2){
+            return false;
+        }
+        if(first < 1 || last > 31 || first > last){
+            return false;
+        }
+        for (int depth = first; depth <= last; ++depth) {
+            depths |= 1u << depth;
+        }
+    }
+    return depths != 0;
+}
+
+//"x,y,z"
+static bool parseVector(const string &text, vec3 &value) {
+    char extra;
+    return sscanf(text.c_str(), "%f,%f,%f%c", &value.x, &value.y, &value.z, &extra) == 3;
+}
+
+//Reads the render job flag at args[i] and its value (leaving i on the value). promptedSetting is set for the flags
+//that replace one of the console prompts.
+static OptionResult parseJobOption(const vector<string> &args, size_t &i, RenderJob &job, bool &promptedSetting,
+                                   string &error) {
+    const string &flag = args[i];
+    bool takesValue = flag == "--width" || flag == "--height" || flag == "--fov" || flag == "--depth"
+                      || flag == "--samples" || flag == "--eye" || flag == "--target" || flag == "--up"
+                      || flag == "--noise" || flag == "--output" || flag == "--format" || flag == "--band"
+                      || flag == "--time" || flag == "--checkpoint" || flag == "--light-samples"
+                      || flag == "--branch-weight" || flag == "--sort-rays" || flag == "--sampler"
+                      || flag == "--aov";
+    if(flag == "--progressive"){
+        job.progressive = true;
+        return OPTION_READ;
+    }
+    if(flag == "--no-roulette"){
+        job.russianRoulette = false;
+        return OPTION_READ;
+    }
+    if(flag == "--wavefront"){
+        job.wavefront = true;
+        return OPTION_READ;
+    }
+    if(flag == "--denoise"){
+        job.denoise = true;
+        return OPTION_READ;
+    }
+    if(flag == "--resume"){
+        job.progressive = true;
+        job.progressiveSettings.resume = true;
+        return OPTION_READ;
+    }
+    if(!takesValue){
+        error = "unknown option \"" + flag + "\"";
+        return OPTION_UNKNOWN;
+    }
+    if(i + 1 >= args.size()){
+        error = flag + " needs a value";
+        return OPTION_INVALID;
+    }
+    const string &value = args[++i];
+    bool valid = true;
+    promptedSetting = flag == "--width" || flag == "--height" || flag == "--fov" || flag == "--depth"
+                      || flag == "--samples";
+    if(flag == "--width"){
+        valid = parseInt(value, job.width, 1);
+    }
+    else if(flag == "--height"){
+        valid = parseInt(value, job.height, 1);
+    }
+    else if(flag == "--fov"){
+        valid = parseInt(value, job.fieldOfView, 1) && job.fieldOfView < 180;
+    }
+    else if(flag == "--depth"){
+        valid = parseInt(value, job.bounceDepth, 0);
+    }
+    else if(flag == "--samples"){
+        valid = parseInt(value, job.samples, 1);
+    }
+    else if(flag == "--eye"){
+        valid = parseVector(value, job.eye);
+    }
+    else if(flag == "--target"){
+        valid = parseVector(value, job.target);
+    }
+    else if(flag == "--up"){
+        valid = parseVector(value, job.up);
+    }
+    else if(flag == "--noise"){
+        valid = parseFloat(value, job.noiseThreshold) && job.noiseThreshold >= 0;
+    }
+    else if(flag == "--output"){
+        job.output = value;
+    }
+    else if(flag == "--format"){
+        valid = ImageStream::parseFormat(value, job.format);
+    }
+    else if(flag == "--aov"){
+        valid = GBuffer::parseLayout(value, job.aovLayout);
+        job.writeAovs = true;
+    }
+    else if(flag == "--band"){
+        valid = parseInt(value, job.bandRows, 0);
+    }
+    else if(flag == "--time"){
+        job.progressiveSettings.timeBudget = parseDuration(value);
+        job.progressive = true;
+        valid = job.progressiveSettings.timeBudget > 0;
+    }
+    else if(flag == "--checkpoint"){
+        job.progressiveSettings.checkpointPath = value;
+    }
+    else if(flag == "--light-samples"){
+        valid = parseInt(value, job.lightSamples, 0);
+    }
+    else if(flag == "--branch-weight"){
+        valid = parseFloat(value, job.branchThreshold) && job.branchThreshold >= 0;
+    }
+    else if(flag == "--sampler"){
+        valid = parseSamplerType(value, job.sampler);
+    }
+    else if(flag == "--sort-rays"){
+        valid = parseDepths(value, job.sortedDepths);
+        job.wavefront = true;
+    }
+    if(!valid){
+        error = "bad value \"" + value + "\" for " + flag;
+        return OPTION_INVALID;
+    }
+    return OPTION_READ;
+}
+
+bool parseCommandLine(int argc, char *argv[], CommandLine &commandLine) {
+    if(argc < 2){
+        cout<<"No scene given"<<endl;
+        return false;
+    }
+    commandLine.scene = argv[1];
+    if(commandLine.scene == "--help" || commandLine.scene == "-h"){
+        return false;
+    }
+    if(commandLine.scene.compare(0, 2, "--") == 0 && commandLine.scene != "--default" && commandLine.scene != "--yours"){
+        cout<<"The first argument has to be the scene (--default, --yours or a config file), not \""
+            <<commandLine.scene<<"\""<<endl;
+        return false;
+    }
+    vector<string> args(argv + 2, argv + argc);
+    for (size_t i = 0; i < args.size(); ++i) {
+        bool commandLineValue = args[i] == "--threads" || args[i] == "--batch" || args[i] == "--animate";
+        if(commandLineValue && i + 1 >= args.size()){
+            cout<<"Couldn't read the command line: "<<args[i]<<" needs a value"<<endl;
+            return false;
+        }
+        if(args[i] == "--threads"){
+            if(!parseInt(args[++i], commandLine.threads, 0)){
+                cout<<"Bad value \""<<args[i]<<"\" for --threads"<<endl;
+                return false;
+            }
+            commandLine.interactive = false;
+            continue;
+        }
+        if(args[i] == "--batch"){
+            commandLine.manifestPath = args[++i];
+            commandLine.interactive = false;
+            continue;
+        }
+        if(args[i] == "--animate"){
+            commandLine.animationPath = args[++i];
+            commandLine.interactive = false;
+            continue;
+        }
+        if(args[i] == "--no-cache"){
+            commandLine.sceneCache = false;
+            continue;
+        }
+        if(args[i] == "--no-prompt"){
+            commandLine.interactive = false;
+            continue;
+        }
+        bool promptedSetting = false;
+        string error;
+        if(parseJobOption(args, i, commandLine.job, promptedSetting, error) != OPTION_READ){
+            cout<<"Couldn't read the command line: "<<error<<endl;
+            return false;
+        }
+        if(promptedSetting){
+            commandLine.interactive = false;
+        }
+    }
+    if(!commandLine.manifestPath.empty() && !commandLine.animationPath.empty()){
+        cout<<"--batch and --animate don't go together"<<endl;
+        return false;
+    }
+    return true;
+}
+
+bool loadManifest(const string &path, const RenderJob &defaults, vector<RenderJob> &jobs) {
+    ifstream file(path);
+    if(!file){
+        cout<<"Couldn't open the manifest \""<<path<<"\""<<endl;
+        return false;
+    }
+    string line;
+    for (int lineNumber = 1; getline(file, line); ++lineNumber) {
+        istringstream words(line);
+        vector<string> args;
+        string word;
+        while(words >> word){
+            args.push_back(word);
+        }
+        if(args.empty() || args[0][0] == '#'){
+            continue;
+        }
+        RenderJob job = defaults;
+        for (size_t i = 0; i < args.size(); ++i) {
+            bool promptedSetting;
+            string error;
+            OptionResult result = parseJobOption(args, i, job, promptedSetting, error);
+            if(result == OPTION_UNKNOWN && (args[i] == "--threads" || args[i] == "--batch" || args[i] == "--animate"
+                                            || args[i] == "--no-cache")){
+                error = args[i] + " only goes on the command line";
+            }
+            if(result != OPTION_READ){
+                cout<<path<<" line "<<lineNumber<<": "<<error<<endl;
+                return false;
+            }
+        }
+        jobs.push_back(job);
+    }
+    if(jobs.empty()){
+        cout<<"The manifest \""<<path<<"\" doesn't have any jobs"<<endl;
+        return false;
+    }
+    return true;
+}
+
+void printUsage() {
+    cout<<"Usage:\n"
+          "\t./Assignment4 <scene> [options]\n"
+          "\t./Assignment4 --benchmark <name> [argument]\n"
+          "scene is --default, --yours or the path to a config file.\n"
+          "Without any of --width, --height, --fov, --depth, --samples, --threads, --batch, --animate or --no-prompt the\n"
+          "render settings are asked for on the console, anything not given uses its default.\n"
+          "\t--width <pixels>, --height <pixels>   (512 x 512)\n"
+          "\t--fov <degrees>                       (55)\n"
+          "\t--depth <bounces>                     (4)\n"
+          "\t--samples <n>                         at most n x n samples a pixel (2)\n"
+          "\t--threads <count>                     0 uses every hardware thread (0)\n"
+          "\t--eye <x,y,z>, --target <x,y,z>, --up <x,y,z>   camera (278,273,-500 looking at 278,273,0)\n"
+          "\t--output <name>                       file name without the extension (the scene's name)\n"
+          "\t--format <ppm, pfm or tiles>          (ppm)\n"
+          "\t--band <rows>                         stream the image to disk this many rows at a time\n"
+          "\t--aov <separate or combined>          also write the depth, normal, albedo, object ID, material type and\n"
+          "\t                                      triangle the primary rays hit, <output>.<aov>.pfm or <output>.aov\n"
+          "\t--sampler <stratified, sobol, r2 or bluenoise>\n"
+          "\t                                      where in each pixel the samples go (stratified)\n"
+          "\t--light-samples <n>                   shadow rays to n point lights picked from a light tree at every hit\n"
+          "\t                                      instead of one to every light (0, every light)\n"
+          "\t--branch-weight <weight>              reflections/refractions adding less than this to the pixel are ended\n"
+          "\t                                      by russian roulette, 0 traces them all to --depth (0.01)\n"
+          "\t--no-roulette                         drop those branches instead\n"
+          "\t--wavefront                           render each tile in waves (every ray of a bounce at once) instead of\n"
+          "\t                                      a sample at a time\n"
+          "\t--sort-rays <all or depths, 1,3-5>     with --wavefront, sort the reflection/refraction rays of those\n"
+          "\t                                      bounces by origin and direction before tracing them\n"
+          "\t--denoise                             filter the noise out of the finished image, guided by the depth,\n"
+          "\t                                      normal, albedo and object the primary rays hit\n"
+          "\t--progressive, --time <30s/5m/1h>, --noise <value>, --checkpoint <path>, --resume\n"
+          "\t                                      progressive rendering, see the ReadMe\n"
+          "\t--batch <manifest>                    render every job in the manifest (one line of the flags above\n"
+          "\t                                      each) with the scene loaded once\n"
+          "\t--animate <file>                      render every frame of a camera path / object animation into\n"
+          "\t                                      <output>_0000, <output>_0001, ... (see src/Scene/Animation.h)\n"
+          "\t--no-cache                            parse a config file and its OBJs even if <config>.cache is up to date\n"
+          "\t                                      (and don't write one)\n"
+          "\t--no-prompt                           don't ask for anything, use the defaults"<<endl;
+}
+
+double parseDuration(const string &text) {
+    char *unit;
+    double value = strtod(text.c_str(), &unit);
+    if(unit == text.c_str()){
+        return 0;
+    }
+    while(isspace((unsigned char)*unit)){
+        unit++;
+    }
+    double scale = 1;
+    if(*unit == 'm'){
+        scale = 60;
+    }else if(*unit == 'h'){
+        scale = 3600;
+    }else if(*unit != 's' && *unit != '\0'){
+        return 0;
+    }
+    //nothing but whitespace after the unit, so 1ms or 30x don't pass as something else
+    if(*unit != '\0'){
+        unit++;
+    }
+    while(isspace((unsigned char)*unit)){
+        unit++;
+    }
+    return *unit == '\0' ? value * scale : 0;
+}
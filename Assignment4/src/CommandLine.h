@@ -0,0 +1,86 @@
+//
+// Command line flags and batch manifests
+// A manifest is a text file with one render job per line, written with the same flags as the command line (blank lines
+// and lines starting with # are skipped). Every job starts from what the command line set and changes what its line
+// says, ie:
+//      --width 1920 --height 1080 --samples 3 --output wide
+//      --eye 278,273,-800 --output far
+//
+
+#ifndef ASSIGNMENT4_COMMANDLINE_H
+#define ASSIGNMENT4_COMMANDLINE_H
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Raytracer/RayTracer.h"
+
+using namespace std;
+using namespace glm;
+
+//everything about one render that isn't the scene
+struct RenderJob {
+    int width = 512;
+    int height = 512;
+    int fieldOfView = 55;
+    int bounceDepth = 4;
+    //square root of the most samples a pixel can get
+    int samples = 2;
+    vec3 eye = vec3(278, 273, -500);
+    vec3 target = vec3(278, 273, 0);
+    vec3 up = vec3(1, 0, 0);
+    float noiseThreshold = 0.003f;
+    SamplerType sampler = STRATIFIED_SAMPLER;
+    //point lights sampled at each shading point, 0 for all of them
+    int lightSamples = 0;
+    //reflections and refractions adding less than this to the pixel are ended by russian roulette (or dropped)
+    float branchThreshold = 0.01f;
+    bool russianRoulette = true;
+    bool wavefront = false;
+    //bit d set sorts the depth d reflection/refraction rays before tracing them (wavefront only)
+    unsigned int sortedDepths = 0;
+    //edge aware filter over the finished image (not for --band)
+    bool denoise = false;
+    //write the G-buffer next to the image (not for --band)
+    bool writeAovs = false;
+    AovLayout aovLayout = SEPARATE_AOVS;
+    //file name without the extension, the scene's name if empty
+    string output;
+    ImageFormat format = PPM_FORMAT;
+    //streams the output this many rows at a time, 0 renders the whole image at once
+    int bandRows = 0;
+    bool progressive = false;
+    //an empty checkpoint path becomes <output>.checkpoint
+    ProgressiveSettings progressiveSettings;
+};
+
+struct CommandLine {
+    //--default, --yours or the path to a config file
+    string scene;
+    int threads = 0;
+    //ask for the render settings on the console, off once any of them is given as a flag
+    bool interactive = true;
+    //render every job in this file instead of just one
+    string manifestPath;
+    //render every frame of this animation (see Animation.h) instead of just one image
+    string animationPath;
+    //load config files from their compiled cache (and write it when there isn't one yet)
+    bool sceneCache = true;
+    //the job to render (or what every manifest job starts from)
+    RenderJob job;
+};
+
+//False (after saying what's wrong) if the arguments don't make sense
+bool parseCommandLine(int argc, char *argv[], CommandLine &commandLine);
+
+//Adds a job for every line of the manifest, false (after saying what's wrong) if it can't be read or a line is bad
+bool loadManifest(const string &path, const RenderJob &defaults, vector<RenderJob> &jobs);
+
+void printUsage();
+
+//"30s", "5m", "1h" or just seconds, 0 for anything else (like "1ms")
+double parseDuration(const string &text);
+
+#endif //ASSIGNMENT4_COMMANDLINE_H
@@ -0,0 +1,125 @@
+//
+// A tileable 64x64 blue noise texture with two channels
+//
+
+#include "BlueNoise.h"
+#include "Sampler.h"
+
+#include <cmath>
+#include <vector>
+
+using namespace std;
+
+static const int texelCount = blueNoiseSize * blueNoiseSize;
+//the gaussian's reach in texels, past it exp(-r^2 / (2 * 1.5^2)) is under 1e-4
+static const int kernelRadius = 6;
+static const float kernelSigma = 1.5f;
+
+//A binary pattern on the torus and the energy (gaussian weighted count of set texels around it) of every texel, kept up
+//to date as texels flip. Set texels with the most energy are the tightest clusters, unset ones with the least the
+//largest voids.
+class VoidAndCluster {
+private:
+    vector<bool> pattern;
+    vector<float> energy;
+    float kernel[2 * kernelRadius + 1][2 * kernelRadius + 1];
+
+public:
+    VoidAndCluster() : pattern(texelCount, false), energy(texelCount, 0.0f) {
+        for (int dy = -kernelRadius; dy <= kernelRadius; ++dy) {
+            for (int dx = -kernelRadius; dx <= kernelRadius; ++dx) {
+                kernel[dy + kernelRadius][dx + kernelRadius] = expf(-(float)(dx * dx + dy * dy)
+                                                                    / (2 * kernelSigma * kernelSigma));
+            }
+        }
+    }
+
+    void flip(int texel) {
+        float sign = pattern[texel] ? -1.0f : 1.0f;
+        pattern[texel] = !pattern[texel];
+        int x = texel % blueNoiseSize;
+        int y = texel / blueNoiseSize;
+        for (int dy = -kernelRadius; dy <= kernelRadius; ++dy) {
+            int row = (y + dy + blueNoiseSize) % blueNoiseSize;
+            for (int dx = -kernelRadius; dx <= kernelRadius; ++dx) {
+                int column = (x + dx + blueNoiseSize) % blueNoiseSize;
+                energy[row * blueNoiseSize + column] += sign * kernel[dy + kernelRadius][dx + kernelRadius];
+            }
+        }
+    }
+
+    int tightestCluster() const {
+        int best = -1;
+        for (int i = 0; i < texelCount; ++i) {
+            if(pattern[i] && (best < 0 || energy[i] > energy[best])){
+                best = i;
+            }
+        }
+        return best;
+    }
+
+    int largestVoid() const {
+        int best = -1;
+        for (int i = 0; i < texelCount; ++i) {
+            if(!pattern[i] && (best < 0 || energy[i] < energy[best])){
+                best = i;
+            }
+        }
+        return best;
+    }
+};
+
+//The order texels get set in, each one going where it's furthest from the ones before. Every prefix is spread out
+//evenly, so rank / texelCount is a blue noise threshold map.
+static vector<int> makeRanks(unsigned int seed) {
+    VoidAndCluster grid;
+    //start from a tenth of the texels picked at random
+    int initialCount = texelCount / 10;
+    for (int i = 0; i < initialCount; ++i) {
+        grid.flip((int)permuteIndex((unsigned int)i, texelCount, seed));
+    }
+    //then spread them out, moving the tightest cluster into the largest void until it'd land where it came from
+    for (int i = 0; i < texelCount; ++i) {
+        int cluster = grid.tightestCluster();
+        grid.flip(cluster);
+        int gap = grid.largestVoid();
+        grid.flip(gap);
+        if(gap == cluster){
+            break;
+        }
+    }
+
+    vector<int> ranks(texelCount);
+    //the starting texels get the first ranks, taken out tightest cluster first
+    VoidAndCluster removing = grid;
+    for (int rank = initialCount - 1; rank >= 0; --rank) {
+        int cluster = removing.tightestCluster();
+        removing.flip(cluster);
+        ranks[cluster] = rank;
+    }
+    //and the rest fill the largest void left each time
+    for (int rank = initialCount; rank < texelCount; ++rank) {
+        int gap = grid.largestVoid();
+        grid.flip(gap);
+        ranks[gap] = rank;
+    }
+    return ranks;
+}
+
+static vector<vec2> makeTexture() {
+    vector<int> xRanks = makeRanks(0x5bd1e995u);
+    vector<int> yRanks = makeRanks(0x27d4eb2fu);
+    vector<vec2> texels(texelCount);
+    for (int i = 0; i < texelCount; ++i) {
+        texels[i] = vec2(((float)xRanks[i] + 0.5f) / (float)texelCount, ((float)yRanks[i] + 0.5f) / (float)texelCount);
+    }
+    return texels;
+}
+
+vec2 blueNoise(int x, int y) {
+    //made by whichever thread gets here first, the others wait for it
+    static const vector<vec2> texels = makeTexture();
+    x = ((x % blueNoiseSize) + blueNoiseSize) % blueNoiseSize;
+    y = ((y % blueNoiseSize) + blueNoiseSize) % blueNoiseSize;
+    return texels[y * blueNoiseSize + x];
+}
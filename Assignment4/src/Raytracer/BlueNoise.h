@@ -0,0 +1,22 @@
+//
+// A tileable 64x64 blue noise texture with two channels
+// Neighbouring texels get values far apart, so giving each pixel its own offset from it spreads the error between
+// pixels as high frequency noise (which looks finer than white noise and goes away under a little blur). Made once
+// the first time it's needed with the void and cluster method, the same on every run.
+// Based on: "The void-and-cluster method for dither array generation" (Ulichney 1993) and "Blue-noise Dithered
+// Sampling" (Georgiev and Fajardo 2016)
+//
+
+#ifndef ASSIGNMENT4_BLUENOISE_H
+#define ASSIGNMENT4_BLUENOISE_H
+
+#include <glm/glm.hpp>
+
+using namespace glm;
+
+static const int blueNoiseSize = 64;
+
+//the texel for pixel (x, y) (wrapping around), both channels uniform in (0, 1)
+vec2 blueNoise(int x, int y);
+
+#endif //ASSIGNMENT4_BLUENOISE_H
@@ -0,0 +1,91 @@
+//
+// Running totals for every pixel of a progressive render, saved after each pass
+//
+
+#include "Checkpoint.h"
+
+#include <cstdio>
+#include <cstring>
+
+static const char checkpointMagic[8] = {'R', 'T', 'C', 'H', 'E', 'C', 'K', '2'};
+
+const uint64_t Checkpoint::keyStart;
+
+//size of PixelSamples goes in too so a checkpoint from a build with a different layout gets turned down
+struct CheckpointHeader {
+    char magic[8];
+    int pixelSize;
+    int width;
+    int height;
+    int samples;
+    int maxDepth;
+    int pass;
+    int finished;
+    double seconds;
+    uint64_t key;
+};
+
+bool Checkpoint::save(const string &path) const {
+    string temporaryPath = path + ".tmp";
+    FILE *file = fopen(temporaryPath.c_str(), "wb");
+    if(file == nullptr){
+        return false;
+    }
+    CheckpointHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, checkpointMagic, sizeof(checkpointMagic));
+    header.pixelSize = (int)sizeof(PixelSamples);
+    header.width = width;
+    header.height = height;
+    header.samples = samples;
+    header.maxDepth = maxDepth;
+    header.pass = pass;
+    header.finished = finished;
+    header.seconds = seconds;
+    header.key = key;
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1
+                   && fwrite(pixels.data(), sizeof(PixelSamples), pixels.size(), file) == pixels.size();
+    written &= fclose(file) == 0;
+    if(!written){
+        remove(temporaryPath.c_str());
+        return false;
+    }
+    return rename(temporaryPath.c_str(), path.c_str()) == 0;
+}
+
+bool Checkpoint::load(const string &path) {
+    FILE *file = fopen(path.c_str(), "rb");
+    if(file == nullptr){
+        return false;
+    }
+    CheckpointHeader header;
+    if(fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, checkpointMagic, sizeof(checkpointMagic)) != 0
+       || header.pixelSize != (int)sizeof(PixelSamples) || header.width <= 0 || header.height <= 0){
+        fclose(file);
+        return false;
+    }
+    vector<PixelSamples> loadedPixels((size_t)header.width * header.height);
+    bool read = fread(loadedPixels.data(), sizeof(PixelSamples), loadedPixels.size(), file) == loadedPixels.size();
+    fclose(file);
+    if(!read){
+        return false;
+    }
+    width = header.width;
+    height = header.height;
+    samples = header.samples;
+    maxDepth = header.maxDepth;
+    pass = header.pass;
+    finished = header.finished != 0;
+    seconds = header.seconds;
+    key = header.key;
+    pixels.swap(loadedPixels);
+    return true;
+}
+
+uint64_t Checkpoint::hashKey(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
@@ -0,0 +1,75 @@
+//
+// Running totals for every pixel of a progressive render, saved after each pass so a killed render can pick up
+// where it left off
+//
+
+#ifndef ASSIGNMENT4_CHECKPOINT_H
+#define ASSIGNMENT4_CHECKPOINT_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+using namespace std;
+using namespace glm;
+
+//running totals for one pixel while its samples come in
+struct PixelSamples {
+    vec3 sum;
+    float luminanceSum;
+    float luminanceSquaredSum;
+    int count;
+    //still needs more samples
+    bool refine;
+
+    void add(vec3 color) {
+        sum += color;
+        float luminance = 0.2126f * color.r + 0.7152f * color.g + 0.0722f * color.b;
+        luminanceSum += luminance;
+        luminanceSquaredSum += luminance * luminance;
+        count++;
+    }
+
+    //standard error of the mean luminance, how far off the pixel probably still is
+    float standardError() const {
+        if(count < 2){
+            return 0;
+        }
+        float mean = luminanceSum / (float)count;
+        float variance = std::max(0.0f, (luminanceSquaredSum - luminanceSum * mean) / (float)(count - 1));
+        return sqrtf(variance / (float)count);
+    }
+};
+
+struct Checkpoint {
+    //a checkpoint only resumes a render with the same settings
+    int width = 0;
+    int height = 0;
+    int samples = 0;
+    int maxDepth = 0;
+    //the scene, camera and everything else the samples depend on (see ProgressiveSettings::key)
+    uint64_t key = 0;
+    //every pixel has all the samples it's getting, resuming it has nothing left to do
+    bool finished = false;
+    //passes that finished completely, the next one is redone for any pixel it didn't get to
+    int pass = 0;
+    //render time spent by every run so far
+    double seconds = 0;
+    //row by row
+    vector<PixelSamples> pixels;
+
+    //Writes to path.tmp and renames it over path, so a render killed while saving still leaves the last checkpoint
+    bool save(const string &path) const;
+    //False (leaving this alone) if the file is missing or isn't a checkpoint
+    bool load(const string &path);
+
+    //64 bit FNV-1a for building a key, start from keyStart
+    static const uint64_t keyStart = 14695981039346656037ULL;
+    static uint64_t hashKey(uint64_t hash, const void *data, size_t size);
+};
+
+#endif //ASSIGNMENT4_CHECKPOINT_H
@@ -0,0 +1,324 @@
+//
+// Edge avoiding a-trous wavelet filter, run on the finished image
+// The scalar and AVX2 rows do the same operations in the same order (and the project is built with floating point
+// contraction off) so they give exactly the same image.
+//
+
+#include "Denoiser.h"
+#include "../myMath.h"
+#include "../Scene/Acceleration/TriangleKernels.h"
+
+#include <algorithm>
+#include <cstring>
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#define SIMD_TARGET(isa)
+#else
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+//B3 spline, the 5x5 kernel is the outer product of it with itself
+static const float splineWeights[5] = {1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16};
+static const int tapCount = 25;
+//object ID of the padding around the planes
+static const float paddingId = -2;
+//added to the colour sigma^2 * variance so a pixel without any noise still averages with ones of nearly the same colour
+static const float varianceFloor = 1e-4f;
+
+//Everything a kernel needs for one row of a pass, the plane pointers are at the row's first pixel
+struct DenoiseRow {
+    const float *color[3];
+    float *out[3];
+    const float *variance;
+    float *outVariance;
+    const float *normal[3];
+    const float *albedo[3];
+    const float *depth;
+    const float *objectId;
+    //where every tap is from the center (in floats) and its spline weight
+    ptrdiff_t offsets[tapCount];
+    float tapWeights[tapCount];
+    int count;
+    //1 / sigma^2, depth's is 1 / (sigma * tap spacing) and gets divided by the center's depth, colour's is
+    //1 / (sigma^2 * the center's variance + varianceFloor)
+    float colorSigmaSquared;
+    float normalScale;
+    float depthScale;
+    float albedoScale;
+};
+
+//exp(-x) for x >= 0 to within 0.2%: 2^t split into 2^whole (the float's exponent) times 2^fraction (a 4th order
+//polynomial). Written out so the AVX2 version can do exactly the same.
+static inline float negativeExp(float x) {
+    float t = std::max(x * -1.44269504f, -126.0f);
+    float whole = floorf(t);
+    float fraction = t - whole;
+    float power = 0.0096181f;
+    power = power * fraction + 0.0555041f;
+    power = power * fraction + 0.2402265f;
+    power = power * fraction + 0.6931472f;
+    power = power * fraction + 1.0f;
+    int bits = ((int)whole + 127) << 23;
+    float scale;
+    memcpy(&scale, &bits, sizeof(float));
+    return power * scale;
+}
+
+static void denoiseRowScalar(const DenoiseRow &row) {
+    for (int x = 0; x < row.count; ++x) {
+        float centerId = row.objectId[x];
+        float centerDepth = row.depth[x];
+        float depthScale = row.depthScale / std::max(centerDepth, 1e-6f);
+        float colorScale = 1.0f / (row.colorSigmaSquared * row.variance[x] + varianceFloor);
+        float sum[3] = {0, 0, 0};
+        float weightSum = 0, varianceSum = 0;
+        for (int tap = 0; tap < tapCount; ++tap) {
+            ptrdiff_t q = x + row.offsets[tap];
+            float colorDistance = 0, normalDistance = 0, albedoDistance = 0;
+            for (int c = 0; c < 3; ++c) {
+                float colorDifference = row.color[c][q] - row.color[c][x];
+                float normalDifference = row.normal[c][q] - row.normal[c][x];
+                float albedoDifference = row.albedo[c][q] - row.albedo[c][x];
+                colorDistance = colorDistance + colorDifference * colorDifference;
+                normalDistance = normalDistance + normalDifference * normalDifference;
+                albedoDistance = albedoDistance + albedoDifference * albedoDifference;
+            }
+            float depthDistance = fabsf(row.depth[q] - centerDepth);
+            float exponent = colorDistance * colorScale + normalDistance * row.normalScale
+                             + depthDistance * depthScale + albedoDistance * row.albedoScale;
+            float weight = row.objectId[q] == centerId ? row.tapWeights[tap] * negativeExp(exponent) : 0.0f;
+            for (int c = 0; c < 3; ++c) {
+                sum[c] = sum[c] + weight * row.color[c][q];
+            }
+            weightSum = weightSum + weight;
+            varianceSum = varianceSum + weight * weight * row.variance[q];
+        }
+        //the center tap always counts so weightSum is never 0
+        for (int c = 0; c < 3; ++c) {
+            row.out[c][x] = sum[c] / weightSum;
+        }
+        row.outVariance[x] = varianceSum / (weightSum * weightSum);
+    }
+}
+
+SIMD_TARGET("avx2")
+static inline __m256 negativeExpAVX2(__m256 x) {
+    __m256 t = _mm256_max_ps(_mm256_mul_ps(x, _mm256_set1_ps(-1.44269504f)), _mm256_set1_ps(-126.0f));
+    __m256 whole = _mm256_floor_ps(t);
+    __m256 fraction = _mm256_sub_ps(t, whole);
+    __m256 power = _mm256_set1_ps(0.0096181f);
+    power = _mm256_add_ps(_mm256_mul_ps(power, fraction), _mm256_set1_ps(0.0555041f));
+    power = _mm256_add_ps(_mm256_mul_ps(power, fraction), _mm256_set1_ps(0.2402265f));
+    power = _mm256_add_ps(_mm256_mul_ps(power, fraction), _mm256_set1_ps(0.6931472f));
+    power = _mm256_add_ps(_mm256_mul_ps(power, fraction), _mm256_set1_ps(1.0f));
+    __m256i bits = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(whole), _mm256_set1_epi32(127)), 23);
+    return _mm256_mul_ps(power, _mm256_castsi256_ps(bits));
+}
+
+//8 pixels at a time, the last few lanes of a row land in the padding (which nothing reads back)
+SIMD_TARGET("avx2")
+static void denoiseRowAVX2(const DenoiseRow &row) {
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    for (int x = 0; x < row.count; x += 8) {
+        __m256 centerColor[3], centerNormal[3], centerAlbedo[3];
+        for (int c = 0; c < 3; ++c) {
+            centerColor[c] = _mm256_loadu_ps(row.color[c] + x);
+            centerNormal[c] = _mm256_loadu_ps(row.normal[c] + x);
+            centerAlbedo[c] = _mm256_loadu_ps(row.albedo[c] + x);
+        }
+        __m256 centerId = _mm256_loadu_ps(row.objectId + x);
+        __m256 centerDepth = _mm256_loadu_ps(row.depth + x);
+        __m256 depthScale = _mm256_div_ps(_mm256_set1_ps(row.depthScale),
+                                          _mm256_max_ps(centerDepth, _mm256_set1_ps(1e-6f)));
+        __m256 colorScale = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_add_ps(
+                _mm256_mul_ps(_mm256_set1_ps(row.colorSigmaSquared), _mm256_loadu_ps(row.variance + x)),
+                _mm256_set1_ps(varianceFloor)));
+        __m256 sum[3] = {_mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps()};
+        __m256 weightSum = _mm256_setzero_ps();
+        __m256 varianceSum = _mm256_setzero_ps();
+        for (int tap = 0; tap < tapCount; ++tap) {
+            ptrdiff_t q = x + row.offsets[tap];
+            __m256 colorDistance = _mm256_setzero_ps();
+            __m256 normalDistance = _mm256_setzero_ps();
+            __m256 albedoDistance = _mm256_setzero_ps();
+            __m256 tapColor[3];
+            for (int c = 0; c < 3; ++c) {
+                tapColor[c] = _mm256_loadu_ps(row.color[c] + q);
+                __m256 colorDifference = _mm256_sub_ps(tapColor[c], centerColor[c]);
+                __m256 normalDifference = _mm256_sub_ps(_mm256_loadu_ps(row.normal[c] + q), centerNormal[c]);
+                __m256 albedoDifference = _mm256_sub_ps(_mm256_loadu_ps(row.albedo[c] + q), centerAlbedo[c]);
+                colorDistance = _mm256_add_ps(colorDistance, _mm256_mul_ps(colorDifference, colorDifference));
+                normalDistance = _mm256_add_ps(normalDistance, _mm256_mul_ps(normalDifference, normalDifference));
+                albedoDistance = _mm256_add_ps(albedoDistance, _mm256_mul_ps(albedoDifference, albedoDifference));
+            }
+            __m256 depthDistance = _mm256_andnot_ps(signMask, _mm256_sub_ps(_mm256_loadu_ps(row.depth + q), centerDepth));
+            __m256 exponent = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+                    _mm256_mul_ps(colorDistance, colorScale),
+                    _mm256_mul_ps(normalDistance, _mm256_set1_ps(row.normalScale))),
+                    _mm256_mul_ps(depthDistance, depthScale)),
+                    _mm256_mul_ps(albedoDistance, _mm256_set1_ps(row.albedoScale)));
+            __m256 sameObject = _mm256_cmp_ps(_mm256_loadu_ps(row.objectId + q), centerId, _CMP_EQ_OQ);
+            __m256 weight = _mm256_and_ps(sameObject, _mm256_mul_ps(_mm256_set1_ps(row.tapWeights[tap]),
+                                                                    negativeExpAVX2(exponent)));
+            for (int c = 0; c < 3; ++c) {
+                sum[c] = _mm256_add_ps(sum[c], _mm256_mul_ps(weight, tapColor[c]));
+            }
+            weightSum = _mm256_add_ps(weightSum, weight);
+            varianceSum = _mm256_add_ps(varianceSum, _mm256_mul_ps(_mm256_mul_ps(weight, weight),
+                                                                   _mm256_loadu_ps(row.variance + q)));
+        }
+        for (int c = 0; c < 3; ++c) {
+            _mm256_storeu_ps(row.out[c] + x, _mm256_div_ps(sum[c], weightSum));
+        }
+        _mm256_storeu_ps(row.outVariance + x, _mm256_div_ps(varianceSum, _mm256_mul_ps(weightSum, weightSum)));
+    }
+}
+
+void Denoiser::setup(ImageData &image, const GBuffer &gBuffer, ThreadPool &workers, const DenoiseSettings &settings) {
+    width = gBuffer.getWidth();
+    height = gBuffer.getHeight();
+    //the last pass' taps are 2^(passes - 1) apart and reach twice that, the left padding keeps rows 32 byte aligned
+    int reach = 2 << (settings.passes - 1);
+    padding = (reach + 7) / 8 * 8;
+    stride = (width + 7) / 8 * 8 + 2 * padding;
+    size_t planeSize = (size_t)stride * (height + 2 * padding);
+    for (int c = 0; c < 3; ++c) {
+        color[c].assign(planeSize, 0.0f);
+        filtered[c].assign(planeSize, 0.0f);
+        normal[c].assign(planeSize, 0.0f);
+        albedo[c].assign(planeSize, 0.0f);
+    }
+    variance.assign(planeSize, 0.0f);
+    filteredVariance.assign(planeSize, 0.0f);
+    depth.assign(planeSize, 0.0f);
+    objectId.assign(planeSize, paddingId);
+    workers.parallelFor(height, [&](int y, int) {
+        for (int x = 0; x < width; ++x) {
+            size_t i = planeIndex(x, y);
+            vec3 pixelColor = image.getPixel(x, y);
+            vec3 pixelNormal = gBuffer.getNormal(x, y);
+            vec3 pixelAlbedo = gBuffer.getAlbedo(x, y);
+            for (int c = 0; c < 3; ++c) {
+                color[c][i] = pixelColor[c];
+                normal[c][i] = pixelNormal[c];
+                albedo[c][i] = pixelAlbedo[c];
+            }
+            //missed pixels only ever average with each other (same ID), their depth doesn't matter
+            float pixelDepth = gBuffer.getDepth(x, y);
+            depth[i] = pixelDepth < INFINITY ? pixelDepth : 0.0f;
+            objectId[i] = (float)gBuffer.getObjectId(x, y);
+        }
+    });
+    workers.parallelFor(height, [&](int y, int) {
+        for (int x = 0; x < width; ++x) {
+            variance[planeIndex(x, y)] = estimateVariance(x, y, image, gBuffer, settings);
+        }
+    });
+}
+
+//The variance the renderer measured is itself noisy with a few samples (4 that happen to agree say there's no noise at
+//all) so it gets averaged with the neighbours'. On an edge it's how different the surfaces are rather than noise, those
+//pixels are left as they are (0) and don't count for their neighbours. Pixels with 1 sample don't have one, the pixels
+//themselves are what's noisy then so how much they spread around their mean is their variance (the spread of a real
+//gradient or shadow edge gets counted as well, which only makes the filter a bit blurrier there).
+float Denoiser::estimateVariance(int x, int y, const ImageData &image, const GBuffer &gBuffer,
+                                 const DenoiseSettings &settings) const {
+    bool measured = gBuffer.getVariance(x, y) >= 0;
+    auto measuredEdge = [&](int pixelX, int pixelY) {
+        return gBuffer.getVariance(pixelX, pixelY) < 0 || gBuffer.isEdge(pixelX, pixelY,
+                                                                          image.getSampleCount(pixelX, pixelY));
+    };
+    if(measured && measuredEdge(x, y)){
+        return 0;
+    }
+    size_t center = planeIndex(x, y);
+    float normalScale = 1 / (settings.normalSigma * settings.normalSigma);
+    float depthScale = 1 / (settings.depthSigma * std::max(depth[center], 1e-6f));
+    float albedoScale = 1 / (settings.albedoSigma * settings.albedoSigma);
+    float weightSum = 0, luminanceSum = 0, squaredSum = 0, varianceSum = 0;
+    for (int tapY = 0; tapY < 5; ++tapY) {
+        for (int tapX = 0; tapX < 5; ++tapX) {
+            int tapPixelX = x + tapX - 2, tapPixelY = y + tapY - 2;
+            size_t q = planeIndex(tapPixelX, tapPixelY);
+            //the padding has its own object ID
+            if(objectId[q] != objectId[center] || (measured && measuredEdge(tapPixelX, tapPixelY))){
+                continue;
+            }
+            float normalDistance = 0, albedoDistance = 0;
+            for (int c = 0; c < 3; ++c) {
+                normalDistance += square(normal[c][q] - normal[c][center]);
+                albedoDistance += square(albedo[c][q] - albedo[c][center]);
+            }
+            float weight = splineWeights[tapY] * splineWeights[tapX]
+                           * negativeExp(normalDistance * normalScale + fabsf(depth[q] - depth[center]) * depthScale
+                                         + albedoDistance * albedoScale);
+            float luminance = 0.2126f * color[0][q] + 0.7152f * color[1][q] + 0.0722f * color[2][q];
+            weightSum += weight;
+            luminanceSum += weight * luminance;
+            squaredSum += weight * luminance * luminance;
+            if(measured){
+                varianceSum += weight * gBuffer.getVariance(tapPixelX, tapPixelY);
+            }
+        }
+    }
+    if(measured){
+        return varianceSum / weightSum;
+    }
+    float mean = luminanceSum / weightSum;
+    return std::max(0.0f, squaredSum / weightSum - mean * mean);
+}
+
+void Denoiser::denoise(ImageData &image, const GBuffer &gBuffer, ThreadPool &workers, const DenoiseSettings &settings,
+                       bool useSimd) {
+    DenoiseSettings passSettings = settings;
+    passSettings.passes = std::max(1, settings.passes);
+    setup(image, gBuffer, workers, passSettings);
+    DenoiseKernel kernel = useSimd && getSimdLevel() >= SIMD_AVX2 ? denoiseRowAVX2 : denoiseRowScalar;
+    for (int pass = 0; pass < passSettings.passes; ++pass) {
+        int step = 1 << pass;
+        workers.parallelFor(height, [&](int y, int) {
+            DenoiseRow row;
+            size_t first = planeIndex(0, y);
+            for (int c = 0; c < 3; ++c) {
+                row.color[c] = color[c].data() + first;
+                row.out[c] = filtered[c].data() + first;
+                row.normal[c] = normal[c].data() + first;
+                row.albedo[c] = albedo[c].data() + first;
+            }
+            row.variance = variance.data() + first;
+            row.outVariance = filteredVariance.data() + first;
+            row.depth = depth.data() + first;
+            row.objectId = objectId.data() + first;
+            for (int tapY = 0; tapY < 5; ++tapY) {
+                for (int tapX = 0; tapX < 5; ++tapX) {
+                    int tap = tapY * 5 + tapX;
+                    row.offsets[tap] = (ptrdiff_t)(tapY - 2) * step * stride + (tapX - 2) * step;
+                    row.tapWeights[tap] = splineWeights[tapY] * splineWeights[tapX];
+                }
+            }
+            row.count = width;
+            row.colorSigmaSquared = settings.colorSigma * settings.colorSigma;
+            row.normalScale = 1 / (settings.normalSigma * settings.normalSigma);
+            row.depthScale = 1 / (settings.depthSigma * (float)step);
+            row.albedoScale = 1 / (settings.albedoSigma * settings.albedoSigma);
+            kernel(row);
+        });
+        for (int c = 0; c < 3; ++c) {
+            swap(color[c], filtered[c]);
+        }
+        swap(variance, filteredVariance);
+    }
+
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            unsigned int sampleCount = image.getSampleCount(x, y);
+            if(sampleCount == 0){
+                continue;
+            }
+            size_t i = planeIndex(x, y);
+            vec3 pixelColor(color[0][i], color[1][i], color[2][i]);
+            image.storeSamples(x, y, pixelColor * (float)sampleCount, sampleCount);
+        }
+    }
+}
@@ -0,0 +1,71 @@
+//
+// Edge avoiding a-trous wavelet filter, run on the finished image
+// Every pass blurs each pixel with a 5x5 B3 spline kernel whose taps are 2^pass pixels apart, so five passes reach 62
+// pixels out for 25 taps a pass. A tap only counts as much as it looks like the same surface: close in the normal, depth,
+// albedo and object ID the primary rays saw (GBuffer.h), and in colour compared to how noisy the pixel is. The noise
+// (variance of the luminance) starts out as what the renderer measured, smoothed over the pixel's neighbours on the
+// same surface (or how much they differ, for 1 sample pixels), and gets filtered along with the colour, so a clean
+// image barely changes while noise inside a surface gets smoothed and edges, creases and texture/material boundaries
+// stay sharp.
+// Runs on the render's worker threads, 8 pixels at a time with AVX2 when the CPU has it (the scalar version gives
+// exactly the same image).
+// Based on: "Edge-Avoiding A-Trous Wavelet Transform for fast Global Illumination Filtering" (Dammertz et al. 2010)
+//
+
+#ifndef ASSIGNMENT4_DENOISER_H
+#define ASSIGNMENT4_DENOISER_H
+
+#include "GBuffer.h"
+#include "ImageData.h"
+#include "ThreadPool.h"
+#include "../AlignedAllocator.h"
+
+struct DenoiseSettings {
+    int passes = 5;
+    //how far apart two pixels can be before a tap between them stops counting (falls to 1/e), colour is in standard
+    //deviations of the center pixel's noise
+    float colorSigma = 4.0f;
+    float normalSigma = 0.3f;
+    //relative to the center pixel's depth a pixel of tap spacing
+    float depthSigma = 0.02f;
+    float albedoSigma = 0.1f;
+};
+
+//one row of a pass, see Denoiser.cpp
+struct DenoiseRow;
+typedef void (*DenoiseKernel)(const DenoiseRow &row);
+
+class Denoiser {
+private:
+    int width = 0, height = 0;
+    //rows are padded on both sides (and the planes above and below) by as far as the widest pass reaches, the padding
+    //has an object ID nothing else has so it never counts
+    int padding = 0;
+    int stride = 0;
+    AlignedVector<float> color[3];
+    AlignedVector<float> filtered[3];
+    AlignedVector<float> normal[3];
+    AlignedVector<float> albedo[3];
+    AlignedVector<float> variance;
+    AlignedVector<float> filteredVariance;
+    AlignedVector<float> depth;
+    AlignedVector<float> objectId;
+
+    size_t planeIndex(int x, int y) const {
+        return (size_t)(y + padding) * stride + (x + padding);
+    }
+
+    void setup(ImageData &image, const GBuffer &gBuffer, ThreadPool &workers, const DenoiseSettings &settings);
+
+    //luminance variance of pixel (x, y) from itself and the pixels around it that look like the same surface
+    float estimateVariance(int x, int y, const ImageData &image, const GBuffer &gBuffer,
+                           const DenoiseSettings &settings) const;
+
+public:
+    //filters image in place (the sample counts stay), gBuffer has to be the same size and come from the same render.
+    //useSimd false always runs the scalar version.
+    void denoise(ImageData &image, const GBuffer &gBuffer, ThreadPool &workers, const DenoiseSettings &settings,
+                 bool useSimd = true);
+};
+
+#endif //ASSIGNMENT4_DENOISER_H
@@ -0,0 +1,113 @@
+//
+// Auxiliary buffers (AOVs) about what the primary rays hit
+//
+
+#include <cstring>
+#include <fstream>
+#include <functional>
+
+#include "GBuffer.h"
+
+GBuffer::GBuffer(int width, int height) : width(width), height(height) {
+    clear();
+}
+
+void GBuffer::clear() {
+    size_t pixelCount = (size_t)width * height;
+    depthSums.assign(pixelCount, 0.0f);
+    normalSums.assign(pixelCount, vec3(0));
+    albedoSums.assign(pixelCount, vec3(0));
+    objectIds.assign(pixelCount, -1);
+    materialTypes.assign(pixelCount, -1);
+    triangles.assign(pixelCount, -1);
+    hitCounts.assign(pixelCount, 0);
+    mixedModels.assign(pixelCount, 0);
+    variances.assign(pixelCount, -1.0f);
+}
+
+//PFM with 1 (Pf) or 3 (PF) channels, bottom row first and little endian like ImageStream's
+static bool writePFM(const string &path, int width, int height, int channels,
+                     const function<void(int x, int y, float *pixel)> &channelsAt) {
+    ofstream file(path, ios::binary);
+    if(!file){
+        return false;
+    }
+    file<<(channels == 3 ? "PF" : "Pf")<<"\n"<<width<<" "<<height<<"\n-1.0\n";
+    vector<float> row((size_t)width * channels);
+    for (int y = height - 1; y >= 0; --y) {
+        for (int x = 0; x < width; ++x) {
+            channelsAt(x, y, &row[(size_t)x * channels]);
+        }
+        file.write((const char *)row.data(), row.size() * sizeof(float));
+    }
+    return (bool)file;
+}
+
+bool GBuffer::write(const string &name, AovLayout layout) const {
+    auto depthAt = [&](int x, int y) {
+        return hitCounts[pixelIndex(x, y)] > 0 ? getDepth(x, y) : 0.0f;
+    };
+    if(layout == SEPARATE_AOVS){
+        bool written = writePFM(name + ".depth.pfm", width, height, 1, [&](int x, int y, float *pixel) {
+            pixel[0] = depthAt(x, y);
+        });
+        written &= writePFM(name + ".normal.pfm", width, height, 3, [&](int x, int y, float *pixel) {
+            vec3 normal = getNormal(x, y);
+            memcpy(pixel, &normal, sizeof(vec3));
+        });
+        written &= writePFM(name + ".albedo.pfm", width, height, 3, [&](int x, int y, float *pixel) {
+            vec3 albedo = getAlbedo(x, y);
+            memcpy(pixel, &albedo, sizeof(vec3));
+        });
+        written &= writePFM(name + ".objectid.pfm", width, height, 1, [&](int x, int y, float *pixel) {
+            pixel[0] = (float)getObjectId(x, y);
+        });
+        written &= writePFM(name + ".material.pfm", width, height, 1, [&](int x, int y, float *pixel) {
+            pixel[0] = (float)getMaterialType(x, y);
+        });
+        written &= writePFM(name + ".triangle.pfm", width, height, 1, [&](int x, int y, float *pixel) {
+            pixel[0] = (float)getTriangle(x, y);
+        });
+        return written;
+    }
+
+    ofstream file(name + ".aov", ios::binary);
+    if(!file){
+        return false;
+    }
+    AovHeader header;
+    memcpy(header.magic, "RTAOVS01", 8);
+    header.width = width;
+    header.height = height;
+    header.channels = aovChannels;
+    file.write((const char *)&header, sizeof(header));
+    vector<float> row((size_t)width * aovChannels);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            float *pixel = &row[(size_t)x * aovChannels];
+            vec3 normal = getNormal(x, y);
+            vec3 albedo = getAlbedo(x, y);
+            pixel[0] = depthAt(x, y);
+            memcpy(pixel + 1, &normal, sizeof(vec3));
+            memcpy(pixel + 4, &albedo, sizeof(vec3));
+            pixel[7] = (float)getObjectId(x, y);
+            pixel[8] = (float)getMaterialType(x, y);
+            pixel[9] = (float)getTriangle(x, y);
+        }
+        file.write((const char *)row.data(), row.size() * sizeof(float));
+    }
+    return (bool)file;
+}
+
+bool GBuffer::parseLayout(const string &text, AovLayout &layout) {
+    if(text == "separate"){
+        layout = SEPARATE_AOVS;
+    }
+    else if(text == "combined"){
+        layout = COMBINED_AOVS;
+    }
+    else{
+        return false;
+    }
+    return true;
+}
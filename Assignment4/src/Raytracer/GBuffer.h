@@ -0,0 +1,157 @@
+//
+// Auxiliary buffers (AOVs) about what the primary rays hit: distance, normal, albedo, model, material type and triangle
+// Every sample that hits something adds to its pixel and the pixel holds the mean of them (the object ID, material type
+// and triangle are the first hit's). Filled in by the renderer next to the image, each tile only ever writes its own
+// pixels. Once a pixel is done it also gets how noisy it still is.
+//
+// Written out (--aov) either as a PFM an AOV, <name>.<aov>.pfm:
+//  - depth: distance along the primary ray, 0 where nothing was hit
+//  - normal: world space, facing the camera, RGB = XYZ
+//  - albedo: RGB
+//  - objectid: model index in the scene (spheres, then meshes, then instances), -1 for nothing
+//  - material: MaterialType (PHONG 0, TRANSMITTANCE 1, REFLECTION 2, LIGHT 3, PBR 4), -1 for nothing
+//  - triangle: index in the mesh's triangles (BVH leaf order, not the OBJ's), -1 for spheres and nothing
+// or all of them in <name>.aov: an AovHeader followed by the pixels row by row from the top, each one
+// aovChannels floats in that order (depth, normal XYZ, albedo RGB, object ID, material, triangle). IDs and indices are
+// exact as floats up to 2^24.
+//
+
+#ifndef ASSIGNMENT4_GBUFFER_H
+#define ASSIGNMENT4_GBUFFER_H
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+using namespace std;
+using namespace glm;
+
+enum AovLayout {
+    SEPARATE_AOVS,
+    COMBINED_AOVS
+};
+
+static const int aovChannels = 10;
+
+struct AovHeader {
+    //"RTAOVS01"
+    char magic[8];
+    int width;
+    int height;
+    //always aovChannels
+    int channels;
+};
+
+class GBuffer {
+private:
+    int width, height;
+    vector<float> depthSums;
+    vector<vec3> normalSums;
+    vector<vec3> albedoSums;
+    vector<int> objectIds;
+    vector<int> materialTypes;
+    vector<int> triangles;
+    vector<unsigned int> hitCounts;
+    //some sample hit another model than the first one
+    vector<unsigned char> mixedModels;
+    vector<float> variances;
+
+    size_t pixelIndex(int x, int y) const {
+        return (size_t)y * width + x;
+    }
+
+public:
+    GBuffer(int width, int height);
+
+    //forgets every hit, for the next render
+    void clear();
+
+    //depth is the distance along the primary ray, normal faces the camera, triangle is -1 for spheres
+    void addHit(int x, int y, float depth, const vec3 &normal, const vec3 &albedo, int objectId, int materialType,
+                int triangle) {
+        size_t i = pixelIndex(x, y);
+        if(hitCounts[i] == 0){
+            objectIds[i] = objectId;
+            materialTypes[i] = materialType;
+            triangles[i] = triangle;
+        }else if(objectIds[i] != objectId){
+            mixedModels[i] = 1;
+        }
+        depthSums[i] += depth;
+        normalSums[i] += normal;
+        albedoSums[i] += albedo;
+        hitCounts[i]++;
+    }
+
+    //variance of the pixel's mean luminance (its standard error squared), -1 if it has less than 2 samples
+    void setVariance(int x, int y, float variance) {
+        variances[pixelIndex(x, y)] = variance;
+    }
+
+    float getVariance(int x, int y) const {
+        return variances[pixelIndex(x, y)];
+    }
+
+    //INFINITY if none of the pixel's samples hit anything
+    float getDepth(int x, int y) const {
+        size_t i = pixelIndex(x, y);
+        return hitCounts[i] > 0 ? depthSums[i] / (float)hitCounts[i] : INFINITY;
+    }
+
+    //unit length (0 for no hits), where the samples hit different surfaces it's the direction of their mean
+    vec3 getNormal(int x, int y) const {
+        const vec3 &sum = normalSums[pixelIndex(x, y)];
+        float sumLength = length(sum);
+        return sumLength > 0 ? sum / sumLength : vec3(0);
+    }
+
+    //0 for no hits
+    vec3 getAlbedo(int x, int y) const {
+        size_t i = pixelIndex(x, y);
+        return hitCounts[i] > 0 ? albedoSums[i] / (float)hitCounts[i] : vec3(0);
+    }
+
+    //model of the render context the first hit was on, -1 for no hits
+    int getObjectId(int x, int y) const {
+        return objectIds[pixelIndex(x, y)];
+    }
+
+    //MaterialType of the first hit, -1 for no hits
+    int getMaterialType(int x, int y) const {
+        return materialTypes[pixelIndex(x, y)];
+    }
+
+    //triangle of the first hit in its mesh, -1 for no hits or a sphere
+    int getTriangle(int x, int y) const {
+        return triangles[pixelIndex(x, y)];
+    }
+
+    unsigned int getHitCount(int x, int y) const {
+        return hitCounts[pixelIndex(x, y)];
+    }
+
+    //the pixel's samples didn't all hit the same flat surface (different models or normals, or only some of them hit
+    //anything), it's on an edge
+    bool isEdge(int x, int y, unsigned int sampleCount) const {
+        size_t i = pixelIndex(x, y);
+        return mixedModels[i] || (hitCounts[i] > 0 && hitCounts[i] < sampleCount)
+               || length(normalSums[i]) < 0.999f * (float)hitCounts[i];
+    }
+
+    int getWidth() const {
+        return width;
+    }
+
+    int getHeight() const {
+        return height;
+    }
+
+    //name doesn't include the extension, false if a file couldn't be written
+    bool write(const string &name, AovLayout layout) const;
+
+    //"separate" or "combined", false for anything else
+    static bool parseLayout(const string &text, AovLayout &layout);
+};
+
+#endif //ASSIGNMENT4_GBUFFER_H
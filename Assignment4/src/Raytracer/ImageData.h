@@ -1,29 +1,96 @@
 //
 // This will export the render
+// The framebuffer is one 64 byte aligned block of HDR pixels (the summed samples and how many there were). By default it
+// is laid out in 8x8 pixel blocks of 1KB each, so a render tile only ever touches whole cache lines of its own and two
+// threads never write to the same line. Pass tiled = false for a plain row by row layout.
+// An image can also hold just a band of rows of a bigger one (see setFirstRow), pixels are still addressed by where they
+// are in the whole picture.
 //
 
 #ifndef ASSIGNMENT4_IMAGE_H
 #define ASSIGNMENT4_IMAGE_H
 
 
+#include <vector>
+#include <string>
 #include <glm/vec3.hpp>
 #include "../Scene/Shading/Color.h"
+#include "../AlignedAllocator.h"
 
 using namespace glm;
+
+//what write saves, see ImageStream.h for the details
+enum ImageFormat {
+    PPM_FORMAT,
+    PFM_FORMAT,
+    TILED_RAW_FORMAT
+};
+
+//16 bytes so four share a cache line
+struct FramePixel {
+    //every sample added together, the pixel is sum / sampleCount
+    vec3 sum;
+    unsigned int sampleCount;
+};
+
 class ImageData {
 private:
     int width, height;
-    //vector<vector<Color>> pixelData;
-    //Color * pixelData;
-    vector<vector<Color>> framebuffer;
+    bool tiled;
+    //in blocks for the tiled layout, in pixels (rounded up to a cache line) for rows
+    int rowLength;
+    //row of the whole picture that the first row here holds
+    int firstRow = 0;
+    vector<FramePixel, AlignedAllocator<FramePixel, 64>> framebuffer;
+
+    size_t pixelIndex(int x, int y) const {
+        y -= firstRow;
+        if(!tiled){
+            return (size_t)y * rowLength + x;
+        }
+        return ((size_t)(y >> blockShift) * rowLength + (x >> blockShift)) * blockPixels
+               + ((y & (blockSize - 1)) << blockShift) + (x & (blockSize - 1));
+    }
 
 public:
-    ImageData(int width, int height);
+    static const int blockShift = 3;
+    static const int blockSize = 1 << blockShift;
+    static const int blockPixels = blockSize * blockSize;
+
+    ImageData(int width, int height, bool tiled = true);
     ~ImageData() = default;
 
     void writeToPPM(string name, float exposure = 1.2f, float gamma = 0.75f);
+    //name doesn't include the extension
+    bool write(string name, ImageFormat format, float exposure = 1.2f, float gamma = 0.75f);
 
-    void storePixel(int x, int y, vec3 color);
+    //for a band of a bigger picture, rows firstRow..firstRow+height-1
+    void setFirstRow(int row) {
+        firstRow = row;
+    }
+
+    //one sample's worth of color
+    void storePixel(int x, int y, vec3 color) {
+        FramePixel &pixel = framebuffer[pixelIndex(x, y)];
+        pixel.sum = color;
+        pixel.sampleCount = 1;
+    }
+
+    void storeSamples(int x, int y, vec3 sum, unsigned int sampleCount) {
+        FramePixel &pixel = framebuffer[pixelIndex(x, y)];
+        pixel.sum = sum;
+        pixel.sampleCount = sampleCount;
+    }
+
+    //the mean of the samples, black if there aren't any
+    vec3 getPixel(int x, int y) const {
+        const FramePixel &pixel = framebuffer[pixelIndex(x, y)];
+        return pixel.sampleCount > 0 ? pixel.sum / (float)pixel.sampleCount : vec3(0);
+    }
+
+    unsigned int getSampleCount(int x, int y) const {
+        return framebuffer[pixelIndex(x, y)].sampleCount;
+    }
 
     int getWidth() {
         return width;
@@ -32,6 +99,15 @@ public:
     int getHeight() {
         return height;
     }
+
+    bool isTiled() {
+        return tiled;
+    }
+
+    //bytes the framebuffer takes up (padding included)
+    size_t getMemoryUsage() {
+        return framebuffer.capacity() * sizeof(FramePixel);
+    }
 };
 
 
@@ -0,0 +1,174 @@
+//
+// Writes an image to disk a band of rows at a time
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "ImageStream.h"
+
+ImageStream::ImageStream(string name, ImageFormat format, int width, int height, int tileSize, float exposure,
+                         float gamma) : width(width), height(height), tileSize(tileSize), format(format),
+                                        exposure(exposure), gamma(gamma) {
+    string path = name + extension(format);
+#ifdef _WIN32
+    file = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, 0644);
+#else
+    file = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+    if(file == -1){
+        return;
+    }
+    if(format == TILED_RAW_FORMAT){
+        TiledRawHeader header;
+        memcpy(header.magic, "RTTILES1", 8);
+        header.width = width;
+        header.height = height;
+        header.tileSize = tileSize;
+        header.channels = 3;
+        header.tilesX = (width + tileSize - 1) / tileSize;
+        header.tilesY = (height + tileSize - 1) / tileSize;
+        headerSize = sizeof(header);
+        if(!writeAt(&header, headerSize, 0)){
+            closeFile();
+        }
+        return;
+    }
+    char header[64];
+    if(format == PPM_FORMAT){
+        headerSize = (size_t)snprintf(header, sizeof(header), "P6\n%d %d\n255\n", width, height);
+    }else{
+        //negative scale means little endian
+        headerSize = (size_t)snprintf(header, sizeof(header), "PF\n%d %d\n-1.0\n", width, height);
+    }
+    if(!writeAt(header, headerSize, 0)){
+        closeFile();
+    }
+}
+
+ImageStream::~ImageStream() {
+    closeFile();
+}
+
+void ImageStream::closeFile() {
+    if(file != -1){
+#ifdef _WIN32
+        _close(file);
+#else
+        close(file);
+#endif
+        file = -1;
+    }
+}
+
+bool ImageStream::writeAt(const void *data, size_t size, size_t offset) {
+    const char *bytes = (const char *)data;
+    while(size > 0){
+#ifdef _WIN32
+        //only one thread writes at a time so seek + write is fine here
+        _lseeki64(file, (long long)offset, SEEK_SET);
+        long long written = _write(file, bytes, (unsigned int)std::min(size, (size_t)1 << 30));
+#else
+        long long written = pwrite(file, bytes, size, (off_t)offset);
+#endif
+        if(written <= 0){
+            return false;
+        }
+        bytes += written;
+        size -= (size_t)written;
+        offset += (size_t)written;
+    }
+    return true;
+}
+
+bool ImageStream::writeBand(const ImageData &image, int startY, int endY) {
+    if(file == -1){
+        return false;
+    }
+    int rows = endY - startY;
+    if(format == PPM_FORMAT){
+        vector<unsigned char> band((size_t)rows * width * 3);
+        unsigned char *destination = band.data();
+        for (int y = startY; y < endY; ++y) {
+            for (int x = 0; x < width; ++x) {
+                vec3 pixel = image.getPixel(x, y);
+                Color currentColor(pixel.r, pixel.g, pixel.b, 1.0f);
+                currentColor.applyGammaCorrection(exposure, gamma);
+                currentColor.clampColor();
+                *destination++ = (unsigned char)(currentColor.r * 255);
+                *destination++ = (unsigned char)(currentColor.g * 255);
+                *destination++ = (unsigned char)(currentColor.b * 255);
+            }
+        }
+        return writeAt(band.data(), band.size(), headerSize + (size_t)startY * width * 3);
+    }
+    if(format == PFM_FORMAT){
+        //the file starts at the bottom row so the band goes in upside down
+        vector<float> band((size_t)rows * width * 3);
+        float *destination = band.data();
+        for (int y = endY - 1; y >= startY; --y) {
+            for (int x = 0; x < width; ++x) {
+                vec3 pixel = image.getPixel(x, y);
+                *destination++ = pixel.r;
+                *destination++ = pixel.g;
+                *destination++ = pixel.b;
+            }
+        }
+        return writeAt(band.data(), band.size() * sizeof(float),
+                       headerSize + (size_t)(height - endY) * width * 3 * sizeof(float));
+    }
+
+    if(startY % tileSize != 0 || (endY % tileSize != 0 && endY != height)){
+        return false;
+    }
+    int tilesX = (width + tileSize - 1) / tileSize;
+    int firstTileRow = startY / tileSize;
+    int tileRows = (rows + tileSize - 1) / tileSize;
+    size_t tileFloats = (size_t)tileSize * tileSize * 3;
+    vector<float> band((size_t)tilesX * tileRows * tileFloats, 0.0f);
+    for (int y = startY; y < endY; ++y) {
+        int tileRow = y / tileSize - firstTileRow;
+        for (int x = 0; x < width; ++x) {
+            vec3 pixel = image.getPixel(x, y);
+            float *destination = band.data() + ((size_t)tileRow * tilesX + x / tileSize) * tileFloats
+                                 + ((y % tileSize) * tileSize + x % tileSize) * 3;
+            destination[0] = pixel.r;
+            destination[1] = pixel.g;
+            destination[2] = pixel.b;
+        }
+    }
+    return writeAt(band.data(), band.size() * sizeof(float),
+                   headerSize + (size_t)firstTileRow * tilesX * tileFloats * sizeof(float));
+}
+
+string ImageStream::extension(ImageFormat format) {
+    if(format == PFM_FORMAT){
+        return ".pfm";
+    }
+    return format == TILED_RAW_FORMAT ? ".tiles" : ".ppm";
+}
+
+bool ImageStream::parseFormat(const string &name, ImageFormat &format) {
+    if(name == "ppm"){
+        format = PPM_FORMAT;
+    }
+    else if(name == "pfm"){
+        format = PFM_FORMAT;
+    }
+    else if(name == "tiles"){
+        format = TILED_RAW_FORMAT;
+    }
+    else{
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,72 @@
+//
+// Writes an image to disk a band of rows at a time so a render doesn't have to keep the whole framebuffer around.
+// Every band goes straight to where it belongs in the file (one pwrite), so bands can be written in any order and from
+// any thread as long as they don't overlap.
+//
+// Formats:
+//  - PPM: 8 bit, exposure and gamma applied exactly like ImageData::writeToPPM
+//  - PFM: the raw float RGB (bottom row first, like every PFM)
+//  - tiled raw: for stitching tools. A 32 byte header (see TiledRawHeader) followed by every tile in row major order,
+//    each one tileSize x tileSize float RGB pixels row by row. Tiles off the edge of the image are padded with zeros so
+//    every tile is the same size and tile i starts at sizeof(TiledRawHeader) + i * tileSize * tileSize * 12.
+//
+
+#ifndef ASSIGNMENT4_IMAGESTREAM_H
+#define ASSIGNMENT4_IMAGESTREAM_H
+
+#include <string>
+
+#include "ImageData.h"
+
+using namespace std;
+
+struct TiledRawHeader {
+    //"RTTILES1"
+    char magic[8];
+    int width;
+    int height;
+    int tileSize;
+    //always 3 (float RGB)
+    int channels;
+    int tilesX;
+    int tilesY;
+};
+
+class ImageStream {
+private:
+    int width, height, tileSize;
+    ImageFormat format;
+    float exposure, gamma;
+    //file descriptor, -1 if it couldn't be opened
+    int file = -1;
+    size_t headerSize = 0;
+
+    bool writeAt(const void *data, size_t size, size_t offset);
+    //also how a stream whose header couldn't be written stops being open
+    void closeFile();
+
+public:
+    //name doesn't include the extension, tileSize only matters for the tiled format
+    ImageStream(string name, ImageFormat format, int width, int height, int tileSize = 32, float exposure = 1.2f,
+                float gamma = 0.75f);
+    ~ImageStream();
+
+    ImageStream(const ImageStream &) = delete;
+    ImageStream &operator=(const ImageStream &) = delete;
+
+    //false if the file couldn't be created or its header couldn't be written
+    bool isOpen() {
+        return file != -1;
+    }
+
+    //Writes rows startY..endY-1 of the image (which only has to hold those rows). For the tiled format the band has to
+    //start on a tile row and end on one (or at the bottom of the image).
+    bool writeBand(const ImageData &image, int startY, int endY);
+
+    //".ppm", ".pfm" or ".tiles"
+    static string extension(ImageFormat format);
+    //"ppm", "pfm" or "tiles", false for anything else
+    static bool parseFormat(const string &name, ImageFormat &format);
+};
+
+#endif //ASSIGNMENT4_IMAGESTREAM_H
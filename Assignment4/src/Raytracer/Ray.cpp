@@ -18,18 +18,6 @@ void Ray::moveRay(vec3 pos) {
     rayOrigin -= pos;
 }
 
-vec3 Ray::getOrigin(){
-    return rayOrigin;
-}
-
-vec3 Ray::getDirection(){
-    return direction;
-}
-
-float Ray::getTimeValueMax() {
-    return rayTimeValueMax;
-}
-
 //Ray::Ray(Ray &rayOld) {
 //    rayOrigin = rayOld.getOrigin();
 //    direction = rayOld.getDirection();
@@ -29,6 +29,15 @@ using namespace glm;
 // 'Infinite' distance, used as a default value
 #define RAY_T_MAX 1.0e30f
 
+//What a ray is for. Every model has a mask of these and is only tested against the rays whose bit it has set,
+//so a model can be hidden from the camera, from reflections/refractions or stop casting shadows.
+enum RayVisibility {
+    VISIBLE_TO_CAMERA = 1,
+    VISIBLE_TO_REFLECTIONS = 2,
+    CASTS_SHADOWS = 4,
+    VISIBLE_TO_ALL = 7
+};
+
 class Ray {
 private:
     vec3 rayOrigin = vec3(0);
@@ -36,7 +45,10 @@ private:
     float rayTimeValueMax = RAY_T_MAX;
 
 public:
-    bool isShadowRay = false;
+    unsigned int visibilityMask = VISIBLE_TO_CAMERA;
+    //seed for anything random along the path this ray is part of (which lights get sampled), different for every
+    //pixel sample and every bounce
+    unsigned int sampleSeed = 0;
 
     Ray() = default;
 
@@ -48,9 +60,18 @@ public:
     vec3 calculate(float t);
     void moveRay(vec3 pos);
 
-    float getTimeValueMax();
-    vec3 getDirection();
-    vec3 getOrigin();
+    //inline so the intersection tests that call them in their inner loops don't pay for a call each time
+    float getTimeValueMax() {
+        return rayTimeValueMax;
+    }
+
+    vec3 getDirection() {
+        return direction;
+    }
+
+    vec3 getOrigin() {
+        return rayOrigin;
+    }
 };
 
 
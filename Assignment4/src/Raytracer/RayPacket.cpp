@@ -0,0 +1,89 @@
+//
+// A block of coherent rays that share an origin, traced through the BVHs together
+//
+
+#include "RayPacket.h"
+
+void RayPacket::setup(int columns, int rows) {
+    this->columns = columns;
+    this->rows = rows;
+    rayCount = columns * rows;
+    for (int i = 0; i < rayCount; ++i) {
+        inverseDirection[i] = 1.0f / direction[i];
+        tNear[i] = RAY_T_MAX;
+        index[i] = 0;
+        uv[i] = vec2(0);
+        hit[i] = false;
+    }
+    updateFrustum();
+}
+
+void RayPacket::updateFrustum() {
+    centerDirection = vec3(0);
+    for (int i = 0; i < rayCount; ++i) {
+        centerDirection += direction[i];
+    }
+    for (int i = 0; i < 4; ++i) {
+        planeNormal[i] = vec3(0);
+    }
+    //Jittered samples don't sit on a grid so the corner rays don't bound the rest. Instead every ray's slope along two
+    //axes across the center direction is measured and the planes go through the smallest and largest ones.
+    //The first axis follows the rows so the frustum hugs the block, a single column just picks any side direction.
+    vec3 center = normalize(centerDirection);
+    vec3 across = direction[columns - 1] - direction[0];
+    across -= dot(across, center) * center;
+    if(length(across) < 1e-12f){
+        across = cross(center, fabs(center.x) < 0.9f ? vec3(1, 0, 0) : vec3(0, 1, 0));
+    }
+    vec3 axes[2];
+    axes[0] = normalize(across);
+    axes[1] = normalize(cross(center, axes[0]));
+    float minimumSlope[2] = {INFINITY, INFINITY};
+    float maximumSlope[2] = {-INFINITY, -INFINITY};
+    for (int i = 0; i < rayCount; ++i) {
+        float forward = dot(direction[i], center);
+        //a ray going sideways or backwards can't be bounded this way, no planes just means nothing gets culled
+        if(!(forward > 0)){
+            return;
+        }
+        for (int axis = 0; axis < 2; ++axis) {
+            float slope = dot(direction[i], axes[axis]) / forward;
+            minimumSlope[axis] = std::min(minimumSlope[axis], slope);
+            maximumSlope[axis] = std::max(maximumSlope[axis], slope);
+        }
+    }
+    //a point p is inside when minimumSlope <= dot(p, axis) / dot(p, center) <= maximumSlope
+    for (int axis = 0; axis < 2; ++axis) {
+        planeNormal[axis * 2] = normalize(axes[axis] - minimumSlope[axis] * center);
+        planeNormal[axis * 2 + 1] = normalize(maximumSlope[axis] * center - axes[axis]);
+    }
+}
+
+bool RayPacket::frustumOverlaps(const AABB &bounds) const {
+    for (int i = 0; i < 4; ++i) {
+        const vec3 &normal = planeNormal[i];
+        //the box corner furthest along the normal, if even that one is behind the plane the whole box is
+        vec3 corner(normal.x >= 0 ? bounds.maximum.x : bounds.minimum.x,
+                    normal.y >= 0 ? bounds.maximum.y : bounds.minimum.y,
+                    normal.z >= 0 ? bounds.maximum.z : bounds.minimum.z);
+        vec3 offset = corner - origin;
+        //corner rays lie right on the planes, the margin keeps rounding from culling a box one of them touches
+        float margin = 1e-4f * (fabs(offset.x) + fabs(offset.y) + fabs(offset.z));
+        if(dot(normal, offset) < -margin){
+            return false;
+        }
+    }
+    return true;
+}
+
+int RayPacket::firstHit(const AABB &bounds, int firstRay) const {
+    if(!frustumOverlaps(bounds)){
+        return rayCount;
+    }
+    for (int i = firstRay; i < rayCount; ++i) {
+        if(bounds.intersect(origin, inverseDirection[i], tNear[i]) != RAY_T_MAX){
+            return i;
+        }
+    }
+    return rayCount;
+}
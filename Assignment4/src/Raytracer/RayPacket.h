@@ -0,0 +1,50 @@
+//
+// A block of coherent rays that share an origin (primary rays from the camera), traced through the BVHs together
+// Nodes and whole models outside the frustum around the block get skipped for every ray at once.
+// Based on the packet traversal in "Ray Tracing Deformable Scenes using Dynamic Bounding Volume Hierarchies"
+// (Wald, Boulos and Shirley 2007)
+//
+
+#ifndef ASSIGNMENT4_RAYPACKET_H
+#define ASSIGNMENT4_RAYPACKET_H
+
+#include "Ray.h"
+#include "../Scene/Acceleration/AABB.h"
+
+struct RayPacket {
+    //an 8x8 block of pixels
+    static const int maxRays = 64;
+
+    //rays are stored row by row, columns x rows of them
+    int columns = 0;
+    int rows = 0;
+    int rayCount = 0;
+
+    vec3 origin;
+    unsigned int visibilityMask = VISIBLE_TO_CAMERA;
+    vec3 direction[maxRays];
+    vec3 inverseDirection[maxRays];
+
+    //per ray closest hit, tNear also stops the traversal for that ray like it does for a single ray
+    float tNear[maxRays];
+    int index[maxRays];
+    vec2 uv[maxRays];
+    bool hit[maxRays];
+
+    //the 4 planes through the origin around every ray of the packet, normals point into the frustum
+    vec3 planeNormal[4];
+    vec3 centerDirection;
+
+    //Call once the origin and directions are in: works out the inverse directions and frustum and clears the hits
+    void setup(int columns, int rows);
+    //Same but keeps the hits, used after moving the packet into another space
+    void updateFrustum();
+
+    //False only if the box is completely outside the frustum (so none of the rays can reach it)
+    bool frustumOverlaps(const AABB &bounds) const;
+
+    //First ray from firstRay on that reaches the box before its tNear, rayCount if none do
+    int firstHit(const AABB &bounds, int firstRay) const;
+};
+
+#endif //ASSIGNMENT4_RAYPACKET_H
@@ -3,130 +3,997 @@
 //
 
 #include "RayTracer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
 //#include "../Scene/Shading/Color.h"
 //#include "ImageData.h"
 //#include "Ray.h"
 //#include "../Scene/Shading/Light.h"
 
-RayTracer::RayTracer(int samples, int width, int height, int maxDepth, Scene scene,bool threading) {
+//which of the random streams bounceSeed gives a hit each thing made there uses, light sample i uses LIGHT_BRANCH + i
+enum SeedBranch {
+    REFLECTION_BRANCH,
+    REFRACTION_BRANCH,
+    ROULETTE_BRANCH,
+    LIGHT_BRANCH
+};
+
+//What one light gives a shading point before its shadow ray is traced: the light that reaches it if nothing is in the
+//way (colour times |cos|) and its specular highlight, which shadows don't block
+struct LightContribution {
+    Ray shadowRay;
+    float shadowLength;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+static LightContribution lightContribution(Light *light, Ray &ray, const Material &material, const vec3 &hitPoint,
+                                           const vec3 &normal, const vec3 &shadowOrigin) {
+    LightContribution contribution;
+    vec3 lightDirection = light->getDirection(hitPoint);
+
+    float lightDistance = lengthSquared(lightDirection);
+    lightDirection = normalize(lightDirection);
+
+    //float lightDotNormal = std::max(0.0f,dot(lightDirection,normal));
+    float lightDotNormal = abs(dot(lightDirection,normal));
+
+    contribution.shadowRay = Ray(shadowOrigin,lightDirection);
+    contribution.shadowRay.visibilityMask = CASTS_SHADOWS;
+    contribution.shadowLength = RayTracer::shadowRayLength(lightDistance);
+
+    vec3 reflectionDirection = reflect(-lightDirection,normal);
+    contribution.diffuse = light->getColor() * lightDotNormal;
+    contribution.specular = powf(std::max(0.f, -dot(reflectionDirection,ray.getDirection())),material.specularExponent) * light->getColor();
+    return contribution;
+}
+
+//Calls visit(light, weight) for every light a shading point gets: all of them, or (lightSamples of them) picked from
+//the light tree with replacement, each weighted by 1 / (lightSamples * its probability) so on average they add up to
+//every light. Directional lights aren't in the tree and always get visited.
+template<typename Visit>
+static void visitLights(int lightSamples, Ray &ray, const vec3 &hitPoint, const vec3 &normal,
+                        const RenderContext &context, Visit visit) {
+    const vector<Light*> &lights = context.lights;
+    const LightTree &lightTree = context.lightTree;
+    if(lightSamples == 0 || lightSamples >= lightTree.lightCount()){
+        for (size_t i = 0; i < lights.size(); ++i) {
+            visit(lights[i], 1.0f);
+        }
+        return;
+    }
+    for (size_t i = 0; i < lightTree.unboundedLights.size(); ++i) {
+        visit(lights[lightTree.unboundedLights[i]], 1.0f);
+    }
+    for (int i = 0; i < lightSamples; ++i) {
+        float probability;
+        int light = lightTree.sample(hitPoint, normal, bounceSeed(ray.sampleSeed, LIGHT_BRANCH + i), probability);
+        if(light < 0){
+            break;
+        }
+        visit(lights[light], 1 / (probability * (float)lightSamples));
+    }
+}
+
+const int RayTracer::tileSize;
+const int RayTracer::adaptiveBatch;
+const int RayTracer::maxPendingRays;
+atomic<bool> RayTracer::stopRequested(false);
+
+RayTracer::RayTracer(int samples, int width, int height, int maxDepth, Scene &scene,int threading) {
     this->samples = samples;
     this->width = width;
     this->height = height;
     this->maxDepth = maxDepth;
     this->backgroundColor = scene.getBackground();
-    this->scene = scene;
+    this->scene = &scene;
     this->threading = threading;
 }
 
+// The image is split into tiles which the thread pool hands out to its workers.
+// Every tile renders straight into the image. The image is stored in 8x8 blocks that each fill whole cache lines and
+// the tiles are made of whole blocks, so no two threads ever write to the same cache line.
+// Each pixel only depends on the scene so the output is identical no matter how many threads are used.
 void RayTracer::cpuRender(ImageData *image, Camera camera) {
 
-    vector<Sphere> modelSpheres = scene.getSpheres();
-    vector<Mesh> modelMeshes = scene.getMeshes();
-    vector<Light*> lights = scene.getLights();
-    vector<Model*> modelSet;
-    for (int i = 0; i < modelSpheres.size(); ++i) {
-        modelSet.push_back(&modelSpheres[i]);
+    const RenderContext context(*scene, camera);
+    ThreadPool &threadPool = prepareRender(context);
+
+    int tilesX = (width + tileSize - 1) / tileSize;
+    int tilesY = (height + tileSize - 1) / tileSize;
+    int totalTiles = tilesX * tilesY;
+
+    atomic<int> tilesDone(0);
+    int lastPercent = -1;
+    mutex progressLock;
+    if(showProgress){
+        cout<<"\n\nBeginning CPU-Based Render ("<<threadPool.getThreadCount()<<" threads):"<<endl;
+    }
+    atomic<long long> samplesTaken(0);
+    threadPool.parallelFor(totalTiles, [&](int tileIndex, int workerIndex) {
+        samplesTaken += renderTile(tileIndex, image, context, workerIndex);
+
+        int currentPercent = (int)ceil(((float)(tilesDone.fetch_add(1) + 1) / (float)totalTiles) * 100);
+        if(!showProgress){
+            return;
+        }
+        lock_guard<mutex> lock(progressLock);
+        if(currentPercent > lastPercent){
+            cout<<"Percent done: "<<currentPercent<<"%"<<endl;
+            lastPercent = currentPercent;
+        }
+    });
+
+    sampleCount = samplesTaken;
+    if(showProgress){
+        cout<<"Average samples per pixel: "<<(double)sampleCount / ((double)width * height)
+            <<" (at most "<<samples * samples<<")"<<endl;
     }
-    for (int j = 0; j < modelMeshes.size(); ++j) {
-        modelSet.push_back(&modelMeshes[j]);
+}
+
+// Streaming: the tiles of one band render straight into a band sized image, then a writer thread tonemaps and saves
+// it while the tiles of the next band render into the other one. Rendering a band only waits for the write from two
+// bands ago, which is long done by then unless the disk can't keep up.
+bool RayTracer::streamRender(ImageStream &output, Camera camera, int bandRows) {
+    const RenderContext context(*scene, camera);
+    ThreadPool &threadPool = prepareRender(context);
+
+    bandRows = std::max(tileSize, (bandRows + tileSize - 1) / tileSize * tileSize);
+    bandRows = std::min(bandRows, (height + tileSize - 1) / tileSize * tileSize);
+    int tilesX = (width + tileSize - 1) / tileSize;
+    int bandCount = (height + bandRows - 1) / bandRows;
+    ImageData bands[2] = {ImageData(width, bandRows), ImageData(width, bandRows)};
+    if(showProgress){
+        cout<<"\n\nBeginning streamed CPU-Based Render ("<<threadPool.getThreadCount()<<" threads, "<<bandCount
+            <<" bands of "<<bandRows<<" rows, "<<(double)(bands[0].getMemoryUsage() * 2) / (1024.0 * 1024.0)
+            <<" MB):"<<endl;
     }
-    int totalPixels = width * height;
-    int lastPercent = -1;
-    int currentPercent = -1;
-    cout<<"\n\nBeginning CPU-Based Render:"<<endl;
-    for (int x = 0; x < width; ++x) {
-        if(threading){
 
+    atomic<long long> samplesTaken(0);
+    future<bool> writing;
+    bool written = true;
+    for (int band = 0; band < bandCount; ++band) {
+        ImageData &image = bands[band % 2];
+        int startY = band * bandRows;
+        int endY = std::min(startY + bandRows, height);
+        image.setFirstRow(startY);
+        int firstTile = (startY / tileSize) * tilesX;
+        int bandTiles = ((endY - startY + tileSize - 1) / tileSize) * tilesX;
+        threadPool.parallelFor(bandTiles, [&](int tileIndex, int workerIndex) {
+            samplesTaken += renderTile(firstTile + tileIndex, &image, context, workerIndex);
+        });
+
+        if(writing.valid()){
+            written &= writing.get();
+        }
+        writing = async(launch::async, [&output, &image, startY, endY]() {
+            return output.writeBand(image, startY, endY);
+        });
+        if(showProgress){
+            cout<<"Percent done: "<<(int)ceil((float)(band + 1) / (float)bandCount * 100)<<"%"<<endl;
+        }
+    }
+    if(writing.valid()){
+        written &= writing.get();
+    }
+
+    sampleCount = samplesTaken;
+    if(showProgress){
+        cout<<"Average samples per pixel: "<<(double)sampleCount / ((double)width * height)
+            <<" (at most "<<samples * samples<<")"<<endl;
+    }
+    return written;
+}
+
+// Progressive rendering: every pass brings the pixels that still need samples up to the next sample count, so there's
+// a complete (if noisy) image after each one. The accumulated totals go into a checkpoint after every pass, a resumed
+// render redoes the pass it was stopped in only for the pixels that hadn't got to it yet. Every pixel takes its samples
+// in the same order as always so a render that got stopped and resumed ends up the same as one that ran straight through.
+bool RayTracer::progressiveRender(ImageData *image, Camera camera, const ProgressiveSettings &settings,
+                                  const function<void()> &afterPass) {
+    const RenderContext context(*scene, camera);
+    ThreadPool &threadPool = prepareRender(context);
+    auto start = chrono::steady_clock::now();
+    auto secondsSinceStart = [&]() {
+        return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    };
+    auto shouldStop = [&]() {
+        return stopRequested || (settings.timeBudget > 0 && secondsSinceStart() >= settings.timeBudget);
+    };
+
+    Checkpoint checkpoint;
+    if(settings.resume && !settings.checkpointPath.empty()){
+        Checkpoint saved;
+        if(!saved.load(settings.checkpointPath)){
+            cout<<"No checkpoint to resume at \""<<settings.checkpointPath<<"\", starting over"<<endl;
+        }
+        else if(saved.width != width || saved.height != height || saved.samples != samples || saved.maxDepth != maxDepth){
+            cout<<"The checkpoint at \""<<settings.checkpointPath<<"\" was made with a different size, sample count or "
+                  "depth, starting over"<<endl;
+        }
+        else if(saved.key != settings.key){
+            cout<<"The checkpoint at \""<<settings.checkpointPath<<"\" was made for a different scene, camera or render "
+                  "settings, starting over"<<endl;
+        }
+        else if(saved.finished){
+            //the image it finished with was written back then
+            cout<<"The checkpoint at \""<<settings.checkpointPath<<"\" is already finished ("<<saved.pass<<" passes, "
+                <<saved.seconds<<" s)"<<endl;
+            return true;
         }
         else{
-            for (int y = 0; y < height; ++y) {
-                vec3 pixel = superSample(x,y,modelSet,camera,lights);
-                image->storePixel(x, y, pixel);
+            checkpoint = saved;
+            cout<<"Resuming after pass "<<checkpoint.pass<<" ("<<checkpoint.seconds<<" s rendered so far)"<<endl;
+            restorePrimaryHits(checkpoint, context, threadPool);
+        }
+    }
+    if(checkpoint.pixels.empty()){
+        checkpoint.width = width;
+        checkpoint.height = height;
+        checkpoint.samples = samples;
+        checkpoint.maxDepth = maxDepth;
+        checkpoint.key = settings.key;
+        PixelSamples unsampled = PixelSamples();
+        unsampled.refine = true;
+        checkpoint.pixels.assign((size_t)width * height, unsampled);
+    }
+    double previousSeconds = checkpoint.seconds;
+
+    int tilesX = (width + tileSize - 1) / tileSize;
+    int tilesY = (height + tileSize - 1) / tileSize;
+    int totalTiles = tilesX * tilesY;
+    bool finished = false;
+    if(showProgress){
+        cout<<"\n\nBeginning progressive CPU-Based Render ("<<threadPool.getThreadCount()<<" threads):"<<endl;
+    }
+    while(!finished && !shouldStop()){
+        int passTarget = passSampleCount(checkpoint.pass);
+        atomic<bool> incomplete(false);
+        threadPool.parallelFor(totalTiles, [&](int tileIndex, int workerIndex) {
+            //tiles already going get finished, the rest wait for the next run
+            if(shouldStop()){
+                incomplete = true;
+                return;
             }
+            progressiveTile(tileIndex, passTarget, checkpoint.pixels.data(), context, workerIndex);
+        });
+        if(!incomplete){
+            finished = !updateRefine(checkpoint, checkpoint.pass == 0);
+            checkpoint.finished = finished;
+            checkpoint.pass++;
         }
-        currentPercent=(int)ceil(((float)(x*height)/(float)totalPixels)*100);
-        if(currentPercent!=lastPercent){
-            cout<<"Percent done: "<<currentPercent<<"%"<<endl;
-            lastPercent = currentPercent;
+        checkpoint.seconds = previousSeconds + secondsSinceStart();
+
+        sampleCount = 0;
+        int pixelsLeft = 0;
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                PixelSamples &pixel = checkpoint.pixels[(size_t)y * width + x];
+                sampleCount += pixel.count;
+                pixelsLeft += pixel.refine;
+                image->storeSamples(x, y, pixel.sum, (unsigned int)pixel.count);
+                storeVariance(x, y, pixel);
+            }
+        }
+        if(!settings.checkpointPath.empty() && !checkpoint.save(settings.checkpointPath)){
+            cout<<"Couldn't save the checkpoint to \""<<settings.checkpointPath<<"\""<<endl;
         }
+        if(showProgress){
+            cout<<"Pass "<<checkpoint.pass<<(incomplete ? " (stopped part way)" : "")<<": "
+                <<(double)sampleCount / ((double)width * height)<<" samples per pixel, "<<pixelsLeft
+                <<" pixels still going, "<<checkpoint.seconds<<" s"<<endl;
+        }
+        afterPass();
     }
+    return finished;
 }
 
+int RayTracer::passSampleCount(int pass) {
+    int maxSamples = samples * samples;
+    int target = std::min(adaptiveBatch, maxSamples);
+    for (int i = 0; i < pass; ++i) {
+        target = std::min(maxSamples, target + std::min(target, 16));
+    }
+    return target;
+}
 
+int RayTracer::progressiveTile(int tileIndex, int passTarget, PixelSamples *pixels, const RenderContext &context,
+                               int workerIndex) {
+    int tilesX = (width + tileSize - 1) / tileSize;
+    int startX = (tileIndex % tilesX) * tileSize;
+    int startY = (tileIndex / tilesX) * tileSize;
+    int endX = std::min(startX + tileSize, width);
+    int endY = std::min(startY + tileSize, height);
+    PixelSamples *tilePixels = pixels + (size_t)startY * width + startX;
 
-// following function thanks to what was provided alongside the assignment.
-// This function generates point on the image plane and starts a trace through them.
-// Grid supersampling is also implemented.
-vec3 RayTracer::superSample(int x, int y, vector<Model*> modelSet,Camera camera,vector<Light*> lights){
-    vec2 windowCoord;
-    vec3 color = backgroundColor;
-    for(int i = 0; i < samples; i++){
-        for(int j = 0; j < samples; j++){
-            windowCoord.x = (float) x + (float)i/(float)samples;
-            windowCoord.y = (float) y + (float)i/(float)samples;
-            vec2 screenCoord((((2.0f * (windowCoord.x)) / (float)width) - 1.0f),
-                             (1.0f - ((2.0f * (windowCoord.y)) / (float)height)));
+    //packets only work when every pixel needs the same samples, which is always the case for the first pass
+    int firstCount = tilePixels[0].count;
+    bool uniform = true;
+    for (int y = startY; y < endY; ++y) {
+        for (int x = startX; x < endX; ++x) {
+            PixelSamples &pixel = tilePixels[(y - startY) * width + (x - startX)];
+            uniform &= pixel.refine && pixel.count == firstCount;
+        }
+    }
+    if(uniform && firstCount < passTarget && packetSize > 1 && maxDepth >= 0 && !wavefront){
+        renderPackets(startX, startY, endX, endY, firstCount, passTarget - firstCount, tilePixels, width, context);
+        return (endX - startX) * (endY - startY) * (passTarget - firstCount);
+    }
+    WavefrontQueues *queues = wavefront ? &wavefrontQueues[workerIndex] : nullptr;
+    if(queues){
+        queues->reset();
+    }
+    int samplesTaken = 0;
+    for (int y = startY; y < endY; ++y) {
+        for (int x = startX; x < endX; ++x) {
+            PixelSamples &pixel = tilePixels[(y - startY) * width + (x - startX)];
+            if(pixel.refine && pixel.count < passTarget){
+                samplesTaken += passTarget - pixel.count;
+                if(queues){
+                    queues->addRun(x, y, pixel.count, passTarget - pixel.count, pixel);
+                }
+                else{
+                    addSamples(x, y, pixel.count, passTarget - pixel.count, pixel, context);
+                }
+            }
+        }
+    }
+    if(queues){
+        renderWavefront(*queues, context);
+    }
+    return samplesTaken;
+}
 
-            Ray ray = camera.generateRay(screenCoord);
-            color = color + castRay(ray, modelSet, lights, 0);
+//Same rules as renderTile's adaptive sampling but the contrast check after the first pass sees the whole image
+bool RayTracer::updateRefine(Checkpoint &checkpoint, bool firstPass) {
+    int maxSamples = samples * samples;
+    bool anyLeft = false;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            PixelSamples &pixel = checkpoint.pixels[(size_t)y * width + x];
+            if(!pixel.refine){
+                continue;
+            }
+            bool contrast = false;
+            if(firstPass){
+                float mean = pixel.luminanceSum / (float)pixel.count;
+                int neighbours[4][2] = {{x - 1, y}, {x + 1, y}, {x, y - 1}, {x, y + 1}};
+                for (int n = 0; n < 4; ++n) {
+                    int neighbourX = neighbours[n][0];
+                    int neighbourY = neighbours[n][1];
+                    if(neighbourX < 0 || neighbourX >= width || neighbourY < 0 || neighbourY >= height){
+                        continue;
+                    }
+                    PixelSamples &neighbour = checkpoint.pixels[(size_t)neighbourY * width + neighbourX];
+                    contrast |= fabsf(neighbour.luminanceSum / (float)neighbour.count - mean) > contrastThreshold;
+                }
+            }
+            pixel.refine = pixel.count < maxSamples
+                           && (!adaptive || contrast || pixel.standardError() > noiseThreshold);
+            anyLeft |= pixel.refine;
         }
     }
-    return color*(float)(1.0/float(samples*samples));;
+    return anyLeft;
 }
 
-//Function based heavily on: https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-overview/ray-tracing-rendering-technique-overview
-vec3 RayTracer::castRay(Ray ray, vector<Model*> modelSet, vector<Light*> lights, int depth){
-    vec3 hitColor = backgroundColor;
-    if(depth > maxDepth){
-        return hitColor;
+// Adaptive sampling: every pixel of the tile gets a first batch of samples, then the pixels that are still noisy or
+// look different from one of their neighbours in the tile keep getting more until they settle or hit samples*samples.
+// Flat walls stop after the first batch, edges, shadows and reflections get the rest. Which pixels get more only
+// depends on the tile so the image is still the same for any thread count.
+int RayTracer::renderTile(int tileIndex, ImageData *image, const RenderContext &context, int workerIndex) {
+    int tilesX = (width + tileSize - 1) / tileSize;
+    int startX = (tileIndex % tilesX) * tileSize;
+    int startY = (tileIndex / tilesX) * tileSize;
+    int endX = std::min(startX + tileSize, width);
+    int endY = std::min(startY + tileSize, height);
+    int maxSamples = samples * samples;
+    int firstSamples = adaptive ? std::min(adaptiveBatch, maxSamples) : maxSamples;
+
+    PixelSamples tileSamples[tileSize * tileSize];
+    for (int i = 0; i < tileSize * tileSize; ++i) {
+        tileSamples[i] = PixelSamples();
+    }
+    auto pixelAt = [&](int x, int y) -> PixelSamples & {
+        return tileSamples[(y - startY) * tileSize + (x - startX)];
+    };
+
+    WavefrontQueues *queues = wavefront ? &wavefrontQueues[workerIndex] : nullptr;
+    if(queues){
+        queues->reset();
+        for (int y = startY; y < endY; ++y) {
+            for (int x = startX; x < endX; ++x) {
+                queues->addRun(x, y, 0, firstSamples, pixelAt(x, y));
+            }
+        }
+        renderWavefront(*queues, context);
+    }
+    else if(packetSize > 1 && maxDepth >= 0){
+        renderPackets(startX, startY, endX, endY, 0, firstSamples, tileSamples, tileSize, context);
+    }
+    else{
+        for (int y = startY; y < endY; ++y) {
+            for (int x = startX; x < endX; ++x) {
+                addSamples(x, y, 0, firstSamples, pixelAt(x, y), context);
+            }
+        }
+    }
+    int samplesTaken = (endX - startX) * (endY - startY) * firstSamples;
+
+    if(firstSamples < maxSamples){
+        //the first batch can miss an edge completely (all of its samples on one side), comparing against the
+        //neighbours catches those
+        for (int y = startY; y < endY; ++y) {
+            for (int x = startX; x < endX; ++x) {
+                PixelSamples &pixel = pixelAt(x, y);
+                float mean = pixel.luminanceSum / (float)pixel.count;
+                bool contrast = false;
+                int neighbours[4][2] = {{x - 1, y}, {x + 1, y}, {x, y - 1}, {x, y + 1}};
+                for (int n = 0; n < 4; ++n) {
+                    int neighbourX = neighbours[n][0];
+                    int neighbourY = neighbours[n][1];
+                    if(neighbourX < startX || neighbourX >= endX || neighbourY < startY || neighbourY >= endY){
+                        continue;
+                    }
+                    PixelSamples &neighbour = pixelAt(neighbourX, neighbourY);
+                    contrast |= fabsf(neighbour.luminanceSum / (float)neighbour.count - mean) > contrastThreshold;
+                }
+                pixel.refine = contrast || pixel.standardError() > noiseThreshold;
+            }
+        }
+        bool refining = true;
+        while(refining){
+            refining = false;
+            if(queues){
+                queues->reset();
+            }
+            for (int y = startY; y < endY; ++y) {
+                for (int x = startX; x < endX; ++x) {
+                    PixelSamples &pixel = pixelAt(x, y);
+                    if(!pixel.refine){
+                        continue;
+                    }
+                    int count = std::min(adaptiveBatch, maxSamples - pixel.count);
+                    samplesTaken += count;
+                    if(queues){
+                        queues->addRun(x, y, pixel.count, count, pixel);
+                        continue;
+                    }
+                    addSamples(x, y, pixel.count, count, pixel, context);
+                    pixel.refine = pixel.count < maxSamples && pixel.standardError() > noiseThreshold;
+                    refining |= pixel.refine;
+                }
+            }
+            //every pixel still going gets its next batch in one go
+            if(queues){
+                renderWavefront(*queues, context);
+                for (size_t i = 0; i < queues->runs.size(); ++i) {
+                    PixelSamples &pixel = *queues->runs[i].pixel;
+                    pixel.refine = pixel.count < maxSamples && pixel.standardError() > noiseThreshold;
+                    refining |= pixel.refine;
+                }
+            }
+        }
+    }
+
+    for (int y = startY; y < endY; ++y) {
+        for (int x = startX; x < endX; ++x) {
+            PixelSamples &pixel = pixelAt(x, y);
+            image->storeSamples(x, y, pixel.sum, (unsigned int)pixel.count);
+            storeVariance(x, y, pixel);
+        }
+    }
+    return samplesTaken;
+}
+
+// Neighbouring primary rays go almost the same way so they're traced together, one packet per sample. Only the
+// visibility is shared, every ray is shaded (and bounces) on its own. Every pixel gets its samples in the same order
+// addSamples gives them so the pixels come out exactly the same.
+void RayTracer::renderPackets(int startX, int startY, int endX, int endY, int firstSample, int count,
+                              PixelSamples *tileSamples, int stride, const RenderContext &context) {
+    RayPacket packet;
+    int hitModels[RayPacket::maxRays];
+    for (int blockY = startY; blockY < endY; blockY += packetSize) {
+        for (int blockX = startX; blockX < endX; blockX += packetSize) {
+            int columns = std::min(packetSize, endX - blockX);
+            int rows = std::min(packetSize, endY - blockY);
+            for (int sample = firstSample; sample < firstSample + count; ++sample) {
+                makePrimaryPacket(packet, context.camera, blockX, blockY, columns, rows, sample);
+                tracePacket(packet, context, hitModels);
+                for (int k = 0; k < packet.rayCount; ++k) {
+                    int x = blockX + k % columns;
+                    int y = blockY + k / columns;
+                    PixelSamples &pixel = tileSamples[(y - startY) * stride + (x - startX)];
+                    if(hitModels[k] < 0){
+                        pixel.add(backgroundColor);
+                        continue;
+                    }
+                    Ray ray(packet.origin, packet.direction[k]);
+                    ray.sampleSeed = sampleSeed(x, y, sample);
+                    if(gBuffer){
+                        recordPrimaryHit(x, y, ray, hitModels[k], packet.tNear[k], packet.index[k], packet.uv[k],
+                                         context);
+                    }
+                    pixel.add(shade(ray, hitModels[k], packet.tNear[k], packet.index[k], packet.uv[k], context, 0));
+                }
+            }
+        }
+    }
+}
+
+void RayTracer::addSamples(int x, int y, int firstSample, int count, PixelSamples &pixel, const RenderContext &context) {
+    for (int sample = firstSample; sample < firstSample + count; ++sample) {
+        Ray ray = context.camera.generateRay(sampleCoord(x, y, sample));
+        ray.sampleSeed = sampleSeed(x, y, sample);
+        pixel.add(castPrimary(x, y, ray, context));
+    }
+}
+
+//The checkpoint only keeps the colours, so the G-buffer gets the primary hits of the samples the pixels already have
+//traced again. They're the same rays in the same order, so it ends up as if the render had never been stopped.
+void RayTracer::restorePrimaryHits(const Checkpoint &checkpoint, const RenderContext &context, ThreadPool &threadPool) {
+    if(!gBuffer || maxDepth < 0){
+        return;
+    }
+    threadPool.parallelFor(height, [&](int y, int) {
+        for (int x = 0; x < width; ++x) {
+            int count = checkpoint.pixels[(size_t)y * width + x].count;
+            for (int sample = 0; sample < count; ++sample) {
+                Ray ray = context.camera.generateRay(sampleCoord(x, y, sample));
+                ray.sampleSeed = sampleSeed(x, y, sample);
+                float tNear = ray.getTimeValueMax();
+                int index = 0;
+                int hitModel;
+                vec2 uv;
+                if(trace(ray,context,tNear,index,uv,hitModel)){
+                    recordPrimaryHit(x, y, ray, hitModel, tNear, index, uv, context);
+                }
+            }
+        }
+    });
+}
+
+void RayTracer::storeVariance(int x, int y, const PixelSamples &pixel) {
+    if(gBuffer){
+        gBuffer->setVariance(x, y, pixel.count > 1 ? square(pixel.standardError()) : -1.0f);
+    }
+}
+
+vec3 RayTracer::castPrimary(int x, int y, Ray &ray, const RenderContext &context) {
+    if(!gBuffer || maxDepth < 0){
+        return castRay(ray, context, 0);
     }
     float tNear = ray.getTimeValueMax();
     int index = 0;
-    Model *hitObject = nullptr;
+    int hitModel;
     vec2 uv;
-    if(trace(ray,modelSet,tNear,index,uv,&hitObject)){
-        //return vec3(1);
-        vec3 hitPoint = ray.calculate(tNear);
-        vec3 normal;
-        vec2 stCoords;
-        hitObject->getSurfaceProperties(hitPoint,ray,index,uv,normal,stCoords);
-        //vec3 tempHitPoint = hitPoint;
-        switch(hitObject->material.type){
-            case TRANSMITTANCE:
-                //vec3 reflection = computeReflection(ray,hitObject,hitPoint,stCoords,normal,index,modelSet,lights,uv);
-                hitColor = computeReflection(ray, hitObject, hitPoint, stCoords, normal, index, modelSet, lights,
-                                             uv, depth, false)
-                           + computeRefraction(ray, hitObject, hitPoint, stCoords, normal, index, modelSet, lights,
-                                               uv, depth, false);
-                break;
-
-            case REFLECTION:
-                hitColor = computeReflection(ray,hitObject,hitPoint,stCoords,normal,index,modelSet,lights,uv,depth,true);
-                break;
-
-            case PHONG:
-                hitColor = computeDiffuse(ray,hitObject,hitPoint,stCoords,normal,index,modelSet,lights,uv);
-                hitColor += hitObject->material.ambientColor;
-                break;
-
-            case LIGHT:
-                hitColor = hitObject->material.diffuseColor;
-                break;
-
-            case PBR:
-                hitColor = computeDiffuse(ray,hitObject,hitPoint,stCoords,normal,index,modelSet,lights,uv);
-                break;
-
-            default:
-                hitColor = computeDiffuse(ray,hitObject,hitPoint,stCoords,normal,index,modelSet,lights,uv);
-                break;
+    if(!trace(ray,context,tNear,index,uv,hitModel)){
+        return backgroundColor;
+    }
+    recordPrimaryHit(x, y, ray, hitModel, tNear, index, uv, context);
+    return shade(ray, hitModel, tNear, index, uv, context, 0);
+}
+
+//Mirrors and glass count as white (what the denoiser needs is where surfaces change, and they show what's around
+//them rather than a colour of their own)
+void RayTracer::recordPrimaryHit(int x, int y, Ray &ray, int hitModel, float tNear, int index, vec2 uv,
+                                 const RenderContext &context) {
+    int triangle = context.modelType(hitModel) == SPHERE_MODEL ? -1 : index;
+    vec3 hitPoint = ray.calculate(tNear);
+    vec3 normal;
+    vec2 stCoords;
+    context.getSurfaceProperties(hitModel,hitPoint,ray,index,uv,normal,stCoords);
+    if(dot(normal, ray.getDirection()) > 0){
+        normal = -normal;
+    }
+    const Material &material = context.getMaterial(hitModel);
+    vec3 albedo;
+    switch(material.type){
+        case TRANSMITTANCE:
+        case REFLECTION:
+            albedo = vec3(1);
+            break;
+        case LIGHT:
+            albedo = material.diffuseColor;
+            break;
+        default:
+            albedo = material.evalDiffuseColor(stCoords);
+            break;
+    }
+    gBuffer->addHit(x, y, tNear, normal, albedo, hitModel, material.type, triangle);
+}
+
+void RayTracer::makePrimaryPacket(RayPacket &packet, const Camera &camera, int startX, int startY, int columns, int rows,
+                                  int sample) {
+    for (int y = 0; y < rows; ++y) {
+        for (int x = 0; x < columns; ++x) {
+            Ray ray = camera.generateRay(sampleCoord(startX + x, startY + y, sample));
+            packet.origin = ray.getOrigin();
+            packet.direction[y * columns + x] = ray.getDirection();
+        }
+    }
+    packet.setup(columns, rows);
+}
+
+vec2 RayTracer::sampleCoord(int x, int y, int sample) {
+    vec2 offset = pixelSample(sampler, x, y, sample, samples);
+    vec2 windowCoord;
+    windowCoord.x = (float) x + offset.x;
+    windowCoord.y = (float) y + offset.y;
+    return vec2((((2.0f * (windowCoord.x)) / (float)width) - 1.0f),
+                (1.0f - ((2.0f * (windowCoord.y)) / (float)height)));
+}
+
+//Function based heavily on: https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-overview/ray-tracing-rendering-technique-overview
+vec3 RayTracer::castRay(Ray &ray, const RenderContext &context, int depth){
+    PendingRay pending[maxPendingRays];
+    pending[0] = {ray, depth, 1};
+    return traceBranches(pending, 1, context);
+}
+
+vec3 RayTracer::shade(Ray &ray, int hitModel, float tNear, int index, vec2 uv, const RenderContext &context, int depth) {
+    PendingRay pending[maxPendingRays];
+    int pendingCount = 0;
+    vec3 hitColor = shadeHit(ray, hitModel, tNear, index, uv, context, depth, 1, pending, pendingCount);
+    return hitColor + traceBranches(pending, pendingCount, context);
+}
+
+// The colour of a ray is what its hit gives plus kr times its reflection plus 1 - kr times its refraction, so the
+// whole tree adds up to every hit's own colour times the weights on the way to it. The branches are followed depth
+// first off a stack, the last one added (the reflection) first.
+vec3 RayTracer::traceBranches(PendingRay *pending, int pendingCount, const RenderContext &context) {
+    vec3 color = vec3(0);
+    while(pendingCount > 0){
+        PendingRay branch = pending[--pendingCount];
+        if(branch.depth > maxDepth){
+            color += branch.weight * backgroundColor;
+            continue;
+        }
+        float tNear = branch.ray.getTimeValueMax();
+        int index = 0;
+        int hitModel;
+        vec2 uv;
+        if(!trace(branch.ray,context,tNear,index,uv,hitModel)){
+            color += branch.weight * backgroundColor;
+            continue;
+        }
+        color += branch.weight * shadeHit(branch.ray, hitModel, tNear, index, uv, context, branch.depth, branch.weight,
+                                          pending, pendingCount);
+    }
+    return color;
+}
+
+vec3 RayTracer::shadeHit(Ray &ray, int hitModel, float tNear, int index, vec2 uv, const RenderContext &context,
+                         int depth, float weight, PendingRay *pending, int &pendingCount) {
+    vec3 hitColor = vec3(0);
+    vec3 hitPoint = ray.calculate(tNear);
+    vec3 normal;
+    vec2 stCoords;
+    context.getSurfaceProperties(hitModel,hitPoint,ray,index,uv,normal,stCoords);
+    const Material &material = context.getMaterial(hitModel);
+    Ray reflectedRay, refractedRay;
+    //vec3 tempHitPoint = hitPoint;
+    switch(material.type){
+        case TRANSMITTANCE: {
+            float reflected = computeReflection(ray, material, hitPoint, normal, reflectedRay);
+            float refracted = computeRefraction(ray, material, hitPoint, normal, refractedRay);
+            addBranch(refractedRay, depth + 1, weight * refracted, pending, pendingCount);
+            addBranch(reflectedRay, depth + 1, weight * reflected, pending, pendingCount);
+            break;
         }
+
+        case REFLECTION: {
+            float reflected = computeReflection(ray, material, hitPoint, normal, reflectedRay);
+            addBranch(reflectedRay, depth + 1, weight * reflected, pending, pendingCount);
+            break;
+        }
+
+        case PHONG:
+            hitColor = computeDiffuse(ray,material,hitPoint,stCoords,normal,index,context,uv);
+            hitColor += material.ambientColor;
+            break;
+
+        case LIGHT:
+            hitColor = material.diffuseColor;
+            break;
+
+        case PBR:
+            hitColor = computeDiffuse(ray,material,hitPoint,stCoords,normal,index,context,uv);
+            break;
+
+        default:
+            hitColor = computeDiffuse(ray,material,hitPoint,stCoords,normal,index,context,uv);
+            break;
     }
     return hitColor;
 }
 
+void RayTracer::addBranch(const Ray &ray, int depth, float weight, PendingRay *pending, int &pendingCount) {
+    if(!keepBranch(ray, weight) || pendingCount == maxPendingRays){
+        return;
+    }
+    pending[pendingCount++] = {ray, depth, weight};
+}
+
+bool RayTracer::keepBranch(const Ray &ray, float &weight) {
+    //total internal reflection leaves the refraction nothing at all
+    if(!(weight > 0)){
+        return false;
+    }
+    //a branch that survives the roulette stands in for the ones that didn't, weight / survival is branchThreshold
+    if(weight < branchThreshold){
+        if(!russianRoulette){
+            return false;
+        }
+        float survival = weight / branchThreshold;
+        if(hashFloat(0, bounceSeed(ray.sampleSeed, ROULETTE_BRANCH)) >= survival){
+            return false;
+        }
+        weight = branchThreshold;
+    }
+    return true;
+}
+
+// Wavefront rendering. Every stage runs over the whole queue before the next one starts, so the BVH gets walked by one
+// ray after another without shading in between and each material's shading runs as one tight loop. The colours
+// add up in a different order than a sample at a time so they can differ in the last bit or so.
+void RayTracer::renderWavefront(WavefrontQueues &queues, const RenderContext &context) {
+    queues.rays.clear();
+    queues.nextRays.clear();
+    //the two queues swap every wave, giving both room for the biggest wave so far means a warmed up worker never
+    //has to grow one again
+    int capacity = std::max(queues.rays.capacity(), queues.nextRays.capacity());
+    queues.rays.reserve(capacity);
+    queues.nextRays.reserve(capacity);
+    //generate
+    for (size_t i = 0; i < queues.runs.size(); ++i) {
+        const SampleRun &run = queues.runs[i];
+        for (int s = 0; s < run.count; ++s) {
+            int sample = run.firstSample + s;
+            Ray ray = context.camera.generateRay(sampleCoord(run.x, run.y, sample));
+            ray.sampleSeed = sampleSeed(run.x, run.y, sample);
+            queueRay(queues, ray, 0, 1, run.firstSlot + s);
+        }
+    }
+    swap(queues.rays, queues.nextRays);
+
+    bool primaryWave = true;
+    while(queues.rays.size() > 0){
+        queues.shadows.clear();
+        extendWave(queues, context);
+        //every sample got a primary ray (or none at all past maxDepth), in slot order
+        if(primaryWave && gBuffer){
+            RayQueue &rays = queues.rays;
+            for (size_t i = 0; i < queues.runs.size(); ++i) {
+                const SampleRun &run = queues.runs[i];
+                for (int slot = run.firstSlot; slot < run.firstSlot + run.count; ++slot) {
+                    if(rays.hitModels[slot] >= 0){
+                        Ray ray = rays.getRay(slot);
+                        recordPrimaryHit(run.x, run.y, ray, rays.hitModels[slot], rays.tNear[slot],
+                                         rays.indices[slot], rays.uvs[slot], context);
+                    }
+                }
+            }
+        }
+        primaryWave = false;
+        queues.sortByMaterial(context);
+        for (int type = 0; type < materialTypeCount; ++type) {
+            int first = queues.typeStart[type];
+            int last = queues.typeStart[type + 1];
+            if(first == last){
+                continue;
+            }
+            switch(type){
+                case TRANSMITTANCE:
+                    shadeReflectionHits(queues, first, last, true, context);
+                    break;
+                case REFLECTION:
+                    shadeReflectionHits(queues, first, last, false, context);
+                    break;
+                case PHONG:
+                    shadeDiffuseHits(queues, first, last, true, context);
+                    break;
+                case LIGHT:
+                    shadeLightHits(queues, first, last, context);
+                    break;
+                default:
+                    shadeDiffuseHits(queues, first, last, false, context);
+                    break;
+            }
+        }
+        traceShadows(queues, context);
+        swap(queues.rays, queues.nextRays);
+        queues.nextRays.clear();
+    }
+
+    for (size_t i = 0; i < queues.runs.size(); ++i) {
+        const SampleRun &run = queues.runs[i];
+        for (int s = 0; s < run.count; ++s) {
+            run.pixel->add(queues.sampleColors[run.firstSlot + s]);
+        }
+    }
+}
+
+void RayTracer::queueRay(WavefrontQueues &queues, const Ray &ray, int depth, float weight, int slot) {
+    if(depth > maxDepth){
+        queues.sampleColors[slot] += weight * backgroundColor;
+        return;
+    }
+    queues.nextRays.push(ray, depth, weight, slot);
+}
+
+void RayTracer::extendWave(WavefrontQueues &queues, const RenderContext &context) {
+    RayQueue &rays = queues.rays;
+    int count = rays.size();
+    rays.tNear.resize(count);
+    rays.hitModels.resize(count);
+    rays.indices.resize(count);
+    rays.uvs.resize(count);
+    int first = 0;
+    //the primary wave all starts at the camera, a run of samples of a row of pixels is coherent enough for packets
+    if(packetSize > 1 && count > 0 && rays.depths[0] == 0){
+        RayPacket packet;
+        int hitModels[RayPacket::maxRays];
+        for (; first < count; first += packet.rayCount) {
+            int packetRays = std::min(RayPacket::maxRays, count - first);
+            packet.origin = rays.origins[first];
+            for (int k = 0; k < packetRays; ++k) {
+                packet.direction[k] = rays.directions[first + k];
+            }
+            packet.setup(packetRays, 1);
+            tracePacket(packet, context, hitModels);
+            for (int k = 0; k < packetRays; ++k) {
+                int i = first + k;
+                rays.tNear[i] = packet.tNear[k];
+                rays.hitModels[i] = hitModels[k];
+                rays.indices[i] = packet.index[k];
+                rays.uvs[i] = packet.uv[k];
+            }
+        }
+    }
+    //a wave's rays all have the same depth
+    int depth = count > 0 ? rays.depths[0] : 0;
+    bool sorted = first < count && depth < 32 && (sortedDepths >> depth & 1);
+    if(sorted){
+        queues.sortRays(sceneBVH.getBounds());
+    }
+    for (int n = first; n < count; ++n) {
+        int i = sorted ? (int)(queues.rayKeys[n] & 0xffffffffu) : n;
+        Ray ray = rays.getRay(i);
+        float tNear = ray.getTimeValueMax();
+        int index = 0;
+        int hitModel;
+        vec2 uv;
+        if(!trace(ray,context,tNear,index,uv,hitModel)){
+            hitModel = -1;
+        }
+        rays.tNear[i] = tNear;
+        rays.hitModels[i] = hitModel;
+        rays.indices[i] = index;
+        rays.uvs[i] = uv;
+    }
+    //in queue order whatever order they were traced in, so the colours add up the same
+    for (int i = 0; i < count; ++i) {
+        if(rays.hitModels[i] < 0){
+            queues.sampleColors[rays.slots[i]] += rays.weights[i] * backgroundColor;
+        }
+    }
+    queues.raysTraced += count;
+}
+
+//the ray, hit point and surface of queued hit i
+static void queuedSurface(const RayQueue &rays, int i, const RenderContext &context, Ray &ray, vec3 &hitPoint,
+                          vec3 &normal, vec2 &stCoords) {
+    ray = rays.getRay(i);
+    hitPoint = ray.calculate(rays.tNear[i]);
+    int index = rays.indices[i];
+    vec2 uv = rays.uvs[i];
+    context.getSurfaceProperties(rays.hitModels[i],hitPoint,ray,index,uv,normal,stCoords);
+}
+
+// Same as computeDiffuse (plus the ambient for PHONG), except the shadow rays are queued with the light they'd let
+// through instead of traced on the spot
+void RayTracer::shadeDiffuseHits(WavefrontQueues &queues, int first, int last, bool ambient,
+                                 const RenderContext &context) {
+    RayQueue &rays = queues.rays;
+    for (int k = first; k < last; ++k) {
+        int i = queues.order[k];
+        Ray ray;
+        vec3 hitPoint, normal;
+        vec2 stCoords;
+        queuedSurface(rays, i, context, ray, hitPoint, normal, stCoords);
+        const Material &material = context.getMaterial(rays.hitModels[i]);
+        float weight = rays.weights[i];
+        int slot = rays.slots[i];
+        vec3 diffuseColor = material.evalDiffuseColor(stCoords);
+        vec3 shadowOrigin = dot(ray.getDirection(),normal)?
+                            hitPoint + normal * biasValue :
+                            hitPoint - normal * biasValue;
+
+        vec3 specularColor = vec3(0);
+        visitLights(lightSamples, ray, hitPoint, normal, context, [&](Light *light, float lightWeight) {
+            LightContribution contribution = lightContribution(light, ray, material, hitPoint, normal, shadowOrigin);
+            queues.shadows.push(contribution.shadowRay, contribution.shadowLength,
+                                weight * ((lightWeight * contribution.diffuse) * diffuseColor), slot);
+            specularColor += lightWeight * contribution.specular;
+        });
+        vec3 hitColor = specularColor * material.specularColor;
+        if(ambient){
+            hitColor += material.ambientColor;
+        }
+        queues.sampleColors[slot] += weight * hitColor;
+    }
+}
+
+void RayTracer::shadeReflectionHits(WavefrontQueues &queues, int first, int last, bool refracts,
+                                    const RenderContext &context) {
+    RayQueue &rays = queues.rays;
+    for (int k = first; k < last; ++k) {
+        int i = queues.order[k];
+        Ray ray;
+        vec3 hitPoint, normal;
+        vec2 stCoords;
+        queuedSurface(rays, i, context, ray, hitPoint, normal, stCoords);
+        const Material &material = context.getMaterial(rays.hitModels[i]);
+        float weight = rays.weights[i];
+        int depth = rays.depths[i];
+        int slot = rays.slots[i];
+
+        Ray reflectedRay;
+        float reflected = weight * computeReflection(ray, material, hitPoint, normal, reflectedRay);
+        if(keepBranch(reflectedRay, reflected)){
+            queueRay(queues, reflectedRay, depth + 1, reflected, slot);
+        }
+        if(refracts){
+            Ray refractedRay;
+            float refracted = weight * computeRefraction(ray, material, hitPoint, normal, refractedRay);
+            if(keepBranch(refractedRay, refracted)){
+                queueRay(queues, refractedRay, depth + 1, refracted, slot);
+            }
+        }
+    }
+}
+
+void RayTracer::shadeLightHits(WavefrontQueues &queues, int first, int last, const RenderContext &context) {
+    RayQueue &rays = queues.rays;
+    for (int k = first; k < last; ++k) {
+        int i = queues.order[k];
+        queues.sampleColors[rays.slots[i]] += rays.weights[i] * context.getMaterial(rays.hitModels[i]).diffuseColor;
+    }
+}
+
+void RayTracer::traceShadows(WavefrontQueues &queues, const RenderContext &context) {
+    ShadowQueue &shadows = queues.shadows;
+    queues.raysTraced += shadows.size();
+    for (int i = 0; i < shadows.size(); ++i) {
+        Ray shadowRay(shadows.origins[i], shadows.directions[i]);
+        shadowRay.visibilityMask = CASTS_SHADOWS;
+        if(!occluded(shadowRay, shadows.lengths[i], context)){
+            queues.sampleColors[shadows.slots[i]] += shadows.contributions[i];
+        }
+    }
+}
+
+//A shadow ray is blocked by a hit at t if square(t) < distanceSquared. This gives the smallest t where that stops being
+//true, so "any hit in front of it" is exactly the same test without needing the closest hit.
+float RayTracer::shadowRayLength(float distanceSquared) {
+    if(!(distanceSquared < INFINITY)){
+        return RAY_T_MAX;
+    }
+    float t = sqrtf(distanceSquared);
+    while(square(t) < distanceSquared){
+        t = nextafterf(t, INFINITY);
+    }
+    while(t > 0 && square(nextafterf(t, 0)) >= distanceSquared){
+        t = nextafterf(t, 0);
+    }
+    return t;
+}
+
 //Function based on: https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-overview/ray-tracing-rendering-technique-overview
-vec3 RayTracer::computeDiffuse(Ray &ray, Model *hitObject, vec3 &hitPoint, vec2 &stCoords, vec3 &normal, int &index, vector<Model*> modelSet, vector<Light*> &lights, vec2 uv) {
+vec3 RayTracer::computeDiffuse(Ray &ray, const Material &material, vec3 &hitPoint, vec2 &stCoords, vec3 &normal, int &, const RenderContext &context, vec2) {
 
     vec3 lightAmount = vec3(0);
     vec3 specularColor = vec3(0);
@@ -134,45 +1001,32 @@ vec3 RayTracer::computeDiffuse(Ray &ray, Model *hitObject, vec3 &hitPoint, vec2
                         hitPoint + normal * biasValue :
                         hitPoint - normal * biasValue;
 
-    for (int i = 0; i < lights.size(); ++i) {
-        vec3 lightDirection = lights[i]->getDirection(hitPoint);
-
-        float lightDistance = lengthSquared(lightDirection);
-        lightDirection = normalize(lightDirection);
-
-        //float lightDotNormal = std::max(0.0f,dot(lightDirection,normal));
-        float lightDotNormal = abs(dot(lightDirection,normal));
-        Model *shadowHitObject = nullptr;
-        float tNearShadow = ray.getTimeValueMax();
-
-        Ray shadowRay(shadowOrigin,lightDirection);
-        shadowRay.isShadowRay = true;
-        bool inShadow = trace(shadowRay,modelSet,tNearShadow,index,uv,&shadowHitObject)
-                        && (square(tNearShadow) < lightDistance);
+    visitLights(lightSamples, ray, hitPoint, normal, context, [&](Light *light, float weight) {
+        LightContribution contribution = lightContribution(light, ray, material, hitPoint, normal, shadowOrigin);
+        bool inShadow = occluded(contribution.shadowRay, contribution.shadowLength, context);
         //return vec3(inShadow);
+        //a weight of 1 (every light) leaves both exactly as they were
+        lightAmount += weight * ((float)(1-inShadow) * contribution.diffuse);
+        specularColor += weight * contribution.specular;
+    });
 
-        lightAmount += (float)(1-inShadow) * lights[i]->getColor() * lightDotNormal;
-        vec3 reflectionDirection = reflect(-lightDirection,normal);
-        specularColor += powf(std::max(0.f, -dot(reflectionDirection,ray.getDirection())),hitObject->material.specularExponent) * lights[i]->getColor();
-    }
-
-    vec3 hitColor = ((lightAmount * hitObject->material.evalDiffuseColor(stCoords))
-                      + (specularColor * hitObject->material.specularColor));
+    vec3 hitColor = ((lightAmount * material.evalDiffuseColor(stCoords))
+                      + (specularColor * material.specularColor));
 
     return hitColor;
 }
 
 //Function heavily based on: https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-overview/ray-tracing-rendering-technique-overview
-vec3 RayTracer::computeReflection(Ray &ray, Model *hitObject, vec3 &hitPoint, vec2 &stCoords, vec3 &normal, int &index, vector<Model*> &modelSet, vector<Light*> &lights, vec2 &uv, int depth, bool direction) {
+float RayTracer::computeReflection(Ray &ray, const Material &material, vec3 &hitPoint, vec3 &normal, Ray &reflectedRay) {
 
     //kind of hacky, should be computed from fresnel but this could sort of work
-    float kr = hitObject->material.kr;
+    float kr = material.kr;
     if(kr<0){
-        kr = fresnel(ray,normal,hitObject->material.ior);
+        kr = fresnel(ray,normal,material.ior);
     }
 
     //float kr = 0.85;
-    //float kr = hitObject->material.indexRefraction;
+    //float kr = material.indexRefraction;
 
     vec3 reflectionRayDir = reflect(ray.getDirection(),normal);
 
@@ -180,58 +1034,225 @@ vec3 RayTracer::computeReflection(Ray &ray, Model *hitObject, vec3 &hitPoint, ve
     vec3 bias = normal * biasValue;
 
     vec3 reflectedRayOrigin = getNewRayOrigin(isOutside, hitPoint, bias);
-    Ray reflectedRay(reflectedRayOrigin,reflectionRayDir);
+    reflectedRay = Ray(reflectedRayOrigin,reflectionRayDir);
+    reflectedRay.visibilityMask = VISIBLE_TO_REFLECTIONS;
+    reflectedRay.sampleSeed = bounceSeed(ray.sampleSeed, REFLECTION_BRANCH);
 
-    return kr * castRay(reflectedRay,modelSet,lights,depth+1); //reflected color
+    return kr; //share of the reflected color
 }
 
 //Function heavily based on: https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-overview/ray-tracing-rendering-technique-overview
-vec3 RayTracer::computeRefraction(Ray &ray, Model *hitObject, vec3 &hitPoint, vec2 &stCoords, vec3 &normal, int &index,vector<Model *> &modelSet, vector<Light *> &lights, vec2 &uv, int depth, bool direction) {
+float RayTracer::computeRefraction(Ray &ray, const Material &material, vec3 &hitPoint, vec3 &normal, Ray &refractedRay) {
 
-    float kr = fresnel(ray, normal, hitObject->material.ior);
-    //float kr = hitObject->material.kr;
+    float kr = fresnel(ray, normal, material.ior);
+    //float kr = material.kr;
 
-    vec3 refractionRayDir = normalize(refractRay(ray.getDirection(), normal, hitObject->material.ior));
+    vec3 refractionRayDir = normalize(refractRay(ray.getDirection(), normal, material.ior));
 
     bool isOutside = dot(refractionRayDir, normal) < 0;
     vec3 bias = normal * biasValue;
 
     vec3 refractionRayOrigin = getNewRayOrigin(isOutside, hitPoint, bias);
 
-    Ray refractedRay(refractionRayOrigin,refractionRayDir);
+    refractedRay = Ray(refractionRayOrigin,refractionRayDir);
+    refractedRay.visibilityMask = VISIBLE_TO_REFLECTIONS;
+    refractedRay.sampleSeed = bounceSeed(ray.sampleSeed, REFRACTION_BRANCH);
+
+    return 1 - kr;
+}
 
-    return (1 - kr) * castRay(refractedRay,modelSet,lights,depth+1);
+void RayTracer::denoise(ImageData *image, const DenoiseSettings &settings) {
+    if(!gBuffer){
+        return;
+    }
+    if(!workers){
+        workers.reset(new ThreadPool(threading));
+    }
+    denoiser.denoise(*image, *gBuffer, *workers, settings);
 }
 
 void RayTracer::gpuRender(Scene scene,Camera camera) {
 
 }
 
+ThreadPool &RayTracer::prepareRender(const RenderContext &context) {
+    if(!sceneBVH.isBuilt() || sceneBVHModels != context.modelCount()){
+        buildSceneBVH(context);
+    }
+    else if(modelsMoved){
+        refitSceneBVH(context);
+    }
+    modelsMoved = false;
+    if(!workers){
+        workers.reset(new ThreadPool(threading));
+    }
+    if(wavefront && (int)wavefrontQueues.size() < workers->getThreadCount()){
+        wavefrontQueues.resize(workers->getThreadCount());
+    }
+    return *workers;
+}
+
+void RayTracer::buildSceneBVH(const RenderContext &context) {
+    vector<AABB> modelBounds;
+    for (int i = 0; i < context.modelCount(); ++i) {
+        modelBounds.push_back(context.getModel(i).getBounds());
+    }
+    sceneBVH.build(modelBounds);
+    sceneBVHModels = context.modelCount();
+    //with each leaf in model order its spheres come first, then meshes, then instances, so the type switch in the leaf
+    //loops takes the same branch several times in a row
+    for (size_t i = 0; i < sceneBVH.nodes.size(); ++i) {
+        const BVHNode &node = sceneBVH.nodes[i];
+        if(node.isLeaf()){
+            sort(sceneBVH.primitiveIndices.begin() + node.leftFirst,
+                 sceneBVH.primitiveIndices.begin() + node.leftFirst + node.count);
+        }
+    }
+}
+
+void RayTracer::refitSceneBVH(const RenderContext &context) {
+    vector<AABB> modelBounds;
+    for (int i = 0; i < context.modelCount(); ++i) {
+        modelBounds.push_back(context.getModel(i).getBounds());
+    }
+    sceneBVH.refit(modelBounds);
+}
+
+//Only the models whose bounds the ray passes through in front of the closest hit so far get tested
+bool RayTracer::trace(Ray &ray, const RenderContext &context, float &tNear, int &index, vec2 &uv, int &hitModel) {
+    if(!sceneBVH.isBuilt()){
+        return traceLinear(ray, context, tNear, index, uv, hitModel);
+    }
+    hitModel = -1;
+    sceneBVH.traverse(ray, tNear, [&](int first, int count, float &tClosest) {
+        bool hit = false;
+        for (int i = first; i < first + count; ++i) {
+            int model = sceneBVH.primitiveIndices[i];
+            if((context.visibilityMasks[model] & ray.visibilityMask) == 0){
+                continue;
+            }
+            //models only report hits strictly in front of tNearI, nudging it up lets exact ties through so they can be
+            //settled the same way the linear loop does (first model in the set wins)
+            float tNearI = nextafterf(tClosest, RAY_T_MAX);
+            int indexI;
+            vec2 uvI;
+            if(context.intersect(model,ray,tNearI,indexI,uvI) && (tNearI<tClosest || (tNearI==tClosest && model<hitModel))){
+                hitModel = model;
+                tClosest = tNearI;
+                index = indexI;
+                uv = uvI;
+                hit = true;
+            }
+        }
+        return hit;
+    });
+    return hitModel >= 0;
+}
+
+//Whole models outside the packet's frustum get skipped, the rest see the rays that reach their leaf of the scene BVH.
+//Ties between models are settled the same way trace settles them.
+void RayTracer::tracePacket(RayPacket &packet, const RenderContext &context, int *hitModels) {
+    float tClosest[RayPacket::maxRays];
+    int closestIndex[RayPacket::maxRays];
+    vec2 closestUV[RayPacket::maxRays];
+    for (int i = 0; i < packet.rayCount; ++i) {
+        hitModels[i] = -1;
+        tClosest[i] = packet.tNear[i];
+    }
+    if(!sceneBVH.isBuilt()){
+        for (int i = 0; i < packet.rayCount; ++i) {
+            Ray ray(packet.origin, packet.direction[i]);
+            packet.hit[i] = traceLinear(ray, context, packet.tNear[i], packet.index[i], packet.uv[i], hitModels[i]);
+        }
+        return;
+    }
+    sceneBVH.traversePacket(packet, [&](int first, int count, int firstRay, const bool *rayMask) {
+        bool hit = false;
+        for (int m = first; m < first + count; ++m) {
+            int model = sceneBVH.primitiveIndices[m];
+            if((context.visibilityMasks[model] & packet.visibilityMask) == 0){
+                continue;
+            }
+            for (int i = firstRay; i < packet.rayCount; ++i) {
+                packet.tNear[i] = nextafterf(tClosest[i], RAY_T_MAX);
+                packet.hit[i] = false;
+            }
+            context.intersectPacket(model, packet, firstRay, rayMask);
+            for (int i = firstRay; i < packet.rayCount; ++i) {
+                if(packet.hit[i] && (packet.tNear[i] < tClosest[i] || (packet.tNear[i] == tClosest[i] && model < hitModels[i]))){
+                    hitModels[i] = model;
+                    tClosest[i] = packet.tNear[i];
+                    closestIndex[i] = packet.index[i];
+                    closestUV[i] = packet.uv[i];
+                    hit = true;
+                }
+                //the traversal keeps culling against the closest hit
+                packet.tNear[i] = tClosest[i];
+            }
+        }
+        return hit;
+    });
+    for (int i = 0; i < packet.rayCount; ++i) {
+        packet.hit[i] = hitModels[i] >= 0;
+        if(packet.hit[i]){
+            packet.index[i] = closestIndex[i];
+            packet.uv[i] = closestUV[i];
+        }
+    }
+}
+
+//Shadow rays only need to know if something is in the way, so this skips finding the closest hit and
+//stops at the first model that blocks the ray
+bool RayTracer::occluded(Ray &ray, float tMax, const RenderContext &context) {
+    auto blocks = [&](int model) {
+        return (context.visibilityMasks[model] & ray.visibilityMask) != 0 && context.occluded(model, ray, tMax);
+    };
+    if(!sceneBVH.isBuilt()){
+        for (int i = 0; i < context.modelCount(); ++i) {
+            if(blocks(i)){
+                return true;
+            }
+        }
+        return false;
+    }
+    return sceneBVH.traverseAny(ray, tMax, [&](int first, int count) {
+        for (int i = first; i < first + count; ++i) {
+            if(blocks(sceneBVH.primitiveIndices[i])){
+                return true;
+            }
+        }
+        return false;
+    });
+}
+
 //Function based heavily on: https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-overview/ray-tracing-rendering-technique-overview
-bool RayTracer::trace(Ray &ray, vector<Model*> &modelSet, float &tNear, int &index, vec2 &uv, Model **hitObject) {
-    *hitObject = nullptr;
-    for (int i = 0; i < modelSet.size(); ++i) {
+bool RayTracer::traceLinear(Ray &ray, const RenderContext &context, float &tNear, int &index, vec2 &uv, int &hitModel) {
+    hitModel = -1;
+    for (int i = 0; i < context.modelCount(); ++i) {
+        if((context.visibilityMasks[i] & ray.visibilityMask) == 0){
+            continue;
+        }
         float tNearI = ray.getTimeValueMax();
         int indexI;
         vec2 uvI;
         //return true;
         //modelSet[i]->intersect(ray,tNearI,indexI,uvI);
-        if(modelSet[i]->intersect(ray,tNearI,indexI,uvI) && tNearI<tNear){
+        if(context.intersect(i,ray,tNearI,indexI,uvI) && tNearI<tNear){
             //cout<<"false"<<endl;
             //cout<<"i"<<endl;
-            *hitObject = modelSet[i];
+            hitModel = i;
             tNear = tNearI;
             index = indexI;
             uv = uvI;
         }
     }
 
-    return (*hitObject != nullptr);
+    return hitModel >= 0;
 }
 
 //Function heavily based on: (basically copy pasted)
 // https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-overview/ray-tracing-rendering-technique-overview
-float RayTracer::fresnel(Ray &ray, vec3 &normal, float &indexOfRefraction) {
+float RayTracer::fresnel(Ray &ray, vec3 &normal, float indexOfRefraction) {
     float kr = 0;
 
     float cosi = clampMyMath(-1, 1, dot(ray.getDirection(), normal));
@@ -257,7 +1278,7 @@ float RayTracer::fresnel(Ray &ray, vec3 &normal, float &indexOfRefraction) {
 
 //Function heavily based on: (basically copy pasted)
 // https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-overview/ray-tracing-rendering-technique-overview
-vec3 RayTracer::refractRay(vec3 rayDirection, vec3 &normal, float &ior){
+vec3 RayTracer::refractRay(vec3 rayDirection, vec3 &normal, float ior){
     float cosi = clampMyMath(-1, 1, dot(rayDirection, normal));
     float etai = 1, etat = ior;
     vec3 tempNormal = normal;
@@ -10,7 +10,40 @@
 #include "../Scene/Scene.h"
 #include "../Scene/Camera.h"
 #include "ImageData.h"
+#include "RenderContext.h"
 #include "../Scene/Shading/Light.h"
+#include "ThreadPool.h"
+#include "Sampler.h"
+#include "Checkpoint.h"
+#include "ImageStream.h"
+#include "Wavefront.h"
+#include "GBuffer.h"
+#include "Denoiser.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+//what progressiveRender stops on besides every pixel being done
+struct ProgressiveSettings {
+    //seconds of wall clock time this run gets, 0 for no limit
+    double timeBudget = 0;
+    //saved after every pass, empty for none
+    string checkpointPath;
+    //pick up from the checkpoint instead of starting over
+    bool resume = false;
+    //stands for the scene, camera and settings of the render (everything but the size, sample count and depth, which
+    //get checked on their own), a checkpoint saved with another key gets started over
+    uint64_t key = 0;
+};
+
+//a branch of the ray tree that still has to be traced: the ray, how many bounces in it starts and how much of what it
+//finds reaches the pixel (the kr and 1 - kr of every reflection and refraction on the way multiplied together)
+struct PendingRay {
+    Ray ray;
+    int depth;
+    float weight;
+};
 
 class RayTracer {
 private:
@@ -19,36 +52,298 @@ private:
     int maxDepth;
     vec3 backgroundColor;
     float biasValue = 1;
-    Scene scene;
-    bool threading;
+    //not owned, has to outlive the tracer
+    Scene *scene = nullptr;
+    int threading;
+    //a whole number of the image's 8x8 blocks so tiles never share a cache line
+    static const int tileSize = 32;
+    static_assert(tileSize % ImageData::blockSize == 0, "tiles have to cover whole framebuffer blocks");
+    //top level BVH over the bounds of every model in the model set, each model keeps its own BVH underneath
+    BVH sceneBVH;
+    //models sceneBVH was built over, -1 before it's built
+    int sceneBVHModels = -1;
+    //some models moved since sceneBVH was built, the next render refits it
+    bool modelsMoved = false;
+    //made by the first render and kept for the next ones (batch jobs)
+    unique_ptr<ThreadPool> workers;
+    bool showProgress = true;
+    //primary rays are traced in packetSize x packetSize blocks, 1 traces every ray on its own
+    int packetSize = 8;
+    //where in the pixel each sample goes (Sampler.h)
+    SamplerType sampler = STRATIFIED_SAMPLER;
+    //samples*samples is the most any pixel gets. Adaptive sampling starts every pixel on adaptiveBatch of them and only
+    //keeps going (adaptiveBatch at a time) while the pixel is noisy or stood out from a neighbour after the first batch
+    bool adaptive = true;
+    static const int adaptiveBatch = 4;
+    //largest standard error of a pixel's mean luminance that still counts as converged
+    float noiseThreshold = 0.003f;
+    //difference in mean luminance from a neighbour after the first batch that gets a pixel another look
+    float contrastThreshold = 0.02f;
+    //point lights each shading point samples from the context's light tree (with as many shadow rays), 0 or at least as
+    //many as the scene has goes through every light like it always did. Directional lights are always all evaluated.
+    int lightSamples = 0;
+    //Reflections and refractions that would add less than this much of themselves to the pixel are ended by russian
+    //roulette (kept with probability weight / branchThreshold and then weighted up to branchThreshold) or just dropped
+    //with roulette off. 0 traces every branch until maxDepth like the recursive tracer did.
+    float branchThreshold = 0.01f;
+    bool russianRoulette = true;
+    //render in waves (every sample of a tile one stage at a time, see Wavefront.h) instead of a sample at a time
+    bool wavefront = false;
+    //one set of queues a worker thread
+    vector<WavefrontQueues> wavefrontQueues;
+    //bit d set sorts the wave of depth d rays (d >= 1, reflections and refractions) by origin and direction before
+    //tracing them, see WavefrontQueues::sortRays
+    unsigned int sortedDepths = 0;
+    //most branches waiting at once. There's one for every refracting hit on the path being followed so it can only fill
+    //up past --depth 62, branches that don't fit are dropped
+    static const int maxPendingRays = 64;
+    //not owned, while set every primary hit of a render adds what it hit to it (see GBuffer.h)
+    GBuffer *gBuffer = nullptr;
+    Denoiser denoiser;
+    //primary samples taken by the last cpuRender (in the image for progressiveRender)
+    long long sampleCount = 0;
+    //set from a signal handler to make progressiveRender save and stop after the tiles already started
+    static atomic<bool> stopRequested;
+
+    //total samples every pixel that's still going has after the given pass of progressiveRender: the first batch,
+    //then doubling (but never more than 16 more at once so checkpoints keep coming) up to samples*samples
+    int passSampleCount(int pass);
+    //Traces the pending rays (and everything that branches off them) until none are left, returns their colours
+    //times their weights added up. Done with this explicit stack instead of recursion so the ray tree can be cut
+    //wherever a branch stops mattering.
+    vec3 traceBranches(PendingRay *pending, int pendingCount, const RenderContext &context);
+    //colour the hit gives on its own (unweighted), the reflection and refraction rays it makes are added to pending
+    vec3 shadeHit(Ray &ray, int hitModel, float tNear, int index, vec2 uv, const RenderContext &context, int depth,
+                  float weight, PendingRay *pending, int &pendingCount);
+    //adds a branch weight deep unless the threshold or roulette ends it
+    void addBranch(const Ray &ray, int depth, float weight, PendingRay *pending, int &pendingCount);
+    //false if the threshold or roulette ends a branch, otherwise the weight it goes on with
+    bool keepBranch(const Ray &ray, float &weight);
+
+    //Renders every sample run of the batch in waves: generate the primary rays, then until no rays are left extend
+    //them all to their closest hits, shade the hits sorted by material (queueing shadow rays and the next wave's
+    //reflections/refractions) and trace the shadow rays. Each sample gets the colour it would get a sample at a time.
+    void renderWavefront(WavefrontQueues &queues, const RenderContext &context);
+    //adds what a primary ray of pixel (x, y) hit to the G-buffer
+    void recordPrimaryHit(int x, int y, Ray &ray, int hitModel, float tNear, int index, vec2 uv,
+                          const RenderContext &context);
+    //fills the G-buffer (if there is one) with the primary hits of the samples a resumed checkpoint already has
+    void restorePrimaryHits(const Checkpoint &checkpoint, const RenderContext &context, ThreadPool &threadPool);
+    //how noisy the finished pixel is into the G-buffer if there is one
+    void storeVariance(int x, int y, const PixelSamples &pixel);
+    //castRay for a primary ray of pixel (x, y), also filling in the G-buffer if there is one
+    vec3 castPrimary(int x, int y, Ray &ray, const RenderContext &context);
+    //adds the ray to the next wave, or the background if it's already past maxDepth
+    void queueRay(WavefrontQueues &queues, const Ray &ray, int depth, float weight, int slot);
+    void extendWave(WavefrontQueues &queues, const RenderContext &context);
+    //hits sorted into order[first..last) all have the material type the function is for
+    void shadeDiffuseHits(WavefrontQueues &queues, int first, int last, bool ambient, const RenderContext &context);
+    void shadeReflectionHits(WavefrontQueues &queues, int first, int last, bool refracts, const RenderContext &context);
+    void shadeLightHits(WavefrontQueues &queues, int first, int last, const RenderContext &context);
+    void traceShadows(WavefrontQueues &queues, const RenderContext &context);
+    //brings the pixels of a tile that are still going up to passTarget samples, returns the samples it took
+    int progressiveTile(int tileIndex, int passTarget, PixelSamples *pixels, const RenderContext &context,
+                        int workerIndex);
+    //after a finished pass: which pixels need more, false once none do
+    bool updateRefine(Checkpoint &checkpoint, bool firstPass);
+    //builds the scene BVH unless the last render already did (for the same models, refitting it if they moved), starts
+    //the workers the first time
+    ThreadPool &prepareRender(const RenderContext &context);
 
 public:
     RayTracer() = default;
-    RayTracer(int samples,int width,int height,int maxDepth, Scene scene,bool threading);
+    //threading is the number of worker threads to render with, 0 uses every hardware thread
+    RayTracer(int samples,int width,int height,int maxDepth, Scene &scene,int threading);
 
 
     void cpuRender(ImageData *image, Camera camera);
+    //Renders bandRows rows at a time (rounded up to whole tiles) and hands each finished band to the output while the
+    //next one renders, so only two bands are ever in memory. Same pixels as cpuRender. False if a write failed.
+    bool streamRender(ImageStream &output, Camera camera, int bandRows);
+    //Renders in passes of more and more samples into an accumulation buffer, filling the image after each pass (then
+    //calling afterPass) and saving the checkpoint. Stops when every pixel is done, the time budget runs out or
+    //requestStop is called. Returns true if every pixel got everything it needed.
+    bool progressiveRender(ImageData *image, Camera camera, const ProgressiveSettings &settings,
+                           const function<void()> &afterPass);
+    //safe to call from a signal handler
+    static void requestStop() {
+        stopRequested = true;
+    }
+
+    static bool isStopRequested() {
+        return stopRequested;
+    }
+
+    //call after moving models around (with the same models in the scene) so the next render refits the scene BVH
+    void markModelsMoved() {
+        modelsMoved = true;
+    }
+
+    //for rendering another image of the same scene, the scene BVH and the threads are kept
+    void setRenderSettings(int samples, int width, int height, int maxDepth) {
+        this->samples = samples;
+        this->width = width;
+        this->height = height;
+        this->maxDepth = maxDepth;
+    }
     void gpuRender(Scene scene,Camera camera);
 
-    vec3 castRay(Ray ray, vector<Model*> modelSet, vector<Light*> lights, int depth);
+    void setShowProgress(bool value) {
+        showProgress = value;
+    }
+
+    //2, 4 or 8 trace primary rays in packets of that many squared, 1 turns packets off
+    void setPacketSize(int value) {
+        packetSize = std::max(1, std::min(value, 8));
+    }
+
+    int getPacketSize() {
+        return packetSize;
+    }
+
+    //false takes every sample on every pixel
+    void setAdaptive(bool value) {
+        adaptive = value;
+    }
+
+    void setNoiseThreshold(float value) {
+        noiseThreshold = value;
+    }
+
+    void setContrastThreshold(float value) {
+        contrastThreshold = value;
+    }
+
+    //true renders every tile in waves (Wavefront.h), same image as a sample at a time
+    void setWavefront(bool value) {
+        wavefront = value;
+    }
+
+    bool getWavefront() {
+        return wavefront;
+    }
+
+    void setSortedDepths(unsigned int depths) {
+        sortedDepths = depths & ~1u;
+    }
+
+    unsigned int getSortedDepths() {
+        return sortedDepths;
+    }
+
+    //rays extended plus shadow rays traced by the wavefront renderer so far, every worker together
+    long long getWavefrontRays() {
+        long long rays = 0;
+        for (size_t i = 0; i < wavefrontQueues.size(); ++i) {
+            rays += wavefrontQueues[i].raysTraced;
+        }
+        return rays;
+    }
+
+    //0 traces every reflection and refraction until maxDepth
+    void setBranchThreshold(float value) {
+        branchThreshold = std::max(0.0f, value);
+    }
+
+    //false drops branches under the threshold instead of playing russian roulette with them
+    void setRussianRoulette(bool value) {
+        russianRoulette = value;
+    }
+
+    //0 evaluates every light at every shading point
+    void setLightSamples(int value) {
+        lightSamples = std::max(0, value);
+    }
+
+    int getLightSamples() {
+        return lightSamples;
+    }
+
+    //has to be the size of the image the next renders go into, nullptr stops filling it in
+    void setGBuffer(GBuffer *buffer) {
+        gBuffer = buffer;
+    }
+
+    //Smooths the noise in a finished render guided by the G-buffer that was set during it (see Denoiser.h)
+    void denoise(ImageData *image, const DenoiseSettings &settings);
+
+    void setSampler(SamplerType type) {
+        sampler = type;
+    }
+
+    SamplerType getSampler() {
+        return sampler;
+    }
+
+    long long getSampleCount() {
+        return sampleCount;
+    }
+
+    int getTileSize() {
+        return tileSize;
+    }
+
+    //number of tiles renderTile takes for this image size
+    int getTileCount() {
+        return ((width + tileSize - 1) / tileSize) * ((height + tileSize - 1) / tileSize);
+    }
+
+    //returns the number of primary samples it took, workerIndex picks the wavefront queues
+    int renderTile(int tileIndex, ImageData *image, const RenderContext &context, int workerIndex = 0);
+
+    //samples firstSample..firstSample+count-1 of every pixel in the tile, traced in blocks of packetSize x packetSize
+    //pixel (x, y) adds to tileSamples[(y - startY) * stride + (x - startX)]
+    void renderPackets(int startX, int startY, int endX, int endY, int firstSample, int count, PixelSamples *tileSamples,
+                       int stride, const RenderContext &context);
+
+    //samples firstSample..firstSample+count-1 of one pixel, one ray at a time
+    void addSamples(int x, int y, int firstSample, int count, PixelSamples &pixel, const RenderContext &context);
+
+    //colour the ray (starting depth bounces in) brings back, with everything reflected and refracted along the way
+    vec3 castRay(Ray &ray, const RenderContext &context, int depth);
+
+    //colour of a ray that has already been traced to its closest hit on model hitModel of the context (with everything
+    //reflected and refracted off it)
+    vec3 shade(Ray &ray, int hitModel, float tNear, int index, vec2 uv, const RenderContext &context, int depth);
+
+    //point on the image plane for sample number sample of pixel (x, y), stratified over a samples x samples grid
+    vec2 sampleCoord(int x, int y, int sample);
+
+    //Fills the packet with sample number sample of every pixel in the columns x rows block starting at (startX, startY)
+    void makePrimaryPacket(RayPacket &packet, const Camera &camera, int startX, int startY, int columns, int rows, int sample);
+
+    //the context's models in its numbering, every leaf's models end up sorted by type
+    void buildSceneBVH(const RenderContext &context);
+    //new bounds for every model, same tree
+    void refitSceneBVH(const RenderContext &context);
 
-    //Color superSample(int x, int y);
+    BVH &getSceneBVH() {
+        return sceneBVH;
+    }
 
-    vec3 superSample(int x, int y, vector<Model*> modelSet, Camera camera,vector<Light*> lights);
+    //hitModel is the context's number for the model hit, -1 if the ray didn't hit anything
+    bool trace(Ray &ray, const RenderContext &context, float &tNear, int &index, vec2 &uv, int &hitModel);
+    //closest hit of every ray in the packet, the same hits trace gives them one at a time
+    void tracePacket(RayPacket &packet, const RenderContext &context, int *hitModels);
+    //length to give occluded for a light distanceSquared away so it agrees exactly with square(tNear) < distanceSquared
+    static float shadowRayLength(float distanceSquared);
 
-    bool trace(Ray &ray, vector<Model*> &modelSet, float &tNear, int &index, vec2 &uv, Model **hitObject);
+    //true if anything the ray can hit is in front of tMax, stops at the first thing it finds
+    bool occluded(Ray &ray, float tMax, const RenderContext &context);
+    //tests every model, used until the scene BVH has been built
+    bool traceLinear(Ray &ray, const RenderContext &context, float &tNear, int &index, vec2 &uv, int &hitModel);
 
-    vec3 computeDiffuse(Ray &ray, Model *hitObject, vec3 &tvec3, vec2 &stCoords, vec3 &normal, int &index, vector<Model *> modelSet, vector<Light*> &lights,vec2 uv);
+    vec3 computeDiffuse(Ray &ray, const Material &material, vec3 &tvec3, vec2 &stCoords, vec3 &normal, int &index, const RenderContext &context,vec2 uv);
 
-    vec3 computeReflection(Ray &ray, Model *hitObject, vec3 &hitPoint, vec2 &stCoords, vec3 &normal, int &index,
-                           vector<Model *> &modelSet, vector<Light *> &lights, vec2 &uv,int depth, bool isOutside);
+    //the ray reflected off the hit, returns how much of what it finds goes back along ray (kr)
+    float computeReflection(Ray &ray, const Material &material, vec3 &hitPoint, vec3 &normal, Ray &reflectedRay);
 
-    vec3 computeRefraction(Ray &ray, Model *hitObject, vec3 &hitPoint, vec2 &stCoords, vec3 &normal, int &index,
-                               vector<Model *> &modelSet, vector<Light *> &lights, vec2 &uv, int depth, bool isOutside);
+    //the ray refracted through the hit, returns how much of what it finds goes back along ray (1 - kr)
+    float computeRefraction(Ray &ray, const Material &material, vec3 &hitPoint, vec3 &normal, Ray &refractedRay);
 
-    float fresnel(Ray &ray, vec3 &normal, float &indexOfRefraction);
+    float fresnel(Ray &ray, vec3 &normal, float indexOfRefraction);
 
-    vec3 refractRay(vec3 rayDirection, vec3 &normal, float &ior);
+    vec3 refractRay(vec3 rayDirection, vec3 &normal, float ior);
 };
 
 
@@ -0,0 +1,24 @@
+//
+// Everything one render reads, shared read only by every worker thread
+//
+
+#include "RenderContext.h"
+
+RenderContext::RenderContext(Scene &scene, const Camera &camera) : materials(scene.getMaterials()),
+                                                                   lights(scene.getLights()), camera(camera) {
+    spheres = scene.getSpheres().data();
+    sphereCount = (int)scene.getSpheres().size();
+    meshes = scene.getMeshes().data();
+    meshCount = (int)scene.getMeshes().size();
+    instances = scene.getInstances().data();
+    instanceCount = (int)scene.getInstances().size();
+    sphereData.reserve(sphereCount);
+    for (int i = 0; i < sphereCount; ++i) {
+        sphereData.emplace_back(spheres[i].getCenter(), spheres[i].getRadius());
+    }
+    visibilityMasks.reserve(modelCount());
+    for (int i = 0; i < modelCount(); ++i) {
+        visibilityMasks.push_back(getModel(i).visibilityMask);
+    }
+    lightTree.build(lights);
+}
@@ -0,0 +1,127 @@
+//
+// Everything one render reads. cpuRender builds it once and every worker thread shares it read only, so tracing a ray
+// never copies the model or light lists (or the scene).
+//
+
+#ifndef ASSIGNMENT4_RENDERCONTEXT_H
+#define ASSIGNMENT4_RENDERCONTEXT_H
+
+#include "../Scene/Scene.h"
+#include "../Scene/Camera.h"
+#include "../Scene/Shading/LightTree.h"
+
+//which of the context's arrays a model lives in
+enum ModelType {
+    SPHERE_MODEL,
+    MESH_MODEL,
+    INSTANCE_MODEL
+};
+
+// Models are numbered the way the scene BVH sees them: every sphere, then every mesh, then every instance. Each type
+// sits in its own array so the calls below switch on the number and go straight to the concrete (final) class instead
+// of through Model's vtable, which also lets the sphere test inline into the leaf loop.
+struct RenderContext {
+    //point straight at the scene's own arrays
+    Sphere *spheres;
+    int sphereCount;
+    Mesh *meshes;
+    int meshCount;
+    Instance *instances;
+    int instanceCount;
+    //every sphere's center and radius packed together (16 bytes each) and every model's visibility mask, the leaf loops
+    //only need these so they don't have to pull whole model objects into the cache
+    vector<vec4> sphereData;
+    vector<unsigned int> visibilityMasks;
+    //models only store an index into this
+    const vector<Material> &materials;
+    vector<Light*> lights;
+    //every point light, for shading points that only sample a few of them (RayTracer::setLightSamples)
+    LightTree lightTree;
+    Camera camera;
+
+    RenderContext(Scene &scene, const Camera &camera);
+
+    //it's only ever passed around by const reference, a copy would just be a mistake
+    RenderContext(const RenderContext &) = delete;
+    RenderContext &operator=(const RenderContext &) = delete;
+
+    int modelCount() const {
+        return sphereCount + meshCount + instanceCount;
+    }
+
+    ModelType modelType(int model) const {
+        if(model < sphereCount){
+            return SPHERE_MODEL;
+        }
+        return model < sphereCount + meshCount ? MESH_MODEL : INSTANCE_MODEL;
+    }
+
+    //for the things that don't care about the type (like bounds)
+    Model &getModel(int model) const {
+        if(model < sphereCount){
+            return spheres[model];
+        }
+        model -= sphereCount;
+        if(model < meshCount){
+            return meshes[model];
+        }
+        return instances[model - meshCount];
+    }
+
+    const Material &getMaterial(int model) const {
+        return materials[getModel(model).materialIndex];
+    }
+
+    bool intersect(int model, Ray &ray, float &tNear, int &index, vec2 &uv) const {
+        if(model < sphereCount){
+            const vec4 &sphere = sphereData[model];
+            return Sphere::intersect(vec3(sphere), sphere.w, ray, tNear);
+        }
+        model -= sphereCount;
+        if(model < meshCount){
+            return meshes[model].intersect(ray, tNear, index, uv);
+        }
+        return instances[model - meshCount].intersect(ray, tNear, index, uv);
+    }
+
+    void intersectPacket(int model, RayPacket &packet, int firstRay, const bool *rayMask) const {
+        if(model < sphereCount){
+            spheres[model].intersectPacket(packet, firstRay, rayMask);
+            return;
+        }
+        model -= sphereCount;
+        if(model < meshCount){
+            meshes[model].intersectPacket(packet, firstRay, rayMask);
+            return;
+        }
+        instances[model - meshCount].intersectPacket(packet, firstRay, rayMask);
+    }
+
+    bool occluded(int model, Ray &ray, float tMax) const {
+        if(model < sphereCount){
+            const vec4 &sphere = sphereData[model];
+            return Sphere::intersect(vec3(sphere), sphere.w, ray, tMax);
+        }
+        model -= sphereCount;
+        if(model < meshCount){
+            return meshes[model].occluded(ray, tMax);
+        }
+        return instances[model - meshCount].occluded(ray, tMax);
+    }
+
+    void getSurfaceProperties(int model, vec3 &hitPoint, Ray &ray, int &index, vec2 &uv, vec3 &normal,
+                              vec2 &stCoords) const {
+        if(model < sphereCount){
+            spheres[model].getSurfaceProperties(hitPoint, ray, index, uv, normal, stCoords);
+            return;
+        }
+        model -= sphereCount;
+        if(model < meshCount){
+            meshes[model].getSurfaceProperties(hitPoint, ray, index, uv, normal, stCoords);
+            return;
+        }
+        instances[model - meshCount].getSurfaceProperties(hitPoint, ray, index, uv, normal, stCoords);
+    }
+};
+
+#endif //ASSIGNMENT4_RENDERCONTEXT_H
@@ -0,0 +1,188 @@
+//
+// Sample positions inside a pixel
+//
+
+#include "Sampler.h"
+#include "BlueNoise.h"
+
+#include <algorithm>
+#include <cmath>
+
+unsigned int pixelSeed(int x, int y) {
+    //murmur3's finalizer over the packed coordinates
+    unsigned int hash = (unsigned int)x * 0x9e3779b1u ^ (unsigned int)y * 0x85ebca77u;
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+unsigned int sampleSeed(int x, int y, int sample) {
+    return pixelSeed(x, y) ^ pixelSeed(sample, 0x2c1b3c6d);
+}
+
+unsigned int bounceSeed(unsigned int seed, unsigned int branch) {
+    return pixelSeed((int)seed, (int)(branch + 1));
+}
+
+//Function from: "Correlated Multi-Jittered Sampling" (Kensler 2013), listing 3
+unsigned int permuteIndex(unsigned int i, unsigned int length, unsigned int seed) {
+    unsigned int mask = length - 1;
+    mask |= mask >> 1;
+    mask |= mask >> 2;
+    mask |= mask >> 4;
+    mask |= mask >> 8;
+    mask |= mask >> 16;
+    //scrambles i within the next power of two and walks the cycle until it lands back inside 0..length-1
+    do {
+        i ^= seed;
+        i *= 0xe170893du;
+        i ^= seed >> 16;
+        i ^= (i & mask) >> 4;
+        i ^= seed >> 8;
+        i *= 0x0929eb3fu;
+        i ^= seed >> 23;
+        i ^= (i & mask) >> 1;
+        i *= 1 | seed >> 27;
+        i *= 0x6935fa69u;
+        i ^= (i & mask) >> 11;
+        i *= 0x74dcb303u;
+        i ^= (i & mask) >> 2;
+        i *= 0x9e501cc3u;
+        i ^= (i & mask) >> 2;
+        i *= 0xc860a3dfu;
+        i &= mask;
+        i ^= i >> 5;
+    } while (i >= length);
+    return (i + seed) % length;
+}
+
+//Function from: "Correlated Multi-Jittered Sampling" (Kensler 2013), listing 4
+float hashFloat(unsigned int i, unsigned int seed) {
+    i ^= seed;
+    i ^= i >> 17;
+    i ^= i >> 10;
+    i *= 0xb36534e5u;
+    i ^= i >> 12;
+    i ^= i >> 21;
+    i *= 0x93fc4795u;
+    i ^= 0xdf6e307fu;
+    i ^= i >> 17;
+    i *= 1 | seed >> 18;
+    return (float)i * (1.0f / 4294967808.0f);
+}
+
+vec2 stratifiedSample(unsigned int seed, int sample, int gridSize) {
+    //past the first gridSize * gridSize samples (progressive renders) every round of that many visits all the cells again
+    //in a new order
+    int cellCount = gridSize * gridSize;
+    unsigned int roundSeed = seed + (unsigned int)(sample / cellCount) * 0x9e3779b9u;
+    int cell = (int)permuteIndex((unsigned int)(sample % cellCount), (unsigned int)cellCount, roundSeed);
+    float jitterX = hashFloat((unsigned int)sample, seed * 0x68bc21ebu);
+    float jitterY = hashFloat((unsigned int)sample, seed * 0x02e5be93u);
+    return vec2(((float)(cell % gridSize) + jitterX) / (float)gridSize,
+                ((float)(cell / gridSize) + jitterY) / (float)gridSize);
+}
+
+static unsigned int reverseBits(unsigned int value) {
+    value = (value << 16) | (value >> 16);
+    value = ((value & 0x00ff00ffu) << 8) | ((value & 0xff00ff00u) >> 8);
+    value = ((value & 0x0f0f0f0fu) << 4) | ((value & 0xf0f0f0f0u) >> 4);
+    value = ((value & 0x33333333u) << 2) | ((value & 0xccccccccu) >> 2);
+    value = ((value & 0x55555555u) << 1) | ((value & 0xaaaaaaaau) >> 1);
+    return value;
+}
+
+//Function from: "Practical Hash-based Owen Scrambling" (Burley 2020), listing 2. Flipping a bit only ever depends on
+//the bits below it, which are the higher ones of the reversed value.
+static unsigned int laineKarrasPermutation(unsigned int value, unsigned int seed) {
+    value += seed;
+    value ^= value * 0x6c50b47cu;
+    value ^= value * 0xb82f1e52u;
+    value ^= value * 0xc7afe638u;
+    value ^= value * 0x8d22f6e6u;
+    return value;
+}
+
+static unsigned int owenScramble(unsigned int value, unsigned int seed) {
+    return reverseBits(laineKarrasPermutation(reverseBits(value), seed));
+}
+
+//second Sobol dimension, its direction numbers are v(k) = v(k - 1) ^ (v(k - 1) >> 1) starting at the top bit
+static unsigned int sobolSecond(unsigned int index) {
+    unsigned int result = 0;
+    for (unsigned int direction = 1u << 31; index != 0; index >>= 1, direction ^= direction >> 1) {
+        if(index & 1){
+            result ^= direction;
+        }
+    }
+    return result;
+}
+
+vec2 sobolSample(unsigned int seed, int sample) {
+    unsigned int index = owenScramble((unsigned int)sample, pixelSeed((int)seed, 0));
+    //the first dimension is the van der Corput sequence, the index's bits reversed
+    unsigned int x = owenScramble(reverseBits(index), pixelSeed((int)seed, 1));
+    unsigned int y = owenScramble(sobolSecond(index), pixelSeed((int)seed, 2));
+    //the top 24 bits, so rounding to a float can't give 1
+    return vec2((float)(x >> 8) * (1.0f / 16777216.0f), (float)(y >> 8) * (1.0f / 16777216.0f));
+}
+
+vec2 r2Sample(const vec2 &shift, int sample) {
+    //1 / g and 1 / g^2 for the plastic number g, in double so late samples don't lose their fraction
+    const double alphaX = 0.7548776662466927;
+    const double alphaY = 0.5698402909980532;
+    double x = (double)shift.x + alphaX * (double)sample;
+    double y = (double)shift.y + alphaY * (double)sample;
+    return vec2(std::min((float)(x - floor(x)), 0.99999994f), std::min((float)(y - floor(y)), 0.99999994f));
+}
+
+vec2 pixelSample(SamplerType type, int x, int y, int sample, int gridSize) {
+    switch(type){
+        case SOBOL_SAMPLER:
+            return sobolSample(pixelSeed(x, y), sample);
+        case R2_SAMPLER: {
+            unsigned int seed = pixelSeed(x, y);
+            return r2Sample(vec2(hashFloat(0, seed), hashFloat(1, seed)), sample);
+        }
+        case BLUE_NOISE_SAMPLER:
+            //neighbouring pixels start the sequence as far apart as they can
+            return r2Sample(blueNoise(x, y), sample);
+        default:
+            return stratifiedSample(pixelSeed(x, y), sample, gridSize);
+    }
+}
+
+bool parseSamplerType(const string &name, SamplerType &type) {
+    if(name == "stratified"){
+        type = STRATIFIED_SAMPLER;
+    }
+    else if(name == "sobol"){
+        type = SOBOL_SAMPLER;
+    }
+    else if(name == "r2"){
+        type = R2_SAMPLER;
+    }
+    else if(name == "bluenoise"){
+        type = BLUE_NOISE_SAMPLER;
+    }
+    else{
+        return false;
+    }
+    return true;
+}
+
+const char *samplerName(SamplerType type) {
+    switch(type){
+        case SOBOL_SAMPLER:
+            return "sobol";
+        case R2_SAMPLER:
+            return "r2";
+        case BLUE_NOISE_SAMPLER:
+            return "bluenoise";
+        default:
+            return "stratified";
+    }
+}
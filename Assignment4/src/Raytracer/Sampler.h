@@ -0,0 +1,63 @@
+//
+// Sample positions inside a pixel
+// Stratified: a pixel with an n x n grid visits its cells in its own random order, so the first k samples always land
+// in k different cells and each sample on its own is uniform over the pixel.
+// Sobol, R2 and blue noise are low discrepancy sequences, every prefix of them covers the pixel evenly without needing
+// to know the sample count up front. Each pixel scrambles (Sobol) or shifts (R2, blue noise) its own copy.
+// With all of them the adaptive sampler can stop a pixel after any number of samples without biasing it.
+// The order, jitter and scrambling come from hashes of the pixel so nothing is stored (bar the blue noise texture) and
+// every thread gets the same samples for the same pixel.
+//
+
+#ifndef ASSIGNMENT4_SAMPLER_H
+#define ASSIGNMENT4_SAMPLER_H
+
+#include <string>
+#include <glm/glm.hpp>
+
+using namespace std;
+using namespace glm;
+
+enum SamplerType {
+    STRATIFIED_SAMPLER,
+    SOBOL_SAMPLER,
+    R2_SAMPLER,
+    BLUE_NOISE_SAMPLER
+};
+
+static const int samplerTypeCount = BLUE_NOISE_SAMPLER + 1;
+
+//"stratified", "sobol", "r2" or "bluenoise"
+bool parseSamplerType(const string &name, SamplerType &type);
+const char *samplerName(SamplerType type);
+
+//seed for everything random about one pixel
+unsigned int pixelSeed(int x, int y);
+
+//where i goes in a random permutation of 0..length-1 picked by seed
+unsigned int permuteIndex(unsigned int i, unsigned int length, unsigned int seed);
+
+//random float in [0, 1) for i, a different sequence for every seed
+float hashFloat(unsigned int i, unsigned int seed);
+
+//seed for everything random about one sample of a pixel (and the rays that bounce off what it hits)
+unsigned int sampleSeed(int x, int y, int sample);
+
+//seed for a ray spawned from one with this seed, branch tells apart the rays spawned at the same hit
+unsigned int bounceSeed(unsigned int seed, unsigned int branch);
+
+//offset in [0, 1) x [0, 1) of sample number sample of a pixel split into gridSize x gridSize cells, any sample number
+//works (each run of gridSize * gridSize is stratified on its own)
+vec2 stratifiedSample(unsigned int seed, int sample, int gridSize);
+
+//The first two dimensions of the Sobol sequence with hashed Owen scrambling, both the points and their order
+//scrambled by seed. Based on: "Practical Hash-based Owen Scrambling" (Burley 2020)
+vec2 sobolSample(unsigned int seed, int sample);
+
+//Roberts' R2 sequence (the 2D golden ratio sequence) shifted by shift, wrapping around
+vec2 r2Sample(const vec2 &shift, int sample);
+
+//offset of sample number sample of pixel (x, y) from the sampler, gridSize only matters to the stratified one
+vec2 pixelSample(SamplerType type, int x, int y, int sample, int gridSize);
+
+#endif //ASSIGNMENT4_SAMPLER_H
@@ -0,0 +1,116 @@
+//
+// Work stealing thread pool used to render the image in parallel
+//
+
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(int threadCount) {
+    if(threadCount <= 0){
+        threadCount = hardwareThreads();
+    }
+    this->threadCount = threadCount;
+    //swapped in, the queues can't be moved
+    WorkerQueues(threadCount).swap(queues);
+    //worker 0 is whoever calls parallelFor so only the rest need their own thread
+    for (int i = 1; i < threadCount; ++i) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lock(jobMutex);
+        stopping = true;
+    }
+    jobStart.notify_all();
+    for (size_t i = 0; i < workers.size(); ++i) {
+        workers[i].join();
+    }
+}
+
+int ThreadPool::hardwareThreads() {
+    unsigned int hardware = thread::hardware_concurrency();
+    return hardware == 0 ? 1 : (int)hardware;
+}
+
+void ThreadPool::parallelFor(int taskCount, const function<void(int, int)> &task) {
+    if(taskCount <= 0){
+        return;
+    }
+    //hand every worker a contiguous block of tasks, stealing evens things out afterwards
+    for (int i = 0; i < threadCount; ++i) {
+        lock_guard<mutex> lock(queues[i].lock);
+        queues[i].tasks.clear();
+        int first = (int)(((long long)taskCount * i) / threadCount);
+        int last = (int)(((long long)taskCount * (i + 1)) / threadCount);
+        for (int taskIndex = first; taskIndex < last; ++taskIndex) {
+            queues[i].tasks.push_back(taskIndex);
+        }
+    }
+    {
+        lock_guard<mutex> lock(jobMutex);
+        currentTask = &task;
+        activeWorkers = threadCount - 1;
+        jobGeneration++;
+    }
+    jobStart.notify_all();
+
+    runWorker(0);
+
+    unique_lock<mutex> lock(jobMutex);
+    jobDone.wait(lock, [this] { return activeWorkers == 0; });
+    currentTask = nullptr;
+}
+
+void ThreadPool::workerLoop(int workerIndex) {
+    unsigned long long seenGeneration = 0;
+    while(true){
+        {
+            unique_lock<mutex> lock(jobMutex);
+            jobStart.wait(lock, [this, &seenGeneration] { return stopping || jobGeneration != seenGeneration; });
+            if(stopping){
+                return;
+            }
+            seenGeneration = jobGeneration;
+        }
+        runWorker(workerIndex);
+        {
+            lock_guard<mutex> lock(jobMutex);
+            activeWorkers--;
+            if(activeWorkers == 0){
+                jobDone.notify_all();
+            }
+        }
+    }
+}
+
+void ThreadPool::runWorker(int workerIndex) {
+    int taskIndex;
+    while(popTask(workerIndex, taskIndex) || stealTask(workerIndex, taskIndex)){
+        (*currentTask)(taskIndex, workerIndex);
+    }
+}
+
+bool ThreadPool::popTask(int workerIndex, int &taskIndex) {
+    WorkerQueue &queue = queues[workerIndex];
+    lock_guard<mutex> lock(queue.lock);
+    if(queue.tasks.empty()){
+        return false;
+    }
+    taskIndex = queue.tasks.front();
+    queue.tasks.pop_front();
+    return true;
+}
+
+bool ThreadPool::stealTask(int workerIndex, int &taskIndex) {
+    for (int i = 1; i < threadCount; ++i) {
+        WorkerQueue &victim = queues[(workerIndex + i) % threadCount];
+        lock_guard<mutex> lock(victim.lock);
+        if(!victim.tasks.empty()){
+            taskIndex = victim.tasks.back();
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,69 @@
+//
+// Work stealing thread pool used to render the image in parallel
+// Each worker owns a queue of task indices, works through it from the front
+// and steals from the back of the other workers' queues once it runs dry.
+//
+
+#ifndef ASSIGNMENT4_THREADPOOL_H
+#define ASSIGNMENT4_THREADPOOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <vector>
+#include <memory>
+
+#include "../AlignedAllocator.h"
+
+using namespace std;
+
+class ThreadPool {
+private:
+    //a cache line each so the queues of two workers never share one (C++11 new doesn't align past 16 bytes, hence the
+    //allocator)
+    struct alignas(64) WorkerQueue {
+        mutex lock;
+        deque<int> tasks;
+    };
+    typedef vector<WorkerQueue, AlignedAllocator<WorkerQueue, 64>> WorkerQueues;
+
+    int threadCount;
+    vector<thread> workers;
+    WorkerQueues queues;
+
+    mutex jobMutex;
+    condition_variable jobStart;
+    condition_variable jobDone;
+    const function<void(int, int)> *currentTask = nullptr;
+    unsigned long long jobGeneration = 0;
+    int activeWorkers = 0;
+    bool stopping = false;
+
+    void workerLoop(int workerIndex);
+    void runWorker(int workerIndex);
+    bool popTask(int workerIndex, int &taskIndex);
+    bool stealTask(int workerIndex, int &taskIndex);
+
+public:
+    //threadCount of 0 (or less) uses every hardware thread
+    explicit ThreadPool(int threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    //Runs task(taskIndex, workerIndex) for every taskIndex in [0, taskCount) and blocks until all are done.
+    //The calling thread takes part as worker 0.
+    void parallelFor(int taskCount, const function<void(int, int)> &task);
+
+    int getThreadCount() {
+        return threadCount;
+    }
+
+    static int hardwareThreads();
+};
+
+
+#endif //ASSIGNMENT4_THREADPOOL_H
@@ -0,0 +1,126 @@
+//
+// Ray queues for the wavefront (breadth first) renderer
+//
+
+#include "Wavefront.h"
+
+#include <algorithm>
+
+void RayQueue::clear() {
+    origins.clear();
+    directions.clear();
+    visibilityMasks.clear();
+    sampleSeeds.clear();
+    depths.clear();
+    weights.clear();
+    slots.clear();
+    tNear.clear();
+    hitModels.clear();
+    indices.clear();
+    uvs.clear();
+}
+
+void RayQueue::reserve(int count) {
+    origins.reserve(count);
+    directions.reserve(count);
+    visibilityMasks.reserve(count);
+    sampleSeeds.reserve(count);
+    depths.reserve(count);
+    weights.reserve(count);
+    slots.reserve(count);
+    tNear.reserve(count);
+    hitModels.reserve(count);
+    indices.reserve(count);
+    uvs.reserve(count);
+}
+
+void RayQueue::push(const Ray &ray, int depth, float weight, int slot) {
+    Ray copy = ray;
+    origins.push_back(copy.getOrigin());
+    directions.push_back(copy.getDirection());
+    visibilityMasks.push_back(ray.visibilityMask);
+    sampleSeeds.push_back(ray.sampleSeed);
+    depths.push_back(depth);
+    weights.push_back(weight);
+    slots.push_back(slot);
+}
+
+Ray RayQueue::getRay(int i) const {
+    Ray ray(origins[i], directions[i]);
+    ray.visibilityMask = visibilityMasks[i];
+    ray.sampleSeed = sampleSeeds[i];
+    return ray;
+}
+
+void ShadowQueue::clear() {
+    origins.clear();
+    directions.clear();
+    lengths.clear();
+    contributions.clear();
+    slots.clear();
+}
+
+void ShadowQueue::push(const Ray &ray, float length, const vec3 &contribution, int slot) {
+    Ray copy = ray;
+    origins.push_back(copy.getOrigin());
+    directions.push_back(copy.getDirection());
+    lengths.push_back(length);
+    contributions.push_back(contribution);
+    slots.push_back(slot);
+}
+
+int WavefrontQueues::addRun(int x, int y, int firstSample, int count, PixelSamples &pixel) {
+    int firstSlot = (int)sampleColors.size();
+    SampleRun run = {x, y, firstSample, count, firstSlot, &pixel};
+    runs.push_back(run);
+    sampleColors.resize(firstSlot + count, vec3(0));
+    return firstSlot + count;
+}
+
+//spreads the low 9 bits of value out to every third bit
+static unsigned int spreadBits(unsigned int value) {
+    value &= 0x1ff;
+    value = (value | value << 16) & 0x030000ff;
+    value = (value | value << 8) & 0x0300f00f;
+    value = (value | value << 4) & 0x030c30c3;
+    value = (value | value << 2) & 0x09249249;
+    return value;
+}
+
+void WavefrontQueues::sortRays(const AABB &sceneBounds) {
+    vec3 scale = 511.0f / max(sceneBounds.maximum - sceneBounds.minimum, vec3(1e-6f));
+    rayKeys.resize(rays.size());
+    for (int i = 0; i < rays.size(); ++i) {
+        vec3 cell = clamp((rays.origins[i] - sceneBounds.minimum) * scale, vec3(0), vec3(511));
+        unsigned int morton = spreadBits((unsigned int)cell.x) << 2 | spreadBits((unsigned int)cell.y) << 1
+                              | spreadBits((unsigned int)cell.z);
+        const vec3 &direction = rays.directions[i];
+        unsigned int octant = (direction.x < 0) << 2 | (direction.y < 0) << 1 | (direction.z < 0);
+        unsigned int key = octant << 27 | morton;
+        rayKeys[i] = (unsigned long long)key << 32 | (unsigned int)i;
+    }
+    sort(rayKeys.begin(), rayKeys.end());
+}
+
+void WavefrontQueues::sortByMaterial(const RenderContext &context) {
+    int counts[materialTypeCount] = {};
+    for (int i = 0; i < rays.size(); ++i) {
+        if(rays.hitModels[i] >= 0){
+            counts[context.getMaterial(rays.hitModels[i]).type]++;
+        }
+    }
+    typeStart[0] = 0;
+    for (int type = 0; type < materialTypeCount; ++type) {
+        typeStart[type + 1] = typeStart[type] + counts[type];
+    }
+    order.resize(typeStart[materialTypeCount]);
+    int next[materialTypeCount];
+    for (int type = 0; type < materialTypeCount; ++type) {
+        next[type] = typeStart[type];
+    }
+    for (int i = 0; i < rays.size(); ++i) {
+        if(rays.hitModels[i] >= 0){
+            order[next[context.getMaterial(rays.hitModels[i]).type]++] = i;
+        }
+    }
+}
@@ -0,0 +1,112 @@
+//
+// Ray queues for the wavefront (breadth first) renderer
+// Instead of following one sample all the way down before starting the next, every sample of a batch goes through one
+// stage at a time: the primary rays are generated, every ray in the queue is extended to its closest hit, the hits are
+// sorted by material and shaded a material at a time (queueing shadow rays and the reflections/refractions for the next
+// round), then every shadow ray is traced. Each queue keeps one array a field so a stage only reads the fields it needs.
+// Based on: "Megakernels Considered Harmful: Wavefront Path Tracing on GPUs" (Laine, Karras, Aila 2013)
+//
+
+#ifndef ASSIGNMENT4_WAVEFRONT_H
+#define ASSIGNMENT4_WAVEFRONT_H
+
+#include <vector>
+
+#include "Ray.h"
+#include "Checkpoint.h"
+#include "RenderContext.h"
+#include "../Scene/Acceleration/AABB.h"
+
+using namespace std;
+
+static const int materialTypeCount = PBR + 1;
+
+//samples firstSample..firstSample+count-1 of pixel (x, y), their colours end up in slots firstSlot.. of the batch and
+//are added to pixel in order once the batch is done
+struct SampleRun {
+    int x, y;
+    int firstSample;
+    int count;
+    int firstSlot;
+    PixelSamples *pixel;
+};
+
+//Rays waiting to be extended. slot is the pixel sample the ray's colour goes to and weight how much of it gets there.
+struct RayQueue {
+    vector<vec3> origins;
+    vector<vec3> directions;
+    vector<unsigned int> visibilityMasks;
+    vector<unsigned int> sampleSeeds;
+    vector<int> depths;
+    vector<float> weights;
+    vector<int> slots;
+    //closest hits, filled in by the extend stage (hitModels is -1 for a miss)
+    vector<float> tNear;
+    vector<int> hitModels;
+    vector<int> indices;
+    vector<vec2> uvs;
+
+    int size() const {
+        return (int)origins.size();
+    }
+
+    int capacity() const {
+        return (int)origins.capacity();
+    }
+
+    //keeps the memory for the next round
+    void clear();
+    void reserve(int count);
+    void push(const Ray &ray, int depth, float weight, int slot);
+    Ray getRay(int i) const;
+};
+
+//Shadow rays waiting to be traced, contribution is added to the slot's colour if nothing is in the way
+struct ShadowQueue {
+    vector<vec3> origins;
+    vector<vec3> directions;
+    vector<float> lengths;
+    vector<vec3> contributions;
+    vector<int> slots;
+
+    int size() const {
+        return (int)origins.size();
+    }
+
+    void clear();
+    void push(const Ray &ray, float length, const vec3 &contribution, int slot);
+};
+
+//Everything one worker needs to render a batch, kept between batches so a warmed up worker doesn't allocate
+struct WavefrontQueues {
+    vector<SampleRun> runs;
+    //one colour for every sample of the batch
+    vector<vec3> sampleColors;
+    RayQueue rays;
+    RayQueue nextRays;
+    ShadowQueue shadows;
+    //the hits in rays by material type, type t's are order[typeStart[t]]..order[typeStart[t + 1] - 1]
+    vector<int> order;
+    int typeStart[materialTypeCount + 1];
+    //sort key << 32 | index of every ray in rays, in the order sortRays wants them traced
+    vector<unsigned long long> rayKeys;
+    //rays extended and shadow rays traced since the queues were made
+    long long raysTraced = 0;
+
+    //empties the batch
+    void reset() {
+        runs.clear();
+        sampleColors.clear();
+    }
+
+    //runs samples of pixel, returns the number of samples in the batch so far
+    int addRun(int x, int y, int firstSample, int count, PixelSamples &pixel);
+    //counting sort of the hits in rays by their material's type, misses are left out
+    void sortByMaterial(const RenderContext &context);
+    //Orders the rays by direction octant, then by the Morton code of their origin's cell in a 512^3 grid over the
+    //scene, so rays traced one after the other start in the same part of the scene and go roughly the same way.
+    //Only the tracing order changes, the hits still go to each ray's place in the queue.
+    void sortRays(const AABB &sceneBounds);
+};
+
+#endif //ASSIGNMENT4_WAVEFRONT_H
@@ -0,0 +1,61 @@
+//
+// Axis aligned bounding box used by the acceleration structures
+//
+
+#ifndef ASSIGNMENT4_AABB_H
+#define ASSIGNMENT4_AABB_H
+
+#include <algorithm>
+
+#include "../../Raytracer/Ray.h"
+
+struct AABB {
+    vec3 minimum = vec3(RAY_T_MAX);
+    vec3 maximum = vec3(-RAY_T_MAX);
+
+    AABB() = default;
+    AABB(vec3 minimum, vec3 maximum) : minimum(minimum), maximum(maximum) {}
+
+    void grow(const vec3 &point) {
+        minimum = glm::min(minimum, point);
+        maximum = glm::max(maximum, point);
+    }
+
+    void grow(const AABB &box) {
+        minimum = glm::min(minimum, box.minimum);
+        maximum = glm::max(maximum, box.maximum);
+    }
+
+    vec3 center() const {
+        return (minimum + maximum) * 0.5f;
+    }
+
+    bool isEmpty() const {
+        return minimum.x > maximum.x;
+    }
+
+    //Half the surface area, the constant factor doesn't matter to the surface area heuristic
+    float halfArea() const {
+        if(isEmpty()){
+            return 0;
+        }
+        vec3 extent = maximum - minimum;
+        return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+    }
+
+    //Slab test, returns the distance the ray enters the box at or RAY_T_MAX if it misses or the box is past tMax
+    float intersect(const vec3 &origin, const vec3 &inverseDirection, float tMax) const {
+        vec3 t0 = (minimum - origin) * inverseDirection;
+        vec3 t1 = (maximum - origin) * inverseDirection;
+        vec3 tSmall = glm::min(t0, t1);
+        vec3 tBig = glm::max(t0, t1);
+        float tEnter = std::max(std::max(tSmall.x, tSmall.y), tSmall.z);
+        float tExit = std::min(std::min(tBig.x, tBig.y), tBig.z);
+        if(tExit < tEnter || tExit < 0 || tEnter > tMax){
+            return RAY_T_MAX;
+        }
+        return tEnter;
+    }
+};
+
+#endif //ASSIGNMENT4_AABB_H
@@ -0,0 +1,158 @@
+//
+// Bounding volume hierarchy built with the surface area heuristic (SAH)
+//
+
+#include "BVH.h"
+
+void BVH::clear() {
+    nodes.clear();
+    primitiveIndices.clear();
+}
+
+void BVH::build(const vector<AABB> &primitiveBounds) {
+    clear();
+    if(primitiveBounds.empty()){
+        return;
+    }
+    vector<vec3> centroids;
+    centroids.reserve(primitiveBounds.size());
+    for (size_t i = 0; i < primitiveBounds.size(); ++i) {
+        primitiveIndices.push_back((int)i);
+        centroids.push_back(primitiveBounds[i].center());
+    }
+    //a binary tree never needs more than 2n-1 nodes
+    nodes.reserve(primitiveBounds.size() * 2);
+
+    BVHNode root;
+    root.leftFirst = 0;
+    root.count = (int)primitiveBounds.size();
+    nodes.push_back(root);
+    updateNodeBounds(0, primitiveBounds);
+    subdivide(0, primitiveBounds, centroids, 1);
+    nodes.shrink_to_fit();
+}
+
+//children always come after their parent so going backwards reaches both of them before the parent
+void BVH::refit(const vector<AABB> &primitiveBounds) {
+    for (int i = (int)nodes.size() - 1; i >= 0; --i) {
+        BVHNode &node = nodes[i];
+        if(node.isLeaf()){
+            updateNodeBounds(i, primitiveBounds);
+        }
+        else{
+            node.bounds = nodes[node.leftFirst].bounds;
+            node.bounds.grow(nodes[node.leftFirst + 1].bounds);
+        }
+    }
+}
+
+void BVH::updateNodeBounds(int nodeIndex, const vector<AABB> &primitiveBounds) {
+    BVHNode &node = nodes[nodeIndex];
+    node.bounds = AABB();
+    for (int i = node.leftFirst; i < node.leftFirst + node.count; ++i) {
+        node.bounds.grow(primitiveBounds[primitiveIndices[i]]);
+    }
+}
+
+//Binned SAH split, the node stays a leaf when splitting it wouldn't be cheaper than testing all of its primitives
+void BVH::subdivide(int nodeIndex, const vector<AABB> &primitiveBounds, const vector<vec3> &centroids, int depth) {
+    BVHNode node = nodes[nodeIndex];
+    if(node.count <= 1 || depth >= maxDepth){
+        return;
+    }
+
+    AABB centroidBounds;
+    for (int i = node.leftFirst; i < node.leftFirst + node.count; ++i) {
+        centroidBounds.grow(centroids[primitiveIndices[i]]);
+    }
+
+    int bestAxis = -1;
+    int bestSplit = 0;
+    float bestCost = RAY_T_MAX;
+    for (int axis = 0; axis < 3; ++axis) {
+        float axisMin = centroidBounds.minimum[axis];
+        float axisMax = centroidBounds.maximum[axis];
+        if(axisMin == axisMax){
+            continue;
+        }
+        AABB binBounds[binCount];
+        int binPrimitives[binCount] = {0};
+        float scale = binCount / (axisMax - axisMin);
+        for (int i = node.leftFirst; i < node.leftFirst + node.count; ++i) {
+            int primitive = primitiveIndices[i];
+            int bin = std::min(binCount - 1, (int)((centroids[primitive][axis] - axisMin) * scale));
+            binPrimitives[bin]++;
+            binBounds[bin].grow(primitiveBounds[primitive]);
+        }
+
+        //sweep from both sides to get the cost of every split plane between the bins
+        float leftArea[binCount - 1], rightArea[binCount - 1];
+        int leftCount[binCount - 1], rightCount[binCount - 1];
+        AABB leftBox, rightBox;
+        int leftSum = 0, rightSum = 0;
+        for (int i = 0; i < binCount - 1; ++i) {
+            leftSum += binPrimitives[i];
+            leftCount[i] = leftSum;
+            leftBox.grow(binBounds[i]);
+            leftArea[i] = leftBox.halfArea();
+            rightSum += binPrimitives[binCount - 1 - i];
+            rightCount[binCount - 2 - i] = rightSum;
+            rightBox.grow(binBounds[binCount - 1 - i]);
+            rightArea[binCount - 2 - i] = rightBox.halfArea();
+        }
+        for (int i = 0; i < binCount - 1; ++i) {
+            if(leftCount[i] == 0 || rightCount[i] == 0){
+                continue;
+            }
+            float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+            if(cost < bestCost){
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = i;
+            }
+        }
+    }
+
+    //every centroid is in the same spot, nothing left to split
+    if(bestAxis == -1){
+        return;
+    }
+    //one traversal step costs about as much as one primitive test
+    float leafCost = node.count * node.bounds.halfArea();
+    float splitCost = node.bounds.halfArea() + bestCost;
+    if(splitCost >= leafCost && node.count <= maxLeafSize){
+        return;
+    }
+
+    float axisMin = centroidBounds.minimum[bestAxis];
+    float scale = binCount / (centroidBounds.maximum[bestAxis] - axisMin);
+    int i = node.leftFirst;
+    int j = node.leftFirst + node.count - 1;
+    while(i <= j){
+        int bin = std::min(binCount - 1, (int)((centroids[primitiveIndices[i]][bestAxis] - axisMin) * scale));
+        if(bin <= bestSplit){
+            i++;
+        }
+        else{
+            std::swap(primitiveIndices[i], primitiveIndices[j]);
+            j--;
+        }
+    }
+    int leftPrimitives = i - node.leftFirst;
+
+    int leftChild = (int)nodes.size();
+    BVHNode child;
+    child.leftFirst = node.leftFirst;
+    child.count = leftPrimitives;
+    nodes.push_back(child);
+    child.leftFirst = i;
+    child.count = node.count - leftPrimitives;
+    nodes.push_back(child);
+    nodes[nodeIndex].leftFirst = leftChild;
+    nodes[nodeIndex].count = 0;
+
+    updateNodeBounds(leftChild, primitiveBounds);
+    updateNodeBounds(leftChild + 1, primitiveBounds);
+    subdivide(leftChild, primitiveBounds, centroids, depth + 1);
+    subdivide(leftChild + 1, primitiveBounds, centroids, depth + 1);
+}
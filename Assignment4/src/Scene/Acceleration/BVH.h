@@ -0,0 +1,200 @@
+//
+// Bounding volume hierarchy built with the surface area heuristic (SAH)
+// Based on:
+//      https://www.pbr-book.org/3ed-2018/Primitives_and_Intersection_Acceleration/Bounding_Volume_Hierarchies
+//      https://jacco.ompf2.com/2022/04/13/how-to-build-a-bvh-part-1-basics/
+//
+
+#ifndef ASSIGNMENT4_BVH_H
+#define ASSIGNMENT4_BVH_H
+
+#include <vector>
+
+#include "AABB.h"
+#include "../../Raytracer/RayPacket.h"
+
+using namespace std;
+
+struct BVHNode {
+    AABB bounds;
+    //first child for interior nodes (the second one is always right after it), first primitive for leaves
+    int leftFirst;
+    //number of primitives, 0 for interior nodes
+    int count;
+
+    bool isLeaf() const {
+        return count > 0;
+    }
+};
+
+class BVH {
+private:
+    static const int binCount = 16;
+    static const int maxLeafSize = 8;
+    static const int maxDepth = 64;
+
+    void subdivide(int nodeIndex, const vector<AABB> &primitiveBounds, const vector<vec3> &centroids, int depth);
+    void updateNodeBounds(int nodeIndex, const vector<AABB> &primitiveBounds);
+
+public:
+    vector<BVHNode> nodes;
+    //primitives in leaf order, leaves point at ranges of this
+    vector<int> primitiveIndices;
+
+    BVH() = default;
+    ~BVH() = default;
+
+    void build(const vector<AABB> &primitiveBounds);
+    //Recomputes every node's bounds for primitives that moved, keeping the tree as it is. Much cheaper than build but
+    //the tree only stays good while things keep roughly the same neighbours (rigid motion, small deformations).
+    void refit(const vector<AABB> &primitiveBounds);
+    void clear();
+
+    bool isBuilt() const {
+        return !nodes.empty();
+    }
+
+    AABB getBounds() const {
+        return nodes.empty() ? AABB() : nodes[0].bounds;
+    }
+
+    //Walks the tree front to back calling leaf(firstPrimitive, primitiveCount, tNear) for every leaf the ray reaches
+    //before tNear. leaf returns true if it found a closer hit and lowered tNear, which culls the nodes behind it.
+    template<typename LeafFunction>
+    bool traverse(Ray &ray, float &tNear, LeafFunction leaf) const {
+        if(nodes.empty()){
+            return false;
+        }
+        vec3 origin = ray.getOrigin();
+        vec3 inverseDirection = 1.0f / ray.getDirection();
+        if(nodes[0].bounds.intersect(origin, inverseDirection, tNear) == RAY_T_MAX){
+            return false;
+        }
+
+        bool hit = false;
+        int stack[maxDepth];
+        float stackDistance[maxDepth];
+        int stackSize = 0;
+        int nodeIndex = 0;
+        while(true){
+            const BVHNode &node = nodes[nodeIndex];
+            if(node.isLeaf()){
+                hit |= leaf(node.leftFirst, node.count, tNear);
+            }
+            else{
+                int nearChild = node.leftFirst;
+                int farChild = node.leftFirst + 1;
+                float nearDistance = nodes[nearChild].bounds.intersect(origin, inverseDirection, tNear);
+                float farDistance = nodes[farChild].bounds.intersect(origin, inverseDirection, tNear);
+                if(farDistance < nearDistance){
+                    std::swap(nearChild, farChild);
+                    std::swap(nearDistance, farDistance);
+                }
+                if(nearDistance != RAY_T_MAX){
+                    if(farDistance != RAY_T_MAX){
+                        stack[stackSize] = farChild;
+                        stackDistance[stackSize] = farDistance;
+                        stackSize++;
+                    }
+                    nodeIndex = nearChild;
+                    continue;
+                }
+            }
+            //pop the next node that is still in front of the closest hit so far
+            bool found = false;
+            while(stackSize > 0){
+                stackSize--;
+                if(stackDistance[stackSize] <= tNear){
+                    nodeIndex = stack[stackSize];
+                    found = true;
+                    break;
+                }
+            }
+            if(!found){
+                return hit;
+            }
+        }
+    }
+
+    //Any hit version of traverse, calls leaf(firstPrimitive, primitiveCount) for leaves the ray reaches before tMax
+    //until one of them returns true. The order doesn't matter for these so there's no sorting by distance.
+    template<typename LeafFunction>
+    bool traverseAny(Ray &ray, float tMax, LeafFunction leaf) const {
+        if(nodes.empty()){
+            return false;
+        }
+        vec3 origin = ray.getOrigin();
+        vec3 inverseDirection = 1.0f / ray.getDirection();
+        int stack[maxDepth + 2];
+        int stackSize = 1;
+        stack[0] = 0;
+        while(stackSize > 0){
+            stackSize--;
+            const BVHNode &node = nodes[stack[stackSize]];
+            if(node.bounds.intersect(origin, inverseDirection, tMax) == RAY_T_MAX){
+                continue;
+            }
+            if(node.isLeaf()){
+                if(leaf(node.leftFirst, node.count)){
+                    return true;
+                }
+                continue;
+            }
+            stack[stackSize] = node.leftFirst + 1;
+            stack[stackSize + 1] = node.leftFirst;
+            stackSize += 2;
+        }
+        return false;
+    }
+
+    //Packet version of traverse, walks the tree once for every ray in the packet. A node is only entered if it's inside
+    //the packet's frustum and at least one ray reaches it before its own tNear. Leaves get
+    //leaf(firstPrimitive, primitiveCount, firstRay, rayMask) where rayMask[i] says if ray i reaches the leaf
+    //(it's false for every ray before firstRay), so each ray sees the same leaves it would on its own.
+    template<typename LeafFunction>
+    bool traversePacket(RayPacket &packet, LeafFunction leaf) const {
+        if(nodes.empty()){
+            return false;
+        }
+        bool hit = false;
+        bool rayMask[RayPacket::maxRays];
+        //pushing both children only ever grows the stack by one a level
+        int stack[maxDepth + 2];
+        int stackFirstRay[maxDepth + 2];
+        int stackSize = 1;
+        stack[0] = 0;
+        stackFirstRay[0] = 0;
+        while(stackSize > 0){
+            stackSize--;
+            const BVHNode &node = nodes[stack[stackSize]];
+            int firstRay = packet.firstHit(node.bounds, stackFirstRay[stackSize]);
+            if(firstRay == packet.rayCount){
+                continue;
+            }
+            if(node.isLeaf()){
+                for (int i = 0; i < packet.rayCount; ++i) {
+                    rayMask[i] = i == firstRay || (i > firstRay && node.bounds.intersect(packet.origin,
+                                         packet.inverseDirection[i], packet.tNear[i]) != RAY_T_MAX);
+                }
+                hit |= leaf(node.leftFirst, node.count, firstRay, rayMask);
+                continue;
+            }
+            //the child closer along the packet's average direction goes on top so it's visited first
+            int nearChild = node.leftFirst;
+            int farChild = node.leftFirst + 1;
+            if(dot(nodes[farChild].bounds.center() - packet.origin, packet.centerDirection)
+               < dot(nodes[nearChild].bounds.center() - packet.origin, packet.centerDirection)){
+                std::swap(nearChild, farChild);
+            }
+            stack[stackSize] = farChild;
+            stackFirstRay[stackSize] = firstRay;
+            stack[stackSize + 1] = nearChild;
+            stackFirstRay[stackSize + 1] = firstRay;
+            stackSize += 2;
+        }
+        return hit;
+    }
+};
+
+
+#endif //ASSIGNMENT4_BVH_H
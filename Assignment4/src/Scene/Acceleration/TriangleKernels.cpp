@@ -0,0 +1,313 @@
+//
+// Ray triangle intersection kernels that test one ray against several triangles at once
+// Every kernel does the same operations in the same order as mollerTrumbore (and the project is built with
+// floating point contraction off) so the results are bit for bit the same as the scalar test.
+//
+
+#include "TriangleKernels.h"
+
+#include <algorithm>
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SIMD_TARGET(isa)
+#else
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+void TriangleIntersectData::resize(int triangleCount) {
+    this->triangleCount = triangleCount;
+    for (int axis = 0; axis < 3; ++axis) {
+        v0[axis].assign(triangleCount + TRIANGLE_KERNEL_PADDING, 0.0f);
+        edge1[axis].assign(triangleCount + TRIANGLE_KERNEL_PADDING, 0.0f);
+        edge2[axis].assign(triangleCount + TRIANGLE_KERNEL_PADDING, 0.0f);
+    }
+}
+
+void TriangleIntersectData::setTriangle(int i, const vec3 &v0, const vec3 &edge1, const vec3 &edge2) {
+    for (int axis = 0; axis < 3; ++axis) {
+        this->v0[axis][i] = v0[axis];
+        this->edge1[axis][i] = edge1[axis];
+        this->edge2[axis][i] = edge2[axis];
+    }
+}
+
+//Goes through the lanes that passed in order, the same way the scalar loop would
+static inline bool keepClosest(unsigned int hitMask, int first, const float *t, const float *u, const float *v,
+                               float &tNear, vec2 &uv, int &index) {
+    bool hit = false;
+    while(hitMask != 0){
+        int lane = 0;
+        while(((hitMask >> lane) & 1u) == 0){
+            lane++;
+        }
+        hitMask &= hitMask - 1;
+        if(t[lane] < tNear){
+            tNear = t[lane];
+            uv = vec2(u[lane], v[lane]);
+            index = first + lane;
+            hit = true;
+        }
+    }
+    return hit;
+}
+
+static bool intersectScalar(const TriangleIntersectData &data, int first, int count, const vec3 &origin,
+                            const vec3 &direction, float &tNear, vec2 &uv, int &index) {
+    bool hit = false;
+    for (int i = first; i < first + count; ++i) {
+        vec3 v0(data.v0[0][i], data.v0[1][i], data.v0[2][i]);
+        vec3 v0v1_edge(data.edge1[0][i], data.edge1[1][i], data.edge1[2][i]);
+        vec3 v0v2_edge(data.edge2[0][i], data.edge2[1][i], data.edge2[2][i]);
+        float tNearTemp = tNear;
+        vec2 uvTemp;
+        if(mollerTrumbore(v0, v0v1_edge, v0v2_edge, origin, direction, tNearTemp, uvTemp) && tNearTemp < tNear){
+            tNear = tNearTemp;
+            uv = uvTemp;
+            index = i;
+            hit = true;
+        }
+    }
+    return hit;
+}
+
+SIMD_TARGET("sse4.1")
+static bool intersectSSE41(const TriangleIntersectData &data, int first, int count, const vec3 &origin,
+                           const vec3 &direction, float &tNear, vec2 &uv, int &index) {
+    const __m128 dx = _mm_set1_ps(direction.x), dy = _mm_set1_ps(direction.y), dz = _mm_set1_ps(direction.z);
+    const __m128 ox = _mm_set1_ps(origin.x), oy = _mm_set1_ps(origin.y), oz = _mm_set1_ps(origin.z);
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    const __m128 epsilon = _mm_set1_ps(kEpsilon), tMin = _mm_set1_ps(RAY_T_MIN);
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    bool hit = false;
+    for (int i = first; i < first + count; i += 4) {
+        __m128 e1x = _mm_loadu_ps(&data.edge1[0][i]), e1y = _mm_loadu_ps(&data.edge1[1][i]), e1z = _mm_loadu_ps(&data.edge1[2][i]);
+        __m128 e2x = _mm_loadu_ps(&data.edge2[0][i]), e2y = _mm_loadu_ps(&data.edge2[1][i]), e2z = _mm_loadu_ps(&data.edge2[2][i]);
+
+        //pVector = cross(direction, edge2), determinate = dot(edge1, pVector)
+        __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(e2y, dz));
+        __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(e2z, dx));
+        __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(e2x, dy));
+        __m128 determinate = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+        __m128 reject = _mm_cmplt_ps(_mm_andnot_ps(signMask, determinate), epsilon);
+        __m128 inverseDet = _mm_div_ps(one, determinate);
+
+        __m128 tx = _mm_sub_ps(ox, _mm_loadu_ps(&data.v0[0][i]));
+        __m128 ty = _mm_sub_ps(oy, _mm_loadu_ps(&data.v0[1][i]));
+        __m128 tz = _mm_sub_ps(oz, _mm_loadu_ps(&data.v0[2][i]));
+        __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), inverseDet);
+        reject = _mm_or_ps(reject, _mm_or_ps(_mm_cmplt_ps(u, zero), _mm_cmpgt_ps(u, one)));
+
+        //qVector = cross(tVector, edge1)
+        __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(e1y, tz));
+        __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(e1z, tx));
+        __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(e1x, ty));
+        __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inverseDet);
+        reject = _mm_or_ps(reject, _mm_or_ps(_mm_cmplt_ps(v, zero), _mm_cmpgt_ps(_mm_add_ps(u, v), one)));
+
+        __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inverseDet);
+        __m128 accept = _mm_andnot_ps(reject, _mm_and_ps(_mm_cmpgt_ps(t, tMin), _mm_cmplt_ps(t, _mm_set1_ps(tNear))));
+
+        unsigned int hitMask = (unsigned int)_mm_movemask_ps(accept);
+        int remaining = first + count - i;
+        if(remaining < 4){
+            hitMask &= (1u << remaining) - 1;
+        }
+        if(hitMask != 0){
+            alignas(16) float tLanes[4], uLanes[4], vLanes[4];
+            _mm_store_ps(tLanes, t);
+            _mm_store_ps(uLanes, u);
+            _mm_store_ps(vLanes, v);
+            hit |= keepClosest(hitMask, i, tLanes, uLanes, vLanes, tNear, uv, index);
+        }
+    }
+    return hit;
+}
+
+SIMD_TARGET("avx2")
+static bool intersectAVX2(const TriangleIntersectData &data, int first, int count, const vec3 &origin,
+                          const vec3 &direction, float &tNear, vec2 &uv, int &index) {
+    const __m256 dx = _mm256_set1_ps(direction.x), dy = _mm256_set1_ps(direction.y), dz = _mm256_set1_ps(direction.z);
+    const __m256 ox = _mm256_set1_ps(origin.x), oy = _mm256_set1_ps(origin.y), oz = _mm256_set1_ps(origin.z);
+    const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+    const __m256 epsilon = _mm256_set1_ps(kEpsilon), tMin = _mm256_set1_ps(RAY_T_MIN);
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    bool hit = false;
+    for (int i = first; i < first + count; i += 8) {
+        __m256 e1x = _mm256_loadu_ps(&data.edge1[0][i]), e1y = _mm256_loadu_ps(&data.edge1[1][i]), e1z = _mm256_loadu_ps(&data.edge1[2][i]);
+        __m256 e2x = _mm256_loadu_ps(&data.edge2[0][i]), e2y = _mm256_loadu_ps(&data.edge2[1][i]), e2z = _mm256_loadu_ps(&data.edge2[2][i]);
+
+        //pVector = cross(direction, edge2), determinate = dot(edge1, pVector)
+        __m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(e2y, dz));
+        __m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(e2z, dx));
+        __m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(e2x, dy));
+        __m256 determinate = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)), _mm256_mul_ps(e1z, pz));
+        __m256 reject = _mm256_cmp_ps(_mm256_andnot_ps(signMask, determinate), epsilon, _CMP_LT_OQ);
+        __m256 inverseDet = _mm256_div_ps(one, determinate);
+
+        __m256 tx = _mm256_sub_ps(ox, _mm256_loadu_ps(&data.v0[0][i]));
+        __m256 ty = _mm256_sub_ps(oy, _mm256_loadu_ps(&data.v0[1][i]));
+        __m256 tz = _mm256_sub_ps(oz, _mm256_loadu_ps(&data.v0[2][i]));
+        __m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tx, px), _mm256_mul_ps(ty, py)), _mm256_mul_ps(tz, pz)), inverseDet);
+        reject = _mm256_or_ps(reject, _mm256_or_ps(_mm256_cmp_ps(u, zero, _CMP_LT_OQ), _mm256_cmp_ps(u, one, _CMP_GT_OQ)));
+
+        //qVector = cross(tVector, edge1)
+        __m256 qx = _mm256_sub_ps(_mm256_mul_ps(ty, e1z), _mm256_mul_ps(e1y, tz));
+        __m256 qy = _mm256_sub_ps(_mm256_mul_ps(tz, e1x), _mm256_mul_ps(e1z, tx));
+        __m256 qz = _mm256_sub_ps(_mm256_mul_ps(tx, e1y), _mm256_mul_ps(e1x, ty));
+        __m256 v = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)), inverseDet);
+        reject = _mm256_or_ps(reject, _mm256_or_ps(_mm256_cmp_ps(v, zero, _CMP_LT_OQ), _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_GT_OQ)));
+
+        __m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)), inverseDet);
+        __m256 accept = _mm256_andnot_ps(reject, _mm256_and_ps(_mm256_cmp_ps(t, tMin, _CMP_GT_OQ),
+                                                               _mm256_cmp_ps(t, _mm256_set1_ps(tNear), _CMP_LT_OQ)));
+
+        unsigned int hitMask = (unsigned int)_mm256_movemask_ps(accept);
+        int remaining = first + count - i;
+        if(remaining < 8){
+            hitMask &= (1u << remaining) - 1;
+        }
+        if(hitMask != 0){
+            alignas(32) float tLanes[8], uLanes[8], vLanes[8];
+            _mm256_store_ps(tLanes, t);
+            _mm256_store_ps(uLanes, u);
+            _mm256_store_ps(vLanes, v);
+            hit |= keepClosest(hitMask, i, tLanes, uLanes, vLanes, tNear, uv, index);
+        }
+    }
+    return hit;
+}
+
+SIMD_TARGET("avx512f")
+static bool intersectAVX512(const TriangleIntersectData &data, int first, int count, const vec3 &origin,
+                            const vec3 &direction, float &tNear, vec2 &uv, int &index) {
+    //most BVH leaves hold 8 or fewer triangles, half empty 16 wide vectors lose to the 8 wide kernel there
+    if(count <= 8){
+        return intersectAVX2(data, first, count, origin, direction, tNear, uv, index);
+    }
+    const __m512 dx = _mm512_set1_ps(direction.x), dy = _mm512_set1_ps(direction.y), dz = _mm512_set1_ps(direction.z);
+    const __m512 ox = _mm512_set1_ps(origin.x), oy = _mm512_set1_ps(origin.y), oz = _mm512_set1_ps(origin.z);
+    const __m512 zero = _mm512_setzero_ps(), one = _mm512_set1_ps(1.0f);
+    const __m512 epsilon = _mm512_set1_ps(kEpsilon), tMin = _mm512_set1_ps(RAY_T_MIN);
+    bool hit = false;
+    for (int i = first; i < first + count; i += 16) {
+        __m512 e1x = _mm512_loadu_ps(&data.edge1[0][i]), e1y = _mm512_loadu_ps(&data.edge1[1][i]), e1z = _mm512_loadu_ps(&data.edge1[2][i]);
+        __m512 e2x = _mm512_loadu_ps(&data.edge2[0][i]), e2y = _mm512_loadu_ps(&data.edge2[1][i]), e2z = _mm512_loadu_ps(&data.edge2[2][i]);
+
+        //pVector = cross(direction, edge2), determinate = dot(edge1, pVector)
+        __m512 px = _mm512_sub_ps(_mm512_mul_ps(dy, e2z), _mm512_mul_ps(e2y, dz));
+        __m512 py = _mm512_sub_ps(_mm512_mul_ps(dz, e2x), _mm512_mul_ps(e2z, dx));
+        __m512 pz = _mm512_sub_ps(_mm512_mul_ps(dx, e2y), _mm512_mul_ps(e2x, dy));
+        __m512 determinate = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(e1x, px), _mm512_mul_ps(e1y, py)), _mm512_mul_ps(e1z, pz));
+        __mmask16 reject = _mm512_cmp_ps_mask(_mm512_abs_ps(determinate), epsilon, _CMP_LT_OQ);
+        __m512 inverseDet = _mm512_div_ps(one, determinate);
+
+        __m512 tx = _mm512_sub_ps(ox, _mm512_loadu_ps(&data.v0[0][i]));
+        __m512 ty = _mm512_sub_ps(oy, _mm512_loadu_ps(&data.v0[1][i]));
+        __m512 tz = _mm512_sub_ps(oz, _mm512_loadu_ps(&data.v0[2][i]));
+        __m512 u = _mm512_mul_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(tx, px), _mm512_mul_ps(ty, py)), _mm512_mul_ps(tz, pz)), inverseDet);
+        reject |= _mm512_cmp_ps_mask(u, zero, _CMP_LT_OQ) | _mm512_cmp_ps_mask(u, one, _CMP_GT_OQ);
+
+        //qVector = cross(tVector, edge1)
+        __m512 qx = _mm512_sub_ps(_mm512_mul_ps(ty, e1z), _mm512_mul_ps(e1y, tz));
+        __m512 qy = _mm512_sub_ps(_mm512_mul_ps(tz, e1x), _mm512_mul_ps(e1z, tx));
+        __m512 qz = _mm512_sub_ps(_mm512_mul_ps(tx, e1y), _mm512_mul_ps(e1x, ty));
+        __m512 v = _mm512_mul_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(dx, qx), _mm512_mul_ps(dy, qy)), _mm512_mul_ps(dz, qz)), inverseDet);
+        reject |= _mm512_cmp_ps_mask(v, zero, _CMP_LT_OQ) | _mm512_cmp_ps_mask(_mm512_add_ps(u, v), one, _CMP_GT_OQ);
+
+        __m512 t = _mm512_mul_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(e2x, qx), _mm512_mul_ps(e2y, qy)), _mm512_mul_ps(e2z, qz)), inverseDet);
+        unsigned int hitMask = (unsigned int)(~reject & _mm512_cmp_ps_mask(t, tMin, _CMP_GT_OQ)
+                                              & _mm512_cmp_ps_mask(t, _mm512_set1_ps(tNear), _CMP_LT_OQ)) & 0xFFFFu;
+        int remaining = first + count - i;
+        if(remaining < 16){
+            hitMask &= (1u << remaining) - 1;
+        }
+        if(hitMask != 0){
+            alignas(64) float tLanes[16], uLanes[16], vLanes[16];
+            _mm512_store_ps(tLanes, t);
+            _mm512_store_ps(uLanes, u);
+            _mm512_store_ps(vLanes, v);
+            hit |= keepClosest(hitMask, i, tLanes, uLanes, vLanes, tNear, uv, index);
+        }
+    }
+    return hit;
+}
+
+typedef bool (*TriangleKernel)(const TriangleIntersectData &, int, int, const vec3 &, const vec3 &, float &, vec2 &, int &);
+
+static TriangleKernel kernelFor(SimdLevel level) {
+    switch(level){
+        case SIMD_AVX512:
+            return intersectAVX512;
+        case SIMD_AVX2:
+            return intersectAVX2;
+        case SIMD_SSE41:
+            return intersectSSE41;
+        default:
+            return intersectScalar;
+    }
+}
+
+SimdLevel detectSimdLevel() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    int highestLeaf = info[0];
+    __cpuid(info, 1);
+    bool sse41 = (info[2] & (1 << 19)) != 0;
+    bool osSavesYmm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+    bool osSavesZmm = osSavesYmm && (_xgetbv(0) & 0xE6) == 0xE6;
+    bool avx2 = false, avx512 = false;
+    if(highestLeaf >= 7){
+        __cpuidex(info, 7, 0);
+        avx2 = osSavesYmm && (info[1] & (1 << 5)) != 0;
+        avx512 = osSavesZmm && (info[1] & (1 << 16)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    bool sse41 = __builtin_cpu_supports("sse4.1");
+    bool avx2 = __builtin_cpu_supports("avx2");
+    bool avx512 = __builtin_cpu_supports("avx512f");
+#endif
+    if(avx512){
+        return SIMD_AVX512;
+    }
+    if(avx2){
+        return SIMD_AVX2;
+    }
+    if(sse41){
+        return SIMD_SSE41;
+    }
+    return SIMD_SCALAR;
+}
+
+static SimdLevel activeLevel = detectSimdLevel();
+static TriangleKernel activeKernel = kernelFor(activeLevel);
+
+SimdLevel getSimdLevel() {
+    return activeLevel;
+}
+
+void setSimdLevel(SimdLevel level) {
+    activeLevel = std::min(level, detectSimdLevel());
+    activeKernel = kernelFor(activeLevel);
+}
+
+const char *simdLevelName(SimdLevel level) {
+    switch(level){
+        case SIMD_AVX512:
+            return "AVX-512";
+        case SIMD_AVX2:
+            return "AVX2";
+        case SIMD_SSE41:
+            return "SSE4.1";
+        default:
+            return "scalar";
+    }
+}
+
+bool intersectTriangles(const TriangleIntersectData &data, int first, int count, const vec3 &origin,
+                        const vec3 &direction, float &tNear, vec2 &uv, int &index) {
+    return activeKernel(data, first, count, origin, direction, tNear, uv, index);
+}
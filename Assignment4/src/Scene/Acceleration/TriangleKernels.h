@@ -0,0 +1,82 @@
+//
+// Ray triangle intersection kernels that test one ray against several triangles at once
+// The widest kernel the CPU supports is picked at startup (scalar, SSE4.1, AVX2 or AVX-512) and
+// they all give exactly the same answer as the scalar test.
+//
+
+#ifndef ASSIGNMENT4_TRIANGLEKERNELS_H
+#define ASSIGNMENT4_TRIANGLEKERNELS_H
+
+#include "../../Raytracer/Ray.h"
+#include "../../AlignedAllocator.h"
+
+//Widest kernel is 16 lanes, the arrays get this many zeroed triangles at the end so a full width load
+//starting at any real triangle stays inside them.
+#define TRIANGLE_KERNEL_PADDING 16
+
+//Just what the intersection test needs, stored as a structure of arrays: the first vertex and the two edges
+//leaving it, one array per component.
+struct TriangleIntersectData {
+    AlignedVector<float> v0[3];
+    AlignedVector<float> edge1[3];
+    AlignedVector<float> edge2[3];
+
+    //number of real triangles (the arrays are longer because of the padding)
+    int triangleCount = 0;
+
+    void resize(int triangleCount);
+    void setTriangle(int i, const vec3 &v0, const vec3 &edge1, const vec3 &edge2);
+};
+
+enum SimdLevel {
+    SIMD_SCALAR,
+    SIMD_SSE41,
+    SIMD_AVX2,
+    SIMD_AVX512
+};
+
+//following function heavily based on:
+// https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-overview/ray-tracing-rendering-technique-overview
+// https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-rendering-a-triangle/moller-trumbore-ray-triangle-intersection
+inline bool mollerTrumbore(const vec3 &v0, const vec3 &v0v1_edge, const vec3 &v0v2_edge, const vec3 &origin,
+                           const vec3 &direction, float &tNearTemp, vec2 &uvTemp) {
+    vec3 pVector = cross(direction,v0v2_edge);
+    float determinate = dot(v0v1_edge,pVector);
+    //vec3 normalVector = normalize(triangle.vertex[0].Normal);
+    //float determinate = dot(ray.getDirection(),normalVector);
+    if(fabs(determinate)<kEpsilon){
+        return false;
+    }
+    //cout<<determinate<<endl;
+
+    float inverseDet = 1/determinate;
+
+    vec3 tVector = origin - v0;
+    uvTemp.x = dot(tVector,pVector) * inverseDet;
+    if(uvTemp.x < 0 || uvTemp.x > 1){
+        return false;
+    }
+
+    vec3 qVector = cross(tVector,v0v1_edge);
+    uvTemp.y = dot(direction,qVector) * inverseDet;
+    if(uvTemp.y < 0 || uvTemp.x + uvTemp.y > 1){
+        return false;
+    }
+
+    tNearTemp = dot(v0v2_edge,qVector) * inverseDet;
+    return tNearTemp > RAY_T_MIN;
+}
+
+//Tests triangles [first, first + count) and keeps the closest hit in front of tNear, on a tie the first triangle wins.
+//Returns true if tNear (and uv, index) changed.
+bool intersectTriangles(const TriangleIntersectData &data, int first, int count, const vec3 &origin,
+                        const vec3 &direction, float &tNear, vec2 &uv, int &index);
+
+//Best level this CPU and OS support
+SimdLevel detectSimdLevel();
+//Level intersectTriangles uses, starts at detectSimdLevel(). Asking for more than the CPU supports is clamped.
+SimdLevel getSimdLevel();
+void setSimdLevel(SimdLevel level);
+const char *simdLevelName(SimdLevel level);
+
+#endif //ASSIGNMENT4_TRIANGLEKERNELS_H
@@ -0,0 +1,136 @@
+//
+// Camera path and keyframed object transforms for rendering a frame sequence in one go
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include "Animation.h"
+
+//"x,y,z"
+static bool parseVector(const string &text, vec3 &value) {
+    char extra;
+    return sscanf(text.c_str(), "%f,%f,%f%c", &value.x, &value.y, &value.z, &extra) == 3;
+}
+
+bool Animation::load(const string &path) {
+    ifstream file(path);
+    if(!file){
+        cout<<"Couldn't open the animation \""<<path<<"\""<<endl;
+        return false;
+    }
+    string line;
+    for (int lineNumber = 1; getline(file, line); ++lineNumber) {
+        istringstream words(line);
+        string keyword;
+        if(!(words >> keyword) || keyword[0] == '#'){
+            continue;
+        }
+        bool valid;
+        if(keyword == "frames"){
+            valid = (bool)(words >> frameCount) && frameCount > 0;
+        }
+        else if(keyword == "camera"){
+            CameraKey key;
+            string eye, target, up;
+            valid = (bool)(words >> key.frame >> eye >> target) && parseVector(eye, key.eye)
+                    && parseVector(target, key.target);
+            key.hasUp = (bool)(words >> up);
+            valid &= !key.hasUp || parseVector(up, key.up);
+            cameraKeys.push_back(key);
+        }
+        else if(keyword == "object"){
+            ObjectKey key;
+            string position, rotation, name;
+            valid = (bool)(words >> key.frame >> position >> rotation >> key.scale) && parseVector(position, key.position)
+                    && parseVector(rotation, key.rotation);
+            //the rest of the line, names can have spaces in them
+            getline(words >> ws, name);
+            name.erase(name.find_last_not_of(" \r") + 1);
+            valid &= !name.empty();
+            objectKeys[name].push_back(key);
+        }
+        else{
+            valid = false;
+        }
+        if(!valid){
+            cout<<path<<" line "<<lineNumber<<" doesn't make sense: "<<line<<endl;
+            return false;
+        }
+    }
+
+    auto byFrame = [](const CameraKey &a, const CameraKey &b) { return a.frame < b.frame; };
+    stable_sort(cameraKeys.begin(), cameraKeys.end(), byFrame);
+    for (auto &object : objectKeys) {
+        stable_sort(object.second.begin(), object.second.end(),
+                    [](const ObjectKey &a, const ObjectKey &b) { return a.frame < b.frame; });
+    }
+    return true;
+}
+
+void Animation::cameraAt(int frame, vec3 &eye, vec3 &target, vec3 &up) const {
+    int next = 0;
+    while(next < (int)cameraKeys.size() && cameraKeys[next].frame <= frame){
+        next++;
+    }
+    const CameraKey &before = cameraKeys[std::max(next - 1, 0)];
+    const CameraKey &after = cameraKeys[std::min(next, (int)cameraKeys.size() - 1)];
+    float t = after.frame == before.frame ? 0.0f : (float)(frame - before.frame) / (float)(after.frame - before.frame);
+    t = clamp(t, 0.0f, 1.0f);
+    eye = mix(before.eye, after.eye, t);
+    target = mix(before.target, after.target, t);
+    vec3 defaultUp = up;
+    up = mix(before.hasUp ? before.up : defaultUp, after.hasUp ? after.up : defaultUp, t);
+}
+
+Animation::ObjectKey Animation::objectAt(const vector<ObjectKey> &keys, int frame) {
+    int next = 0;
+    while(next < (int)keys.size() && keys[next].frame <= frame){
+        next++;
+    }
+    const ObjectKey &before = keys[std::max(next - 1, 0)];
+    const ObjectKey &after = keys[std::min(next, (int)keys.size() - 1)];
+    float t = after.frame == before.frame ? 0.0f : (float)(frame - before.frame) / (float)(after.frame - before.frame);
+    t = clamp(t, 0.0f, 1.0f);
+    ObjectKey key;
+    key.frame = frame;
+    key.position = mix(before.position, after.position, t);
+    key.rotation = mix(before.rotation, after.rotation, t);
+    key.scale = mix(before.scale, after.scale, t);
+    return key;
+}
+
+bool Animation::checkObjects(Scene &scene) const {
+    bool found = true;
+    for (auto &object : objectKeys) {
+        if(scene.findMesh(object.first) == nullptr && scene.findInstance(object.first) == nullptr){
+            cout<<"The animation moves \""<<object.first<<"\" but the scene doesn't have anything called that"<<endl;
+            found = false;
+        }
+    }
+    return found;
+}
+
+int Animation::apply(Scene &scene, int frame) {
+    int moved = 0;
+    for (auto &object : objectKeys) {
+        ObjectKey key = objectAt(object.second, frame);
+        auto last = applied.find(object.first);
+        if(last != applied.end() && last->second.position == key.position && last->second.rotation == key.rotation
+           && last->second.scale == key.scale){
+            continue;
+        }
+        applied[object.first] = key;
+        //instances just get a new transform, their BVH is in object space so it stays as it is
+        if(Instance *instance = scene.findInstance(object.first)){
+            instance->setTransform(key.position, key.rotation, vec3(key.scale));
+        }
+        else if(Mesh *mesh = scene.findMesh(object.first)){
+            mesh->setTransform(key.position, key.rotation, vec3(key.scale));
+        }
+        moved++;
+    }
+    return moved;
+}
@@ -0,0 +1,71 @@
+//
+// Camera path and keyframed object transforms for rendering a frame sequence in one go
+// The file has one keyframe per line (# starts a comment), everything in between is linearly interpolated and anything
+// before the first or after the last key of something holds still:
+//      frames <count>
+//      camera <frame> <eye x,y,z> <target x,y,z> [up x,y,z]
+//      object <frame> <position x,y,z> <rotation x,y,z> <scale> <name>
+// name is the text after the #### of a config entry. For instances (>I:) position, rotation and scale are its transform,
+// for meshes (>M:) they're relative to where it was loaded: rotated and scaled about the center of its bounds and then
+// moved by position (so 0,0,0 0,0,0 1 leaves it alone).
+//
+
+#ifndef ASSIGNMENT4_ANIMATION_H
+#define ASSIGNMENT4_ANIMATION_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Scene.h"
+
+using namespace std;
+using namespace glm;
+
+class Animation {
+private:
+    struct CameraKey {
+        int frame;
+        vec3 eye, target, up;
+        //keys without an up use the render's
+        bool hasUp;
+    };
+    struct ObjectKey {
+        int frame;
+        vec3 position, rotation;
+        float scale;
+    };
+
+    int frameCount = 1;
+    vector<CameraKey> cameraKeys;
+    map<string, vector<ObjectKey>> objectKeys;
+    //where every object was put last so the ones that hold still don't get touched (or refit) again
+    map<string, ObjectKey> applied;
+
+    static ObjectKey objectAt(const vector<ObjectKey> &keys, int frame);
+
+public:
+    //False (after saying what's wrong) if the file can't be read or a line doesn't make sense
+    bool load(const string &path);
+
+    int getFrameCount() {
+        return frameCount;
+    }
+
+    bool hasCameraPath() {
+        return !cameraKeys.empty();
+    }
+
+    //the camera on this frame, only call it if there is a camera path. up comes in as the render's own up
+    void cameraAt(int frame, vec3 &eye, vec3 &target, vec3 &up) const;
+
+    //False (after saying which) if an object isn't in the scene
+    bool checkObjects(Scene &scene) const;
+
+    //Puts every object where it is on this frame, returns how many of them moved since the last call
+    int apply(Scene &scene, int frame);
+};
+
+#endif //ASSIGNMENT4_ANIMATION_H
@@ -25,7 +25,7 @@ Camera::Camera(vec3 pos, vec3 target, vec3 upguide, float fov, float aspectRatio
     cameraSize.y = cameraSize.x * aspectRatio;
 }
 
-Ray Camera::generateRay(vec2 point) {
+Ray Camera::generateRay(vec2 point) const {
     vec3 direction = cameraForward
                      + (point.x * cameraSize.x * cameraUp)
                      + (point.y * cameraSize.y * cameraRight);
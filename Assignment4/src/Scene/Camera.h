@@ -41,7 +41,7 @@ public:
 
     ~Camera() = default;
 
-    Ray generateRay(vec2 point);
+    Ray generateRay(vec2 point) const;
 
 };
 
@@ -4,3 +4,22 @@
 
 #include "Model.h"
 
+
+void Model::intersectPacket(RayPacket &packet, int firstRay, const bool *rayMask) {
+    for (int i = firstRay; i < packet.rayCount; ++i) {
+        if(!rayMask[i]){
+            continue;
+        }
+        Ray ray(packet.origin, packet.direction[i]);
+        if(intersect(ray, packet.tNear[i], packet.index[i], packet.uv[i])){
+            packet.hit[i] = true;
+        }
+    }
+}
+
+bool Model::occluded(Ray &ray, float tMax) {
+    float tNear = tMax;
+    int index;
+    vec2 uv;
+    return intersect(ray, tNear, index, uv);
+}
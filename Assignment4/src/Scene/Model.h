@@ -8,6 +8,8 @@
 
 #include "Shading/Material.h"
 #include "../Raytracer/Ray.h"
+#include "../Raytracer/RayPacket.h"
+#include "Acceleration/AABB.h"
 
 class Model {
 private:
@@ -20,12 +22,22 @@ private:
     //};
 
 public:
-    Material material;
+    //index into the scene's material table, models that look the same share one entry
+    int materialIndex = 0;
+    //the kinds of rays (RayVisibility bits) that can hit this model, checked while walking the scene BVH
+    unsigned int visibilityMask = VISIBLE_TO_ALL;
 
     virtual ~Model() = default;
 
     virtual bool intersect(Ray &ray,float &tNearI,int &indexI,vec2 &uvI) = 0;
+    //Intersects the rays of the packet with rayMask set (none before firstRay), each one against its own tNear.
+    //Sets hit for the rays that found something closer. By default every ray is just traced on its own.
+    virtual void intersectPacket(RayPacket &packet, int firstRay, const bool *rayMask);
+    //Any hit in front of tMax, doesn't have to be the closest one so it can stop at the first it finds
+    virtual bool occluded(Ray &ray, float tMax);
     virtual void getSurfaceProperties(vec3 &hitPoint, Ray &ray, int &index, vec2 &uv, vec3 &normal, vec2 &stCoords)=0;
+    //world space bounds, used to build the scene's top level BVH
+    virtual AABB getBounds()=0;
 };
 
 
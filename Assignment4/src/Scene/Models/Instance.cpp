@@ -0,0 +1,105 @@
+//
+// Places a shared model in the scene with its own transform and material
+//
+
+#include "Instance.h"
+
+Instance::Instance(shared_ptr<Model> model) {
+    this->model = model;
+    updateTransform();
+}
+
+void Instance::setPosition(vec3 position) {
+    this->position = position;
+    updateTransform();
+}
+
+void Instance::setRotation(vec3 rotation) {
+    this->rotation = rotation;
+    updateTransform();
+}
+
+void Instance::setScale(vec3 scale) {
+    this->scale = scale;
+    updateTransform();
+}
+
+void Instance::setTransform(vec3 position, vec3 rotation, vec3 scale) {
+    this->position = position;
+    this->rotation = rotation;
+    this->scale = scale;
+    updateTransform();
+}
+
+void Instance::updateTransform() {
+    objectToWorld = translate(mat4(1), position);
+    objectToWorld = rotate(objectToWorld, radians(rotation.z), vec3(0, 0, 1));
+    objectToWorld = rotate(objectToWorld, radians(rotation.y), vec3(0, 1, 0));
+    objectToWorld = rotate(objectToWorld, radians(rotation.x), vec3(1, 0, 0));
+    objectToWorld = glm::scale(objectToWorld, scale);
+    worldToObject = inverse(objectToWorld);
+    normalToWorld = transpose(mat3(worldToObject));
+}
+
+//The direction isn't normalized afterwards so a distance along the object space ray is the same distance in world space
+Ray Instance::toObjectSpace(Ray &ray) {
+    Ray localRay(vec3(worldToObject * vec4(ray.getOrigin(), 1)), vec3(worldToObject * vec4(ray.getDirection(), 0)));
+    localRay.visibilityMask = ray.visibilityMask;
+    return localRay;
+}
+
+bool Instance::intersect(Ray &ray, float &tNearI, int &indexI, vec2 &uvI) {
+    Ray localRay = toObjectSpace(ray);
+    return model->intersect(localRay, tNearI, indexI, uvI);
+}
+
+//The packet's rays still share an origin in object space and the frustum is just transformed along with them
+void Instance::intersectPacket(RayPacket &packet, int firstRay, const bool *rayMask) {
+    RayPacket localPacket;
+    localPacket.columns = packet.columns;
+    localPacket.rows = packet.rows;
+    localPacket.rayCount = packet.rayCount;
+    localPacket.origin = vec3(worldToObject * vec4(packet.origin, 1));
+    for (int i = 0; i < packet.rayCount; ++i) {
+        localPacket.direction[i] = vec3(worldToObject * vec4(packet.direction[i], 0));
+        localPacket.inverseDirection[i] = 1.0f / localPacket.direction[i];
+        localPacket.tNear[i] = packet.tNear[i];
+        localPacket.index[i] = packet.index[i];
+        localPacket.uv[i] = packet.uv[i];
+        localPacket.hit[i] = false;
+    }
+    localPacket.updateFrustum();
+    model->intersectPacket(localPacket, firstRay, rayMask);
+    for (int i = firstRay; i < packet.rayCount; ++i) {
+        if(localPacket.hit[i]){
+            packet.tNear[i] = localPacket.tNear[i];
+            packet.index[i] = localPacket.index[i];
+            packet.uv[i] = localPacket.uv[i];
+            packet.hit[i] = true;
+        }
+    }
+}
+
+bool Instance::occluded(Ray &ray, float tMax) {
+    Ray localRay = toObjectSpace(ray);
+    return model->occluded(localRay, tMax);
+}
+
+void Instance::getSurfaceProperties(vec3 &hitPoint, Ray &ray, int &index, vec2 &uv, vec3 &normal, vec2 &stCoords) {
+    Ray localRay = toObjectSpace(ray);
+    vec3 localHitPoint = vec3(worldToObject * vec4(hitPoint, 1));
+    model->getSurfaceProperties(localHitPoint, localRay, index, uv, normal, stCoords);
+    normal = normalize(normalToWorld * normal);
+}
+
+AABB Instance::getBounds() {
+    AABB localBounds = model->getBounds();
+    AABB bounds;
+    for (int i = 0; i < 8; ++i) {
+        vec3 corner((i & 1) ? localBounds.maximum.x : localBounds.minimum.x,
+                    (i & 2) ? localBounds.maximum.y : localBounds.minimum.y,
+                    (i & 4) ? localBounds.maximum.z : localBounds.minimum.z);
+        bounds.grow(vec3(objectToWorld * vec4(corner, 1)));
+    }
+    return bounds;
+}
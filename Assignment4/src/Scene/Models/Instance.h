@@ -0,0 +1,67 @@
+//
+// Places a shared model in the scene with its own transform and material
+// The model keeps its own BVH in object space so any number of instances can use
+// the same triangles without copying them.
+//
+
+#ifndef ASSIGNMENT4_INSTANCE_H
+#define ASSIGNMENT4_INSTANCE_H
+
+#include <memory>
+
+#include "../Model.h"
+
+using namespace std;
+
+class Instance final: public Model {
+private:
+    shared_ptr<Model> model;
+
+    vec3 position = vec3(0);
+    vec3 rotation = vec3(0);
+    vec3 scale = vec3(1);
+
+    mat4 objectToWorld = mat4(1);
+    mat4 worldToObject = mat4(1);
+    mat3 normalToWorld = mat3(1);
+
+    void updateTransform();
+    Ray toObjectSpace(Ray &ray);
+
+public:
+    Instance() = default;
+    explicit Instance(shared_ptr<Model> model);
+    ~Instance() override = default;
+
+    void setPosition(vec3 position);
+    //euler angles in degrees, applied x then y then z
+    void setRotation(vec3 rotation);
+    void setScale(vec3 scale);
+    //all three at once (only works out the matrices once)
+    void setTransform(vec3 position, vec3 rotation, vec3 scale);
+
+    vec3 getPosition() const {
+        return position;
+    }
+
+    vec3 getRotation() const {
+        return rotation;
+    }
+
+    vec3 getScale() const {
+        return scale;
+    }
+
+    Model *getModel() {
+        return model.get();
+    }
+
+    bool intersect(Ray &ray,float &tNearI,int &indexI,vec2 &uvI) override;
+    void intersectPacket(RayPacket &packet, int firstRay, const bool *rayMask) override;
+    bool occluded(Ray &ray, float tMax) override;
+    void getSurfaceProperties(vec3 &hitPoint, Ray &ray, int &index, vec2 &uv, vec3 &normal, vec2 &stCoords) override;
+    AABB getBounds() override;
+};
+
+
+#endif //ASSIGNMENT4_INSTANCE_H
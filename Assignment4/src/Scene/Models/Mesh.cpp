@@ -20,64 +20,162 @@ void Mesh::addTriangle(vector<vec3> point,vec3 normal,vector<vec2> uv) {
         uv.emplace_back(vec3(0));
         uv.emplace_back(vec3(0));
     }
-    Triangle tempTriangle = {};
     for (int i = 0; i < 3; ++i) {
-        //Vertex tempVertex;
-        tempTriangle.vertex[i].Position = point[i];
-        tempTriangle.vertex[i].Normal = normal;
-        tempTriangle.vertex[i].uvCoords = uv[i];
+        Vertex vertex = {};
+        vertex.Position = point[i];
+        vertex.Normal = normal;
+        vertex.uvCoords = uv[i];
         //cout<<i<<" Pos: "<<point[i].x<<","<<point[i].y<<","<<point[i].z<<endl;
-        //tempTriangle.vertex[i]=tempVertex;
+        meshData.indices.push_back((uint32_t)meshData.vertices.size());
+        meshData.vertices.push_back(vertex);
     }
-    meshData.triangles.push_back(tempTriangle);
+    //the scene rebuilds it once it's done adding triangles
+    bvh.clear();
 }
 
-//following function heavily based on:
-// https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-overview/ray-tracing-rendering-technique-overview
-// https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-rendering-a-triangle/moller-trumbore-ray-triangle-intersection
-bool Mesh::rayTriangleIntersect(Triangle &triangle, Ray &ray, float &tNearTemp, vec2 &uvTemp) {
-    vec3 v0 = triangle.vertex[0].Position;
-    vec3 v1 = triangle.vertex[1].Position;
-    vec3 v2 = triangle.vertex[2].Position;
+void Mesh::buildBVH() {
+    vector<AABB> triangleBounds(meshData.triangleCount());
+    for (int i = 0; i < meshData.triangleCount(); ++i) {
+        for (int j = 0; j < 3; ++j) {
+            triangleBounds[i].grow(meshData.vertex(i, j).Position);
+        }
+    }
+    bvh.build(triangleBounds);
+
+    //store the triangles in leaf order so a leaf is just a range of them, and renumber the vertices in the order
+    //those triangles first use them so a leaf's vertices end up next to each other as well
+    vector<uint32_t> sortedIndices(meshData.indices.size());
+    vector<uint32_t> newIndex(meshData.vertices.size(), UINT32_MAX);
+    vector<Vertex> sortedVertices;
+    sortedVertices.reserve(meshData.vertices.size());
+    for (size_t i = 0; i < bvh.primitiveIndices.size(); ++i) {
+        for (int j = 0; j < 3; ++j) {
+            uint32_t vertex = meshData.indices[bvh.primitiveIndices[i] * 3 + j];
+            if(newIndex[vertex] == UINT32_MAX){
+                newIndex[vertex] = (uint32_t)sortedVertices.size();
+                sortedVertices.push_back(meshData.vertices[vertex]);
+            }
+            sortedIndices[i * 3 + j] = newIndex[vertex];
+        }
+        bvh.primitiveIndices[i] = i;
+    }
+    meshData.indices.swap(sortedIndices);
+    meshData.vertices.swap(sortedVertices);
+    buildIntersectData();
+}
+
+void Mesh::setTransform(vec3 offset, vec3 rotation, vec3 scale) {
+    if(!bvh.isBuilt()){
+        buildBVH();
+    }
+    if(restVertices.empty()){
+        restVertices = meshData.vertices;
+        restCenter = getBounds().center();
+    }
+    mat4 transform = translate(mat4(1), restCenter + offset);
+    transform = rotate(transform, radians(rotation.z), vec3(0, 0, 1));
+    transform = rotate(transform, radians(rotation.y), vec3(0, 1, 0));
+    transform = rotate(transform, radians(rotation.x), vec3(1, 0, 0));
+    transform = glm::scale(transform, scale);
+    transform = translate(transform, -restCenter);
+    mat3 normalTransform = transpose(inverse(mat3(transform)));
+
+    //every shared vertex only gets moved once
+    for (size_t i = 0; i < restVertices.size(); ++i) {
+        meshData.vertices[i].Position = vec3(transform * vec4(restVertices[i].Position, 1));
+        meshData.vertices[i].Normal = normalize(normalTransform * restVertices[i].Normal);
+    }
+    //the triangles are already in leaf order so triangle i is primitive i
+    vector<AABB> triangleBounds(meshData.triangleCount());
+    for (int i = 0; i < meshData.triangleCount(); ++i) {
+        for (int j = 0; j < 3; ++j) {
+            triangleBounds[i].grow(meshData.vertex(i, j).Position);
+        }
+    }
+    buildIntersectData();
+    bvh.refit(triangleBounds);
+}
 
-    vec3 v0v1_edge = v1 - v0;
-    vec3 v0v2_edge = v2 - v0;
+void Mesh::buildIntersectData() {
+    int triangleCount = meshData.triangleCount();
+    intersectData.resize(triangleCount);
+    for (int i = 0; i < triangleCount; ++i) {
+        vec3 v0 = meshData.vertex(i, 0).Position;
+        intersectData.setTriangle(i, v0, meshData.vertex(i, 1).Position - v0, meshData.vertex(i, 2).Position - v0);
+    }
+}
 
-    vec3 pVector = cross(ray.getDirection(),v0v2_edge);
-    float determinate = dot(v0v1_edge,pVector);
-    //vec3 normalVector = normalize(triangle.vertex[0].Normal);
-    //float determinate = dot(ray.getDirection(),normalVector);
-    if(fabs(determinate)<kEpsilon){
-        return false;
+AABB Mesh::getBounds() {
+    if(bvh.isBuilt()){
+        return bvh.getBounds();
     }
-    //cout<<determinate<<endl;
+    AABB bounds;
+    for (size_t i = 0; i < meshData.vertices.size(); ++i) {
+        bounds.grow(meshData.vertices[i].Position);
+    }
+    return bounds;
+}
 
-    float inverseDet = 1/determinate;
+bool Mesh::rayTriangleIntersect(int triangle, Ray &ray, float &tNearTemp, vec2 &uvTemp) {
+    vec3 v0 = meshData.vertex(triangle, 0).Position;
+    vec3 v1 = meshData.vertex(triangle, 1).Position;
+    vec3 v2 = meshData.vertex(triangle, 2).Position;
+
+    return mollerTrumbore(v0, v1 - v0, v2 - v0, ray.getOrigin(), ray.getDirection(), tNearTemp, uvTemp);
+}
 
-    vec3 tVector = ray.getOrigin() - v0;
-    uvTemp.x = dot(tVector,pVector) * inverseDet;
-    if(uvTemp.x < 0 || uvTemp.x > 1){
-        return false;
+bool Mesh::intersect(Ray &ray, float &tNearI, int &indexI, vec2 &uvI) {
+    if(!bvh.isBuilt()){
+        return intersectLinear(ray, tNearI, indexI, uvI);
     }
+    vec3 origin = ray.getOrigin();
+    vec3 direction = ray.getDirection();
+    return bvh.traverse(ray, tNearI, [&](int first, int count, float &tNear) {
+        return intersectTriangles(intersectData, first, count, origin, direction, tNear, uvI, indexI);
+    });
+}
 
-    vec3 qVector = cross(tVector,v0v1_edge);
-    uvTemp.y = dot(ray.getDirection(),qVector) * inverseDet;
-    if(uvTemp.y < 0 || uvTemp.x + uvTemp.y > 1){
-        return false;
+void Mesh::intersectPacket(RayPacket &packet, int firstRay, const bool *rayMask) {
+    if(!bvh.isBuilt()){
+        Model::intersectPacket(packet, firstRay, rayMask);
+        return;
     }
+    //the mesh's own rays are the ones the scene let through that also reach each leaf
+    bvh.traversePacket(packet, [&](int first, int count, int leafFirstRay, const bool *leafMask) {
+        bool hit = false;
+        for (int i = leafFirstRay; i < packet.rayCount; ++i) {
+            if(rayMask[i] && leafMask[i] && intersectTriangles(intersectData, first, count, packet.origin, packet.direction[i],
+                                                               packet.tNear[i], packet.uv[i], packet.index[i])){
+                packet.hit[i] = true;
+                hit = true;
+            }
+        }
+        return hit;
+    });
+}
 
-    tNearTemp = dot(v0v2_edge,qVector) * inverseDet;
-    return tNearTemp > RAY_T_MIN;
+//Stops at the first leaf with a triangle in front of tMax
+bool Mesh::occluded(Ray &ray, float tMax) {
+    if(!bvh.isBuilt()){
+        return Model::occluded(ray, tMax);
+    }
+    vec3 origin = ray.getOrigin();
+    vec3 direction = ray.getDirection();
+    return bvh.traverseAny(ray, tMax, [&](int first, int count) {
+        float tNear = tMax;
+        vec2 uv;
+        int index;
+        return intersectTriangles(intersectData, first, count, origin, direction, tNear, uv, index);
+    });
 }
 
 //following function based on: https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-overview/ray-tracing-rendering-technique-overview
-bool Mesh::intersect(Ray &ray, float &tNearI, int &indexI, vec2 &uvI) {
+bool Mesh::intersectLinear(Ray &ray, float &tNearI, int &indexI, vec2 &uvI) {
     bool intersect = false;
-    for (int i = 0; i < meshData.triangles.size(); ++i) {
-        Triangle triangle = meshData.triangles[i];
+    for (int i = 0; i < meshData.triangleCount(); ++i) {
         float tNearTemp = tNearI;
         vec2 uvTemp;
-        if (rayTriangleIntersect(triangle, ray, tNearTemp, uvTemp) && tNearTemp < tNearI) {
+        if (rayTriangleIntersect(i, ray, tNearTemp, uvTemp) && tNearTemp < tNearI) {
             tNearI = tNearTemp;
             uvI = uvTemp;
             indexI = i;
@@ -90,101 +188,35 @@ bool Mesh::intersect(Ray &ray, float &tNearI, int &indexI, vec2 &uvI) {
 //following function based on: https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-overview/ray-tracing-rendering-technique-overview
 void Mesh::getSurfaceProperties(vec3 &hitPoint, Ray &ray, int &index, vec2 &uv, vec3 &normal, vec2 &stCoords) {
 
-    const vec3 &v0 = meshData.triangles[index].vertex[0].Position;
-    const vec3 &v1 = meshData.triangles[index].vertex[1].Position;
-    const vec3 &v2 = meshData.triangles[index].vertex[2].Position;
+    const vec3 &v0 = meshData.vertex(index, 0).Position;
+    const vec3 &v1 = meshData.vertex(index, 1).Position;
+    const vec3 &v2 = meshData.vertex(index, 2).Position;
     vec3 edge0 = normalize(v1 - v0);
     vec3 edge1 = normalize(v2 - v1);
-    normal = meshData.triangles[index].vertex[1].Normal;
+    normal = meshData.vertex(index, 1).Normal;
     //normal = normalize(cross(edge0, edge1));
-    const vec2 &st0 = meshData.triangles[index].vertex[0].uvCoords;
-    const vec2 &st1 = meshData.triangles[index].vertex[1].uvCoords;
-    const vec2 &st2 = meshData.triangles[index].vertex[2].uvCoords;
+    const vec2 &st0 = meshData.vertex(index, 0).uvCoords;
+    const vec2 &st1 = meshData.vertex(index, 1).uvCoords;
+    const vec2 &st2 = meshData.vertex(index, 2).uvCoords;
     stCoords = st0 * (1 - uv.x - uv.y) + st1 * uv.x + st2 * uv.y;
 
 }
 
-//Following function based on:
-// http://www.opengl-tutorial.org/beginners-tutorials/tutorial-7-model-loading/
-// https://stackoverflow.com/questions/21120699/c-obj-file-parser
 void Mesh::openOBJ(string filename) {
-    vector<int> vertexIndices, uvIndices, normalIndices;
-    vector<vec3> temp_vertices;
-    vector<vec3> temp_normals;
-    vector<vec2> temp_uvs;
-
-    // try to open the file
-    ifstream file;
-    file.open( filename, fstream::in );
-    // didn't work? fail!
-    if ( file.fail() ) {
-        cout << "ERROR: OBJmodel: Couldn't load \""
-             << filename << "\"." << endl;
-    }
-
-    string line; // a buffer to store lines in, and separators
-    const char* values;
-    //Process the file
-    while(getline(file,line)) {	// while we have data, read in a line
-
-        if (line.substr(0,2)=="v "){
-            vec3 vertex;
-            values = line.c_str();
-            sscanf(values, "v %f %f %f\n", &vertex.x, &vertex.y, &vertex.z);
-            //cout<<"V: "<<vertex.x<<" "<<vertex.y<<" "<<vertex.z<<endl;
-            temp_vertices.push_back(vertex);
-            //updateBoundingBox(vertex);
-        }
-            //Process uv coordinates at each vertex
-        else if (line.substr(0,2)=="vt"){
-            vec2 uv;
-            values = line.c_str();
-            sscanf(values, "vt %f %f\n", &uv.x, &uv.y);
-            //cout<<"UV: "<<uv.x<<" "<<uv.y<<endl;
-            temp_uvs.push_back(uv);
+    ObjData obj;
+    if(loadOBJ(filename, obj)){
+        //already welded and indexed, the BVH puts them in leaf order
+        if(meshData.vertices.empty()){
+            meshData.vertices.swap(obj.vertices);
+            meshData.indices.swap(obj.indices);
         }
-        //Process normals at each vertex
-        else if (line.substr(0,2)=="vn"){
-            vec3 normal;
-            values = line.c_str();
-            sscanf(values, "vn %f %f %f\n", &normal.x, &normal.y, &normal.z);
-            //cout<<"N: "<<normal.x<<" "<<normal.y<<" "<<normal.z<<endl;
-            temp_normals.push_back(normal);
-        }
-        //Process indices of each set of vertices, uvs, and normals.
-        else if (line.substr(0,2)=="f "){
-            //string vertex1, vertex2, vertex3;
-            values = line.c_str();
-            int vertexIndex[3], uvIndex[3], normalIndex[3];
-            sscanf(values, "f %d/%d/%d %d/%d/%d %d/%d/%d\n",
-                   &vertexIndex[0], &uvIndex[0], &normalIndex[0],
-                   &vertexIndex[1], &uvIndex[1], &normalIndex[1],
-                   &vertexIndex[2], &uvIndex[2], &normalIndex[2]);
-
-            vertexIndices.push_back(vertexIndex[0] - 1);
-            vertexIndices.push_back(vertexIndex[1] - 1);
-            vertexIndices.push_back(vertexIndex[2] - 1);
-            uvIndices.push_back(uvIndex[0] - 1);
-            uvIndices.push_back(uvIndex[1] - 1);
-            uvIndices.push_back(uvIndex[2] - 1);
-            normalIndices.push_back(normalIndex[0] - 1);
-            normalIndices.push_back(normalIndex[1] - 1);
-            normalIndices.push_back(normalIndex[2] - 1);
-        }
-    }
-    Vertex vertex;
-
-    //Store the file's contents in proper MeshData setup
-    Triangle tempTriangle;
-    for (int i = 0; i < vertexIndices.size(); ++i) {
-        vertex.Position = temp_vertices[vertexIndices[i]];
-        vertex.Normal = temp_normals[normalIndices[i]];
-        vertex.uvCoords = temp_uvs[uvIndices[i]];
-        //meshData.vertices.push_back(vertex);
-        tempTriangle.vertex[i%3] = vertex;
-        if((i+1)%3==0){
-            meshData.triangles.push_back(tempTriangle);
-            //cout<<"writting Verts"<<endl;
+        else{
+            uint32_t firstVertex = (uint32_t)meshData.vertices.size();
+            meshData.vertices.insert(meshData.vertices.end(), obj.vertices.begin(), obj.vertices.end());
+            for (uint32_t index : obj.indices) {
+                meshData.indices.push_back(firstVertex + index);
+            }
         }
     }
+    buildBVH();
 }
@@ -12,21 +12,45 @@ using namespace std;
 
 #include "../Model.h"
 #include "../Shading/Material.h"
+#include "../Acceleration/BVH.h"
+#include "../Acceleration/TriangleKernels.h"
+#include "ObjLoader.h"
 
-class Mesh: public Model {
+class Mesh final: public Model {
 public:
-    struct Vertex {
-        vec3 Position;
-        vec3 Normal;
-        vec2 uvCoords;
-    };
-    struct Triangle{
-        Vertex vertex[3];
-    };
+    //what the OBJ loader gives back, so a loaded file is copied in as it is
+    typedef ObjVertex Vertex;
+    //Indexed: shared corners are stored once (the loader welds identical ones) and the triangles point at them
     struct MeshData{
-        vector<Triangle> triangles;
+        //numbered in the order the (leaf ordered) triangles first use them so a leaf's vertices sit together
+        vector<Vertex> vertices;
+        //three a triangle into vertices
+        vector<uint32_t> indices;
+
+        int triangleCount() const {
+            return (int)(indices.size() / 3);
+        }
+
+        const Vertex &vertex(int triangle, int corner) const {
+            return vertices[indices[triangle * 3 + corner]];
+        }
     };
     MeshData meshData;
+    //What the intersection kernels read, in the same (leaf) order as the triangles in meshData. The kernels test a
+    //whole leaf at once so they get their own flat copy instead of going through the indices, the vertices in
+    //meshData are only read for the final hit in getSurfaceProperties.
+    TriangleIntersectData intersectData;
+    //built over the triangles in meshData, which get sorted into leaf order so leaves index them directly
+    BVH bvh;
+
+private:
+    //the vertices as they were loaded, only kept once the mesh gets moved so every transform starts from them instead
+    //of piling up rounding errors
+    vector<Vertex> restVertices;
+    vec3 restCenter;
+
+    void buildIntersectData();
+
 public:
     Mesh() = default;
     ~Mesh() = default;
@@ -38,12 +62,23 @@ public:
     void addTexture(char type, string texturePath);
 
     bool intersect(Ray &ray,float &tNearI,int &indexI,vec2 &uvI) override;
+    void intersectPacket(RayPacket &packet, int firstRay, const bool *rayMask) override;
+    bool occluded(Ray &ray, float tMax) override;
+    //tests every triangle, used until the BVH has been built
+    bool intersectLinear(Ray &ray,float &tNearI,int &indexI,vec2 &uvI);
 
     void getSurfaceProperties(vec3 &hitPoint, Ray &ray, int &index, vec2 &uv, vec3 &normal, vec2 &stCoords) override;
 
+    AABB getBounds() override;
+
     void openOBJ(string filename);
 
-    bool rayTriangleIntersect(Triangle &tempTriangle, Ray &ray, float &tNearTemp, vec2 &uvTemp);
+    bool rayTriangleIntersect(int triangle, Ray &ray, float &tNearTemp, vec2 &uvTemp);
+
+    void buildBVH();
+    //Moves the mesh rigidly away from where it was loaded: scaled and rotated (degrees, x then y then z like an instance)
+    //about the center of its bounds, then moved by offset. The BVH keeps its tree and just gets refit.
+    void setTransform(vec3 offset, vec3 rotation, vec3 scale);
 };
 
 
@@ -18,7 +18,7 @@
 using namespace std;
 using namespace glm;
 
-class Sphere:public Model{
+class Sphere final:public Model{
 private:
     vec3 center={0,0,0};
     float radius = 1.0f;
@@ -32,10 +32,53 @@ public:
     void move(vec3 deltaMovement);
     void changeSize(float scalar);
 
+    vec3 getCenter() {
+        return center;
+    }
+
+    float getRadius() {
+        return radius;
+    }
+
+    //the test itself, defined below so the render context can inline it straight off its packed copy of the spheres
+    static bool intersect(const vec3 &center, float radius, Ray &ray, float &tNear);
     bool intersect(Ray &ray,float &tNear,int &index,vec2 &uv) override;
     void getSurfaceProperties(vec3 &hitPoint, Ray &ray, int &index, vec2 &uv, vec3 &normal, vec2 &stCoords) override;
+    AABB getBounds() override;
 
 };
 
+//Function based on: https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-overview/ray-tracing-rendering-technique-overview
+inline bool Sphere::intersect(const vec3 &center, float radius, Ray &ray, float &tNear) {
+    //the ray moved so the sphere sits at the origin
+    vec3 localOrigin = ray.getOrigin() - center;
+    vec3 direction = ray.getDirection();
+    //float a = dot(localRay.getDirection(),localRay.getDirection());
+    //float b = 2*dot(localRay.getDirection(),localRay.getOrigin());
+    //float c = dot(localRay.getOrigin(),localRay.getOrigin() - square(radius));
+    float a = lengthSquared(direction);
+    float b = 2 * dot(direction,localOrigin);
+    float c = lengthSquared(localOrigin) - square(radius);
+
+    float t0, t1;
+    if(!solveQuadratic(a, b, c, t0, t1)) return false;
+    // First check if close intersection is valid
+    if (t0 > RAY_T_MIN && t0 < tNear){
+        tNear = t0;
+    }
+    else if (t1 > RAY_T_MIN && t1 < tNear){
+        tNear = t1;
+    }
+    else{
+        return false;
+    }
+    //cout<<"hit"<<endl;
+    return true;
+}
+
+inline bool Sphere::intersect(Ray &ray, float &tNear, int &, vec2 &) {
+    return intersect(center, radius, ray, tNear);
+}
+
 
 #endif //ASSIGNMENT4_SPHERE_H
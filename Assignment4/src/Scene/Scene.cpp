@@ -3,11 +3,18 @@
 //
 
 #include "Scene.h"
+#include "SceneCache.h"
 #include "Shading/PointLight.h"
 #include "Shading/DirectionalLight.h"
 
 #include <fstream>
 
+bool Scene::sceneCacheEnabled = true;
+
+void Scene::setSceneCacheEnabled(bool enabled) {
+    sceneCacheEnabled = enabled;
+}
+
 void Scene::setupScene(string &sceneType) {
     //cout<<sceneType<<endl;
     if(sceneType=="--default"){
@@ -17,8 +24,19 @@ void Scene::setupScene(string &sceneType) {
         sceneType = "yours";
         generateMyScene();
     } else{
+        string configPath = sceneType;
         sceneType = "custom";
-        loadConfig(sceneType);
+        loadConfig(configPath);
+    }
+    buildAccelerationStructures();
+}
+
+//Meshes built out of addTriangle calls get their BVH once the scene is done adding to them
+void Scene::buildAccelerationStructures() {
+    for (size_t i = 0; i < modelMeshes.size(); ++i) {
+        if(!modelMeshes[i].bvh.isBuilt()){
+            modelMeshes[i].buildBVH();
+        }
     }
 }
 
@@ -40,6 +58,13 @@ void Scene::generateDefaultScene() {
 }
 
 void Scene::loadConfig(string config) {
+    //an unchanged config (and OBJs) comes straight out of its cache without parsing anything or building BVHs
+    uint64_t cacheKey = sceneCacheEnabled ? SceneCache::hashConfig(config) : 0;
+    if(cacheKey != 0 && SceneCache::load(*this, config, cacheKey)){
+        return;
+    }
+    size_t firstMesh = modelMeshes.size();
+    size_t firstInstance = modelInstances.size();
     ifstream file;
     file.open(config, fstream::in );
     if ( file.fail() ) {
@@ -48,18 +73,69 @@ void Scene::loadConfig(string config) {
     }
     string line;
     int counter = -1;
+    bool isInstance = false;
+    //the model the lines below apply to
+    auto current = [&]() -> Model & {
+        if(isInstance){
+            return modelInstances.back();
+        }
+        return modelMeshes[counter];
+    };
+    //built up by the material lines, goes into the material table once the model's entry is done
+    Material material;
+    //whatever follows the #### of the entry, animations find the model by it
+    string name;
+    auto finishModel = [&]() {
+        if(counter >= 0 || isInstance){
+            current().materialIndex = addMaterial(material);
+            if(isInstance){
+                namedInstances[name] = (int)modelInstances.size() - 1;
+            }else{
+                namedMeshes[name] = counter;
+            }
+        }
+        material.reset();
+    };
     while(getline(file,line)){
         //cout<<line<<endl;
         //Create model and add it to model objects
         if(line.substr(0,4)=="####"){
+            finishModel();
+            size_t nameStart = line.find_first_not_of("# ");
+            name = nameStart == string::npos ? "" : line.substr(nameStart);
+            name.erase(name.find_last_not_of(" \r") + 1);
             Mesh model;
             modelMeshes.push_back(model);
             counter++;
+            isInstance = false;
         }
         //give a model its mesh data:
         if(line.substr(0,4)==">M: "){
             modelMeshes[counter].addModel(line.substr(4, line.size()-1));
         }
+        //place another copy of a shared mesh instead of loading its own:
+        if(line.substr(0,4)==">I: "){
+            modelMeshes.pop_back();
+            counter--;
+            modelInstances.emplace_back(getSharedMesh(line.substr(4, line.size()-1)));
+            isInstance = true;
+        }
+        //instance transform:
+        if(line.substr(0,4)==" P: " && isInstance){
+            vec3 position;
+            sscanf(line.c_str(), " P: %f,%f,%f\n", &position.x, &position.y, &position.z);
+            modelInstances.back().setPosition(position);
+        }
+        if(line.substr(0,4)==" R: " && isInstance){
+            vec3 rotation;
+            sscanf(line.c_str(), " R: %f,%f,%f\n", &rotation.x, &rotation.y, &rotation.z);
+            modelInstances.back().setRotation(rotation);
+        }
+        if(line.substr(0,4)==" Z: " && isInstance){
+            float scale;
+            sscanf(line.c_str(), " Z: %f\n", &scale);
+            modelInstances.back().setScale(vec3(scale));
+        }
         //type of material it should use:
         if(line.substr(0,4)==" T: "){
             string type = (line.substr(4, line.size()-1));
@@ -79,42 +155,61 @@ void Scene::loadConfig(string config) {
             else{
                 materialType = PHONG;
             }
-            modelMeshes[counter].material.setMaterialType(materialType);
+            material.setMaterialType(materialType);
         }
         //give a model it's texture data:
         if(line.substr(0,4)==" D: "){
             vec3 color;
             sscanf(line.c_str(), " D: %f,%f,%f\n", &color.x, &color.y, &color.z);
-            modelMeshes[counter].material.setDiffuseColor(color);
+            material.setDiffuseColor(color);
         }
         if(line.substr(0,4)==" G: "){
             float strength;
             sscanf(line.c_str(), " G: %f\n", &strength);
-            modelMeshes[counter].material.setSpecularColor(vec3(strength));
+            material.setSpecularColor(vec3(strength));
         }
         if(line.substr(0,4)==" S: "){
             vec3 color;
             sscanf(line.c_str(), " S: %f,%f,%f\n", &color.x, &color.y, &color.z);
-            modelMeshes[counter].material.setSpecularColor(color);
+            material.setSpecularColor(color);
         }
         if(line.substr(0,4)==" K: "){
             float kr;
             sscanf(line.c_str(), " K: %f\n", &kr);
-            modelMeshes[counter].material.setKR(kr);
+            material.setKR(kr);
         }
         if(line.substr(0,4)==" I: "){
             float ior;
             sscanf(line.c_str(), " I: %f\n", &ior);
-            modelMeshes[counter].material.setIOR(ior);
+            material.setIOR(ior);
         }
         if(line.substr(0,4)==" E: "){
             float exponent;
             sscanf(line.c_str(), " E: %f\n", &exponent);
-            modelMeshes[counter].material.setSpecularExponet(exponent);
+            material.setSpecularExponet(exponent);
         }
         if(line.substr(0,4)==" X: "){
-            modelMeshes[counter].material.texture=true;
+            material.texture=true;
         }
+        //which rays can see it, any of camera/reflections/shadows (leaving one out hides it from those rays):
+        if(line.substr(0,4)==" V: "){
+            string flags = line.substr(4);
+            unsigned int visibilityMask = 0;
+            if(flags.find("camera") != string::npos){
+                visibilityMask |= VISIBLE_TO_CAMERA;
+            }
+            if(flags.find("reflections") != string::npos){
+                visibilityMask |= VISIBLE_TO_REFLECTIONS;
+            }
+            if(flags.find("shadows") != string::npos){
+                visibilityMask |= CASTS_SHADOWS;
+            }
+            current().visibilityMask = visibilityMask;
+        }
+    }
+    finishModel();
+    if(cacheKey != 0){
+        SceneCache::save(*this, config, cacheKey, firstMesh, firstInstance);
     }
     //for (int i = 0; i < modelMeshes.size(); ++i) {
     //    modelObjects.addModel(modelMeshes[i]);
@@ -123,19 +218,70 @@ void Scene::loadConfig(string config) {
 
 void Scene::addSphere(highp_vec3 pos, int radius, Material material) {
     Sphere sphere(pos,radius);
-    sphere.material = material;
+    sphere.materialIndex = addMaterial(material);
+    //a light sphere is where the light comes from, it shouldn't block it
+    if(material.type == LIGHT){
+        sphere.visibilityMask &= ~CASTS_SHADOWS;
+    }
     modelSpheres.push_back(sphere);
     //modelObjects.addModel(sphere);
 }
 
-vector<Sphere> Scene::getSpheres() {
+void Scene::addInstance(Instance instance) {
+    modelInstances.push_back(instance);
+}
+
+void Scene::addLight(Light *light) {
+    lights.push_back(light);
+}
+
+int Scene::addMaterial(const Material &material) {
+    for (size_t i = 0; i < materials.size(); ++i) {
+        if(materials[i] == material){
+            return (int)i;
+        }
+    }
+    materials.push_back(material);
+    return (int)materials.size() - 1;
+}
+
+shared_ptr<Mesh> Scene::getSharedMesh(string filepath) {
+    auto found = meshLibrary.find(filepath);
+    if(found != meshLibrary.end()){
+        return found->second;
+    }
+    shared_ptr<Mesh> mesh = make_shared<Mesh>();
+    mesh->addModel(filepath);
+    meshLibrary[filepath] = mesh;
+    return mesh;
+}
+
+Mesh *Scene::findMesh(const string &name) {
+    auto found = namedMeshes.find(name);
+    return found == namedMeshes.end() ? nullptr : &modelMeshes[found->second];
+}
+
+Instance *Scene::findInstance(const string &name) {
+    auto found = namedInstances.find(name);
+    return found == namedInstances.end() ? nullptr : &modelInstances[found->second];
+}
+
+vector<Sphere> &Scene::getSpheres() {
     return modelSpheres;
 }
 
-vector<Mesh> Scene::getMeshes() {
+vector<Mesh> &Scene::getMeshes() {
     return modelMeshes;
 }
 
+vector<Instance> &Scene::getInstances() {
+    return modelInstances;
+}
+
+const vector<Material> &Scene::getMaterials() {
+    return materials;
+}
+
 vector<Light *> Scene::getLights() {
     return lights;
 }
@@ -173,7 +319,7 @@ void Scene::genDefaultSquares() {
     material.setDiffuseColor(vec3(0.25));
     material.setSpecularColor(vec3(0.25));
     //material.texture = true;
-    bottomWall.material=material;
+    bottomWall.materialIndex=addMaterial(material);
     addSquare(bottomWall, p1, p0, p2, p3, n1);
     modelMeshes.push_back(bottomWall);
 
@@ -181,7 +327,7 @@ void Scene::genDefaultSquares() {
     Mesh backWall;
     material.reset();
     material.setDiffuseColor(vec3(0.35,0.45,0.2));
-    backWall.material=material;
+    backWall.materialIndex=addMaterial(material);
     //addSquare(backWall, p3, p2, p6, p5, n4);
     addSquare(backWall, p6, p5, p3, p2, n4);
     modelMeshes.push_back(backWall);
@@ -190,7 +336,7 @@ void Scene::genDefaultSquares() {
     Mesh leftWall;
     material.reset();
     material.setDiffuseColor(vec3(0.0,0.25,0.25));
-    leftWall.material=material;
+    leftWall.materialIndex=addMaterial(material);
     addSquare(leftWall, p2, p0, p7, p6, n2);
     modelMeshes.push_back(leftWall);
 
@@ -201,7 +347,7 @@ void Scene::genDefaultSquares() {
     material.setIOR(1.25);
     material.setKR(0.85);
     //material.setDiffuseColor(vec3(0.35,0.45,0.2));
-    rightWall.material=material;
+    rightWall.materialIndex=addMaterial(material);
     addSquare(rightWall, p1, p3, p5, p4, n3);
     modelMeshes.push_back(rightWall);
     material.setMaterialType(PHONG);
@@ -247,7 +393,7 @@ void Scene::genDefaultSquares() {
     material.setMaterialType(PHONG);
     material.setDiffuseColor(vec3(0.85,0.55,0.1));
     material.setSpecularColor(vec3(0.2));
-    squareMesh.material = material;
+    squareMesh.materialIndex = addMaterial(material);
     //add all the sides of the smaller square
     addSquare(squareMesh, vert3, vert1, vert5, vert7, normal0); //top
     addSquare(squareMesh, vert4, vert5, vert7, vert6, normal1); //right side
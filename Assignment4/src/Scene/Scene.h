@@ -6,6 +6,8 @@
 #define ASSIGNMENT4_SCENE_H
 #include <iostream>
 #include <vector>
+#include <map>
+#include <memory>
 
 //Include GLM for all the vector data.
 #include <glm/glm.hpp>
@@ -16,6 +18,7 @@
 //#include "Model.h"
 #include "Models/Mesh.h"
 #include "Models/Sphere.h"
+#include "Models/Instance.h"
 #include "Shading/Light.h"
 //#include "Models/ModelSet.h"
 
@@ -23,31 +26,60 @@
 using namespace glm;
 using namespace std;
 class Scene {
+    //fills the scene straight from a compiled config
+    friend class SceneCache;
+
 private:
     //vector<Model> modelObjects;
     vector<Sphere> modelSpheres;
     vector<Mesh> modelMeshes;
+    vector<Instance> modelInstances;
+    //every OBJ placed with >I: is only loaded once and shared by all of its instances
+    map<string, shared_ptr<Mesh>> meshLibrary;
+    //config entries by the name after their ####, index into modelMeshes or modelInstances
+    map<string, int> namedMeshes;
+    map<string, int> namedInstances;
+    //every distinct material in the scene, models keep an index into it. Entry 0 is the default material so a model
+    //nobody gave a material still points at something
+    vector<Material> materials = {Material()};
     vector<Light*> lights;
     vec3 background;
     //ModelSet modelObjects;
+    //config files are loaded from (and saved to) their binary cache, see SceneCache.h
+    static bool sceneCacheEnabled;
 
     //Setup the initial scene
     void generateDefaultScene();
     void generateMyScene();
     void loadConfig(string config);
+    void buildAccelerationStructures();
+    shared_ptr<Mesh> getSharedMesh(string filepath);
 
 public:
     Scene() = default;
     ~Scene() = default;
 
     void setupScene(string &sceneType);
+    //off parses every config from its text and OBJs and leaves any cache alone
+    static void setSceneCacheEnabled(bool enabled);
 
     void addSphere(highp_vec3 pos, int radius, Material material);
+    void addInstance(Instance instance);
+    //the scene keeps the light (like the ones it makes itself) for as long as it runs
+    void addLight(Light *light);
+    //index of the material in the table, reusing the entry of an identical one
+    int addMaterial(const Material &material);
 
     //bool isIntersect(Intersect &intersection);
 
-    vector<Sphere> getSpheres();
-    vector<Mesh> getMeshes();
+    //the scene's own models, the renderer traces them in place instead of copying them
+    vector<Sphere> &getSpheres();
+    vector<Mesh> &getMeshes();
+    vector<Instance> &getInstances();
+    const vector<Material> &getMaterials();
+    //the config entry with this name (what follows its ####), nullptr if there isn't one
+    Mesh *findMesh(const string &name);
+    Instance *findInstance(const string &name);
     //ModelSet getModelObjects();
     //void addPlane();
     //void addCube();
@@ -0,0 +1,501 @@
+//
+// Compiled copy of everything a config file loads (meshes with their BVHs, instances, materials and names)
+//
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "SceneCache.h"
+
+static const char cacheMagic[8] = {'R', 'T', 'S', 'C', 'E', 'N', 'E', '1'};
+static const uint32_t cacheVersion = 2;
+//every array starts on a cache line so it can be copied out of the mapping in one go
+static const size_t cacheAlignment = 64;
+
+//Layout of the file, all in this machine's byte order:
+//      header, materials, config meshes, shared meshes, instances
+//a mesh is its record, its name (or library path for shared meshes), then its vertices and indices, the nine
+//intersection arrays, the BVH nodes and primitive indices. Every array is padded to start on a multiple of cacheAlignment.
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    //sizes of the structs copied as they are, a build where any of them changed can't use the file
+    uint32_t vertexSize;
+    uint32_t nodeSize;
+    uint32_t materialSize;
+    uint64_t key;
+    uint64_t fileSize;
+    uint32_t materialCount;
+    uint32_t meshCount;
+    uint32_t sharedMeshCount;
+    uint32_t instanceCount;
+};
+
+struct MeshRecord {
+    //into the cache's material table
+    int32_t materialIndex;
+    uint32_t visibilityMask;
+    int32_t vertexCount;
+    //three indices each
+    int32_t triangleCount;
+    //length of each intersection array
+    int32_t intersectCount;
+    int32_t nodeCount;
+    int32_t primitiveCount;
+    int32_t nameLength;
+};
+
+struct InstanceRecord {
+    //into the shared meshes
+    int32_t sharedMesh;
+    int32_t materialIndex;
+    uint32_t visibilityMask;
+    int32_t nameLength;
+    float position[3];
+    float rotation[3];
+    float scale[3];
+};
+
+static const uint64_t fnvOffset = 14695981039346656037ULL;
+static const uint64_t fnvPrime = 1099511628211ULL;
+
+//FNV-1a eight bytes at a time, the OBJs can be hundreds of megabytes and this only has to notice that they changed
+static uint64_t hashBytes(uint64_t hash, const char *data, size_t size) {
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * fnvPrime;
+    }
+    for (; i < size; ++i) {
+        hash = (hash ^ (unsigned char)data[i]) * fnvPrime;
+    }
+    return hash;
+}
+
+//false if the file can't be opened
+static bool hashFile(uint64_t &hash, const string &path) {
+    ifstream file(path, ios::binary);
+    if(!file){
+        return false;
+    }
+    vector<char> buffer(1 << 20);
+    while(file){
+        file.read(buffer.data(), buffer.size());
+        hash = hashBytes(hash, buffer.data(), (size_t)file.gcount());
+    }
+    return true;
+}
+
+uint64_t SceneCache::hashConfig(const string &configPath) {
+    uint64_t hash = fnvOffset;
+    if(!hashFile(hash, configPath)){
+        return 0;
+    }
+    ifstream file(configPath);
+    string line;
+    while(getline(file, line)){
+        if(line.substr(0,4) == ">M: " || line.substr(0,4) == ">I: "){
+            //the path as loadConfig takes it, then the file (a missing one still changes the key so it isn't cached
+            //as if it were there)
+            string path = line.substr(4, line.size()-1);
+            hash = hashBytes(hash, path.c_str(), path.size() + 1);
+            if(!hashFile(hash, path)){
+                hash = hashBytes(hash, "missing", 7);
+            }
+        }
+    }
+    return hash == 0 ? 1 : hash;
+}
+
+//The whole cache file mapped read only (read into memory where there's no mmap)
+struct MappedFile {
+    const char *data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    vector<char> contents;
+#endif
+
+    bool open(const string &path) {
+#ifdef _WIN32
+        ifstream file(path, ios::binary | ios::ate);
+        if(!file){
+            return false;
+        }
+        size = (size_t)file.tellg();
+        contents.resize(size);
+        file.seekg(0);
+        file.read(contents.data(), size);
+        data = contents.data();
+        return file && size >= sizeof(CacheHeader);
+#else
+        int file = ::open(path.c_str(), O_RDONLY);
+        if(file < 0){
+            return false;
+        }
+        struct stat status;
+        if(fstat(file, &status) != 0 || status.st_size < (off_t)sizeof(CacheHeader)){
+            close(file);
+            return false;
+        }
+        size = (size_t)status.st_size;
+        void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+        close(file);
+        if(mapping == MAP_FAILED){
+            return false;
+        }
+        data = (const char *)mapping;
+        return true;
+#endif
+    }
+
+    ~MappedFile() {
+#ifndef _WIN32
+        if(data != nullptr){
+            munmap((void *)data, size);
+        }
+#endif
+    }
+};
+
+//Walks the mapping, every take checks it stays inside the file so a cut off or garbled cache just fails to load
+struct CacheReader {
+    const char *data;
+    size_t size;
+    size_t offset = 0;
+
+    CacheReader(const char *data, size_t size) : data(data), size(size) {}
+
+    const char *take(size_t bytes, bool aligned) {
+        if(aligned){
+            offset = (offset + cacheAlignment - 1) / cacheAlignment * cacheAlignment;
+        }
+        if(offset > size || bytes > size - offset){
+            return nullptr;
+        }
+        const char *start = data + offset;
+        offset += bytes;
+        return start;
+    }
+
+    template<typename T>
+    bool read(T &value, bool aligned = false) {
+        const char *start = take(sizeof(T), aligned);
+        if(start != nullptr){
+            memcpy(&value, start, sizeof(T));
+        }
+        return start != nullptr;
+    }
+
+    bool readName(int32_t length, string &name) {
+        const char *start = length >= 0 ? take((size_t)length, false) : nullptr;
+        if(start != nullptr){
+            name.assign(start, (size_t)length);
+        }
+        return start != nullptr;
+    }
+
+    //count elements of T, straight out of the mapping into the vector
+    template<typename Vector>
+    bool readArray(int32_t count, Vector &values) {
+        typedef typename Vector::value_type T;
+        const char *start = count >= 0 ? take((size_t)count * sizeof(T), true) : nullptr;
+        if(start == nullptr){
+            return false;
+        }
+        values.resize((size_t)count);
+        if(count > 0){
+            memcpy(values.data(), start, (size_t)count * sizeof(T));
+        }
+        return true;
+    }
+};
+
+static bool readMesh(CacheReader &reader, Mesh &mesh, string &name, int materialCount) {
+    MeshRecord record;
+    if(!reader.read(record, true) || !reader.readName(record.nameLength, name)){
+        return false;
+    }
+    if(record.materialIndex < 0 || record.materialIndex >= materialCount
+       || (record.intersectCount != record.triangleCount + TRIANGLE_KERNEL_PADDING && record.intersectCount != 0)){
+        return false;
+    }
+    mesh.materialIndex = record.materialIndex;
+    mesh.visibilityMask = record.visibilityMask;
+    if(record.triangleCount < 0 || !reader.readArray(record.vertexCount, mesh.meshData.vertices)
+       || !reader.readArray(record.triangleCount * 3, mesh.meshData.indices)){
+        return false;
+    }
+    for (uint32_t index : mesh.meshData.indices) {
+        if(index >= (uint32_t)record.vertexCount){
+            return false;
+        }
+    }
+    TriangleIntersectData &intersectData = mesh.intersectData;
+    intersectData.triangleCount = record.triangleCount;
+    for (int axis = 0; axis < 3; ++axis) {
+        if(!reader.readArray(record.intersectCount, intersectData.v0[axis])
+           || !reader.readArray(record.intersectCount, intersectData.edge1[axis])
+           || !reader.readArray(record.intersectCount, intersectData.edge2[axis])){
+            return false;
+        }
+    }
+    if(!reader.readArray(record.nodeCount, mesh.bvh.nodes)
+       || !reader.readArray(record.primitiveCount, mesh.bvh.primitiveIndices)){
+        return false;
+    }
+    //every node has to point inside the arrays, the traversal doesn't check
+    for (const BVHNode &node : mesh.bvh.nodes) {
+        bool fits = node.isLeaf() ? node.leftFirst >= 0 && node.leftFirst + node.count <= record.triangleCount
+                                  : node.leftFirst > 0 && node.leftFirst + 1 < record.nodeCount;
+        if(!fits){
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SceneCache::load(Scene &scene, const string &configPath, uint64_t key) {
+    MappedFile file;
+    if(key == 0 || !file.open(cachePath(configPath))){
+        return false;
+    }
+    CacheReader reader(file.data, file.size);
+    CacheHeader header = {};
+    reader.read(header);
+    if(memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0 || header.version != cacheVersion
+       || header.vertexSize != sizeof(Mesh::Vertex) || header.nodeSize != sizeof(BVHNode)
+       || header.materialSize != sizeof(Material) || header.key != key || header.fileSize != file.size){
+        return false;
+    }
+
+    vector<Material> materials;
+    if(!reader.readArray((int32_t)header.materialCount, materials)){
+        return false;
+    }
+    //the meshes go straight into the scene (copying a whole mesh afterwards would be most of the cost), if anything
+    //goes wrong they're dropped again
+    size_t firstMesh = scene.modelMeshes.size();
+    size_t firstInstance = scene.modelInstances.size();
+    auto fail = [&]() {
+        scene.modelMeshes.resize(firstMesh);
+        scene.modelInstances.resize(firstInstance);
+        return false;
+    };
+    vector<string> meshNames(header.meshCount);
+    scene.modelMeshes.reserve(firstMesh + header.meshCount);
+    for (uint32_t i = 0; i < header.meshCount; ++i) {
+        scene.modelMeshes.emplace_back();
+        if(!readMesh(reader, scene.modelMeshes.back(), meshNames[i], (int)materials.size())){
+            return fail();
+        }
+    }
+    vector<shared_ptr<Mesh>> sharedMeshes(header.sharedMeshCount);
+    vector<string> sharedPaths(header.sharedMeshCount);
+    for (uint32_t i = 0; i < header.sharedMeshCount; ++i) {
+        sharedMeshes[i] = make_shared<Mesh>();
+        if(!readMesh(reader, *sharedMeshes[i], sharedPaths[i], (int)materials.size())){
+            return fail();
+        }
+    }
+    vector<string> instanceNames(header.instanceCount);
+    for (uint32_t i = 0; i < header.instanceCount; ++i) {
+        InstanceRecord record;
+        if(!reader.read(record) || !reader.readName(record.nameLength, instanceNames[i])
+           || record.sharedMesh < 0 || record.sharedMesh >= (int32_t)sharedMeshes.size()
+           || record.materialIndex < 0 || record.materialIndex >= (int32_t)materials.size()){
+            return fail();
+        }
+        Instance instance(sharedMeshes[record.sharedMesh]);
+        instance.setTransform(make_vec3(record.position), make_vec3(record.rotation), make_vec3(record.scale));
+        instance.materialIndex = record.materialIndex;
+        instance.visibilityMask = record.visibilityMask;
+        scene.modelInstances.push_back(instance);
+    }
+
+    //everything's there, now it can go into the scene's tables
+    vector<int> materialIndices;
+    for (const Material &material : materials) {
+        materialIndices.push_back(scene.addMaterial(material));
+    }
+    for (size_t i = firstMesh; i < scene.modelMeshes.size(); ++i) {
+        scene.modelMeshes[i].materialIndex = materialIndices[scene.modelMeshes[i].materialIndex];
+        scene.namedMeshes[meshNames[i - firstMesh]] = (int)i;
+    }
+    for (size_t i = firstInstance; i < scene.modelInstances.size(); ++i) {
+        scene.modelInstances[i].materialIndex = materialIndices[scene.modelInstances[i].materialIndex];
+        scene.namedInstances[instanceNames[i - firstInstance]] = (int)i;
+    }
+    for (size_t i = 0; i < sharedMeshes.size(); ++i) {
+        scene.meshLibrary[sharedPaths[i]] = sharedMeshes[i];
+    }
+    return true;
+}
+
+//Writes the cache front to back keeping track of where it is so the arrays can be padded to the alignment
+struct CacheWriter {
+    ofstream file;
+    size_t offset = 0;
+
+    void write(const void *data, size_t bytes) {
+        file.write((const char *)data, bytes);
+        offset += bytes;
+    }
+
+    void pad() {
+        static const char zeros[cacheAlignment] = {};
+        write(zeros, (cacheAlignment - offset % cacheAlignment) % cacheAlignment);
+    }
+
+    template<typename Vector>
+    void writeArray(const Vector &values) {
+        pad();
+        write(values.data(), values.size() * sizeof(typename Vector::value_type));
+    }
+};
+
+static void writeMesh(CacheWriter &writer, Mesh &mesh, const string &name, int materialIndex) {
+    MeshRecord record = {};
+    record.materialIndex = materialIndex;
+    record.visibilityMask = mesh.visibilityMask;
+    record.vertexCount = (int32_t)mesh.meshData.vertices.size();
+    record.triangleCount = mesh.meshData.triangleCount();
+    record.intersectCount = (int32_t)mesh.intersectData.v0[0].size();
+    record.nodeCount = (int32_t)mesh.bvh.nodes.size();
+    record.primitiveCount = (int32_t)mesh.bvh.primitiveIndices.size();
+    record.nameLength = (int32_t)name.size();
+    writer.write(&record, sizeof(record));
+    writer.write(name.data(), name.size());
+    writer.writeArray(mesh.meshData.vertices);
+    writer.writeArray(mesh.meshData.indices);
+    for (int axis = 0; axis < 3; ++axis) {
+        writer.writeArray(mesh.intersectData.v0[axis]);
+        writer.writeArray(mesh.intersectData.edge1[axis]);
+        writer.writeArray(mesh.intersectData.edge2[axis]);
+    }
+    writer.writeArray(mesh.bvh.nodes);
+    writer.writeArray(mesh.bvh.primitiveIndices);
+}
+
+bool SceneCache::save(Scene &scene, const string &configPath, uint64_t key, size_t firstMesh, size_t firstInstance) {
+    if(key == 0){
+        return false;
+    }
+    //only the materials the config's models use, renumbered from 0
+    vector<Material> materials;
+    map<int, int> materialIndices;
+    auto cacheMaterial = [&](int sceneIndex) {
+        auto found = materialIndices.find(sceneIndex);
+        if(found != materialIndices.end()){
+            return found->second;
+        }
+        materials.push_back(scene.materials[sceneIndex]);
+        return materialIndices[sceneIndex] = (int)materials.size() - 1;
+    };
+    vector<string> meshNames(scene.modelMeshes.size() - firstMesh);
+    for (auto &named : scene.namedMeshes) {
+        if(named.second >= (int)firstMesh){
+            meshNames[named.second - firstMesh] = named.first;
+        }
+    }
+    vector<string> instanceNames(scene.modelInstances.size() - firstInstance);
+    for (auto &named : scene.namedInstances) {
+        if(named.second >= (int)firstInstance){
+            instanceNames[named.second - firstInstance] = named.first;
+        }
+    }
+    vector<string> sharedPaths;
+    map<Model *, int> sharedIndices;
+    for (auto &shared : scene.meshLibrary) {
+        sharedIndices[shared.second.get()] = (int)sharedPaths.size();
+        sharedPaths.push_back(shared.first);
+    }
+    vector<int> meshMaterials, sharedMaterials(sharedPaths.size()), instanceMaterials;
+    for (size_t i = firstMesh; i < scene.modelMeshes.size(); ++i) {
+        //a mesh the config is still adding triangles to has no BVH yet, there's nothing worth caching then
+        if(!scene.modelMeshes[i].bvh.isBuilt() && !scene.modelMeshes[i].meshData.indices.empty()){
+            return false;
+        }
+        meshMaterials.push_back(cacheMaterial(scene.modelMeshes[i].materialIndex));
+    }
+    int sharedIndex = 0;
+    for (auto &shared : scene.meshLibrary) {
+        sharedMaterials[sharedIndex++] = cacheMaterial(shared.second->materialIndex);
+    }
+    for (size_t i = firstInstance; i < scene.modelInstances.size(); ++i) {
+        instanceMaterials.push_back(cacheMaterial(scene.modelInstances[i].materialIndex));
+    }
+
+    //written next to it and renamed over it so a cut off save never looks like a cache
+    string path = cachePath(configPath);
+    string temporaryPath = path + ".tmp";
+    CacheWriter writer;
+    writer.file.open(temporaryPath, ios::binary | ios::trunc);
+    if(!writer.file){
+        cout<<"Couldn't write the scene cache \""<<temporaryPath<<"\""<<endl;
+        return false;
+    }
+    CacheHeader header = {};
+    memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    header.version = cacheVersion;
+    header.vertexSize = sizeof(Mesh::Vertex);
+    header.nodeSize = sizeof(BVHNode);
+    header.materialSize = sizeof(Material);
+    header.key = key;
+    header.materialCount = (uint32_t)materials.size();
+    header.meshCount = (uint32_t)meshNames.size();
+    header.sharedMeshCount = (uint32_t)sharedPaths.size();
+    header.instanceCount = (uint32_t)instanceNames.size();
+    //the size goes in once everything's written
+    writer.write(&header, sizeof(header));
+    writer.writeArray(materials);
+    for (size_t i = 0; i < meshNames.size(); ++i) {
+        writer.pad();
+        writeMesh(writer, scene.modelMeshes[firstMesh + i], meshNames[i], meshMaterials[i]);
+    }
+    sharedIndex = 0;
+    for (auto &shared : scene.meshLibrary) {
+        writer.pad();
+        writeMesh(writer, *shared.second, shared.first, sharedMaterials[sharedIndex++]);
+    }
+    for (size_t i = 0; i < instanceNames.size(); ++i) {
+        Instance &instance = scene.modelInstances[firstInstance + i];
+        InstanceRecord record = {};
+        auto found = sharedIndices.find(instance.getModel());
+        if(found == sharedIndices.end()){
+            //placed by code with a mesh that isn't in the library, the cache couldn't bring it back
+            writer.file.close();
+            remove(temporaryPath.c_str());
+            return false;
+        }
+        record.sharedMesh = found->second;
+        record.materialIndex = instanceMaterials[i];
+        record.visibilityMask = instance.visibilityMask;
+        record.nameLength = (int32_t)instanceNames[i].size();
+        for (int axis = 0; axis < 3; ++axis) {
+            record.position[axis] = instance.getPosition()[axis];
+            record.rotation[axis] = instance.getRotation()[axis];
+            record.scale[axis] = instance.getScale()[axis];
+        }
+        writer.write(&record, sizeof(record));
+        writer.write(instanceNames[i].data(), instanceNames[i].size());
+    }
+    header.fileSize = writer.offset;
+    writer.file.seekp(0);
+    writer.file.write((const char *)&header, sizeof(header));
+    writer.file.close();
+    if(!writer.file || rename(temporaryPath.c_str(), path.c_str()) != 0){
+        cout<<"Couldn't write the scene cache \""<<path<<"\""<<endl;
+        remove(temporaryPath.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,37 @@
+//
+// Compiled copy of everything a config file loads (meshes with their BVHs, instances, materials and names)
+// It's written next to the config as <config>.cache the first time the config is loaded and keyed by a hash of the
+// config and every OBJ it names, so the next start with the same files maps it in and copies its arrays straight into
+// the scene instead of parsing OBJs and building BVHs. Editing any of the files changes the key and the cache gets
+// rebuilt. It's only meant for the machine (and build) that wrote it.
+//
+
+#ifndef ASSIGNMENT4_SCENECACHE_H
+#define ASSIGNMENT4_SCENECACHE_H
+
+#include <cstdint>
+#include <string>
+
+#include "Scene.h"
+
+using namespace std;
+
+class SceneCache {
+public:
+    //64 bit FNV-1a of the config and every OBJ its >M: and >I: lines name, 0 if the config can't be read
+    static uint64_t hashConfig(const string &configPath);
+
+    static string cachePath(const string &configPath) {
+        return configPath + ".cache";
+    }
+
+    //Adds everything the cache holds to the scene, false (leaving the scene as it was) if there is no cache for this
+    //key or it doesn't fit this build
+    static bool load(Scene &scene, const string &configPath, uint64_t key);
+
+    //Saves the meshes and instances from these on (what loadConfig added, the scene can have code made models as
+    //well), false (after saying why) if it can't be written, which only means the next start parses again
+    static bool save(Scene &scene, const string &configPath, uint64_t key, size_t firstMesh, size_t firstInstance);
+};
+
+#endif //ASSIGNMENT4_SCENECACHE_H
@@ -0,0 +1,168 @@
+//
+// Light hierarchy for sampling a few of many point lights
+//
+
+#include "LightTree.h"
+#include "PointLight.h"
+#include "../../Raytracer/Sampler.h"
+
+//every light (however it faces) keeps at least this much of its power as importance, computeDiffuse adds a specular
+//highlight even for lights the surface is edge on to and a light that can't be picked would bias the render
+static const float minimumCosine = 0.01f;
+
+static float luminance(const vec3 &color) {
+    return 0.2126f * color.r + 0.7152f * color.g + 0.0722f * color.b;
+}
+
+void LightTree::build(const vector<Light*> &lights) {
+    nodes.clear();
+    lightIndices.clear();
+    unboundedLights.clear();
+    vector<vec3> positions(lights.size());
+    vector<float> powers(lights.size());
+    for (size_t i = 0; i < lights.size(); ++i) {
+        PointLight *pointLight = dynamic_cast<PointLight *>(lights[i]);
+        if(pointLight == nullptr){
+            unboundedLights.push_back((int)i);
+            continue;
+        }
+        lightIndices.push_back((int)i);
+        positions[i] = pointLight->position;
+        powers[i] = std::max(0.0f, luminance(pointLight->color));
+    }
+    if(lightIndices.empty()){
+        return;
+    }
+    //a binary tree with one light a leaf has 2n-1 nodes
+    nodes.reserve(lightIndices.size() * 2);
+    nodes.push_back(LightNode());
+    subdivide(0, 0, (int)lightIndices.size(), positions, powers);
+}
+
+//Splits the lights at the median along the longest axis of their bounds, so the tree is always balanced (and at most
+//log2 of the light count deep)
+void LightTree::subdivide(int nodeIndex, int first, int count, const vector<vec3> &positions, const vector<float> &powers) {
+    AABB bounds;
+    float power = 0;
+    for (int i = first; i < first + count; ++i) {
+        bounds.grow(positions[lightIndices[i]]);
+        power += powers[lightIndices[i]];
+    }
+    nodes[nodeIndex].bounds = bounds;
+    nodes[nodeIndex].power = power;
+    if(count == 1){
+        nodes[nodeIndex].leftFirst = lightIndices[first];
+        nodes[nodeIndex].count = 1;
+        return;
+    }
+    vec3 extent = bounds.maximum - bounds.minimum;
+    int axis = 0;
+    if(extent.y > extent.x){
+        axis = 1;
+    }
+    if(extent.z > extent[axis]){
+        axis = 2;
+    }
+    int leftCount = count / 2;
+    nth_element(lightIndices.begin() + first, lightIndices.begin() + first + leftCount,
+                lightIndices.begin() + first + count, [&](int a, int b) {
+                    return positions[a][axis] < positions[b][axis];
+                });
+
+    int leftChild = (int)nodes.size();
+    nodes.push_back(LightNode());
+    nodes.push_back(LightNode());
+    nodes[nodeIndex].leftFirst = leftChild;
+    nodes[nodeIndex].count = 0;
+    subdivide(leftChild, first, leftCount, positions, powers);
+    subdivide(leftChild + 1, first + leftCount, count - leftCount, positions, powers);
+}
+
+// The lights here don't fall off with distance (computeDiffuse never did), so what a light adds is its colour times
+// |cos| of the angle between the normal and the direction to it. For a node that's bounded by the power under it times
+// the largest |cos| any direction into the sphere around its box could have.
+float LightTree::importance(const LightNode &node, const vec3 &point, const vec3 &normal) const {
+    if(node.power <= 0){
+        return 0;
+    }
+    vec3 toCenter = node.bounds.center() - point;
+    float distanceSquared = lengthSquared(toCenter);
+    float radiusSquared = lengthSquared(node.bounds.maximum - node.bounds.minimum) * 0.25f;
+    if(distanceSquared <= radiusSquared){
+        return node.power;
+    }
+    float distance = sqrtf(distanceSquared);
+    //angle between the normal (either way) and the center, and the half angle the sphere takes up seen from the point
+    float cosCenter = std::min(1.0f, fabsf(dot(normal, toCenter)) / distance);
+    float sinCenter = sqrtf(std::max(0.0f, 1 - square(cosCenter)));
+    float sinSpread = sqrtf(radiusSquared / distanceSquared);
+    float cosSpread = sqrtf(std::max(0.0f, 1 - radiusSquared / distanceSquared));
+    float cosBound = 1;
+    //the closest direction in the sphere is still off the normal, cos(center - spread)
+    if(cosCenter < cosSpread){
+        cosBound = cosCenter * cosSpread + sinCenter * sinSpread;
+    }
+    return node.power * std::max(cosBound, minimumCosine);
+}
+
+int LightTree::sample(const vec3 &point, const vec3 &normal, unsigned int seed, float &probability) const {
+    probability = 0;
+    if(nodes.empty() || importance(nodes[0], point, normal) <= 0){
+        return -1;
+    }
+    probability = 1;
+    int nodeIndex = 0;
+    for (unsigned int level = 0; !nodes[nodeIndex].isLeaf(); ++level) {
+        int leftChild = nodes[nodeIndex].leftFirst;
+        float leftImportance = importance(nodes[leftChild], point, normal);
+        float rightImportance = importance(nodes[leftChild + 1], point, normal);
+        float total = leftImportance + rightImportance;
+        if(total <= 0){
+            probability = 0;
+            return -1;
+        }
+        if(hashFloat(level, seed) * total < leftImportance){
+            probability *= leftImportance / total;
+            nodeIndex = leftChild;
+        }
+        else{
+            probability *= rightImportance / total;
+            nodeIndex = leftChild + 1;
+        }
+    }
+    return nodes[nodeIndex].leftFirst;
+}
+
+void LightTree::probabilities(const vec3 &point, const vec3 &normal, vector<float> &lightProbabilities) const {
+    int lightListSize = (int)(lightIndices.size() + unboundedLights.size());
+    lightProbabilities.assign(lightListSize, 0.0f);
+    if(nodes.empty() || importance(nodes[0], point, normal) <= 0){
+        return;
+    }
+    //pushing both children only ever grows the stack by one a level
+    int stack[maxDepth + 2];
+    float stackProbability[maxDepth + 2];
+    int stackSize = 1;
+    stack[0] = 0;
+    stackProbability[0] = 1;
+    while(stackSize > 0){
+        stackSize--;
+        const LightNode &node = nodes[stack[stackSize]];
+        float nodeProbability = stackProbability[stackSize];
+        if(node.isLeaf()){
+            lightProbabilities[node.leftFirst] = nodeProbability;
+            continue;
+        }
+        float leftImportance = importance(nodes[node.leftFirst], point, normal);
+        float rightImportance = importance(nodes[node.leftFirst + 1], point, normal);
+        float total = leftImportance + rightImportance;
+        if(total <= 0){
+            continue;
+        }
+        stack[stackSize] = node.leftFirst;
+        stackProbability[stackSize] = nodeProbability * (leftImportance / total);
+        stack[stackSize + 1] = node.leftFirst + 1;
+        stackProbability[stackSize + 1] = nodeProbability * (rightImportance / total);
+        stackSize += 2;
+    }
+}
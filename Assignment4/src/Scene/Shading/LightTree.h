@@ -0,0 +1,69 @@
+//
+// Light hierarchy for sampling a few of many point lights
+// Every node keeps the bounds and total power of the lights under it. A shading point walks down from the root picking
+// a child at random in proportion to how much that child could light it, and ends on one light along with the
+// probability of having picked it, so dividing by that keeps the estimate unbiased. Picking a light costs one walk down
+// the tree (log2 of the light count) instead of a shadow ray to every light.
+// Based on:
+//      "Importance Sampling of Many Lights With Adaptive Tree Splitting" (Conty Estevez, Kulla 2018)
+//      https://www.pbr-book.org/4ed/Light_Sources/Light_Sampling
+//
+
+#ifndef ASSIGNMENT4_LIGHTTREE_H
+#define ASSIGNMENT4_LIGHTTREE_H
+
+#include <vector>
+
+#include "Light.h"
+#include "../Acceleration/AABB.h"
+
+using namespace std;
+
+struct LightNode {
+    AABB bounds;
+    //summed luminance of every light's colour under the node
+    float power;
+    //first child for interior nodes (the second one is always right after it), the light for leaves
+    int leftFirst;
+    //1 for leaves, 0 for interior nodes
+    int count;
+
+    bool isLeaf() const {
+        return count > 0;
+    }
+};
+
+class LightTree {
+private:
+    static const int maxDepth = 64;
+
+    void subdivide(int nodeIndex, int first, int count, const vector<vec3> &positions, const vector<float> &powers);
+    //upper bound on what the node's lights could add at point (for a surface facing normal either way)
+    float importance(const LightNode &node, const vec3 &point, const vec3 &normal) const;
+
+public:
+    vector<LightNode> nodes;
+    //indices into the light list the tree was built from, leaves point at one each
+    vector<int> lightIndices;
+    //lights without a position (directional ones), they aren't in the tree and always get evaluated
+    vector<int> unboundedLights;
+
+    LightTree() = default;
+    ~LightTree() = default;
+
+    void build(const vector<Light*> &lights);
+
+    int lightCount() const {
+        return (int)lightIndices.size();
+    }
+
+    //Picks a light in the tree for the point using the random numbers hashFloat(0, seed), hashFloat(1, seed), ... (one a
+    //level). Returns the light's index in the list the tree was built from and the probability it had of being picked,
+    //-1 if no light in the tree can reach the point.
+    int sample(const vec3 &point, const vec3 &normal, unsigned int seed, float &probability) const;
+    //the probability sample gives every light in the list the tree was built from (0 for the ones not in it), for
+    //checking the tree
+    void probabilities(const vec3 &point, const vec3 &normal, vector<float> &lightProbabilities) const;
+};
+
+#endif //ASSIGNMENT4_LIGHTTREE_H
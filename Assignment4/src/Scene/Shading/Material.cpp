@@ -16,7 +16,7 @@ void Material::setIOR(float value) {
 
 //Function heavily based on:
 // https://www.scratchapixel.com/lessons/3d-basic-rendering/ray-tracing-overview/ray-tracing-rendering-technique-overview
-vec3 Material::evalDiffuseColor(vec2 &stCoords) {
+vec3 Material::evalDiffuseColor(vec2 &stCoords) const {
     if(texture){
         float scale = 5;
         vec2 st = vec2(0);
@@ -70,3 +70,8 @@ void Material::reset() {
     texture = false;
 }
 
+bool Material::operator==(const Material &other) const {
+    return type == other.type && specularExponent == other.specularExponent && ior == other.ior && kr == other.kr
+           && diffuseColor == other.diffuseColor && specularColor == other.specularColor
+           && ambientColor == other.ambientColor && texture == other.texture;
+}
@@ -31,11 +31,14 @@ public:
     void setSpecularExponet(float value);
     void setMaterialType(MaterialType type);
 
-    vec3 evalDiffuseColor(vec2 &stCoords);
+    vec3 evalDiffuseColor(vec2 &stCoords) const;
 
     void setIOR(float value);
 
     void reset();
+
+    //every field the same, used to share one material table entry between models
+    bool operator==(const Material &other) const;
 };
 
 
@@ -4,48 +4,233 @@
 
 //Include all the needed libraries
 #include <iostream>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
 
 
 //#include "OpenGL/mainOpenGL.h"
 #include "Raytracer/RayTracer.h"
 #include "Scene/Scene.h"
 #include "Raytracer/ImageData.h"
+#include "Benchmark/Benchmark.h"
+#include "CommandLine.h"
+#include "Scene/Animation.h"
+#include "Scene/SceneCache.h"
 
 
-void setupUserDefinedVars(int &width, int &height, int &fieldOfView, int &bounceDepth, int &samples);
+void setupUserDefinedVars(int &width, int &height, int &fieldOfView, int &bounceDepth, int &samples, int &threads);
 
 void getUserInput(int &width, int defaultValue);
 
+string outputName(const RenderJob &job, const string &sceneType);
+
+bool renderJob(RayTracer &rayTracer, const RenderJob &job, const string &sceneType, uint64_t sceneKey);
+
+uint64_t hashScene(const string &scene);
+
+uint64_t checkpointKey(const RenderJob &job, uint64_t sceneKey);
+
+void stopRendering(int signal);
+
 using namespace std;
 
 int main(int argc, char *argv[]) {
-    string sceneType = argv[1];
+    if(argc > 1 && string(argv[1])=="--benchmark"){
+        return runBenchmark(argc > 2 ? argv[2] : "", argc > 3 ? argv[3] : "");
+    }
 
-    int width, height, fieldOfView, bounceDepth, superSampling;
+    CommandLine commandLine;
+    if(!parseCommandLine(argc, argv, commandLine)){
+        printUsage();
+        return 1;
+    }
+    RenderJob &settings = commandLine.job;
     //vec3 background = vec3(0);
     //vec3 background = vec3(0.2,0.4,1);
 
-    setupUserDefinedVars(width,height,fieldOfView,bounceDepth,superSampling);
+    if(commandLine.interactive){
+        setupUserDefinedVars(settings.width,settings.height,settings.fieldOfView,settings.bounceDepth,settings.samples,
+                             commandLine.threads);
+    }
 
-    //Setup final output image
-    ImageData imageData(width, height);
-    //Setup the camera
-    Camera camera(vec3(278, 273, -500),vec3(278, 273, 0),vec3(1,0,0),fieldOfView,(float)height/(float)width);
+    vector<RenderJob> jobs;
+    if(commandLine.manifestPath.empty()){
+        jobs.push_back(settings);
+    }else if(!loadManifest(commandLine.manifestPath, settings, jobs)){
+        return 1;
+    }
+    Animation animation;
+    bool animating = !commandLine.animationPath.empty();
+    if(animating && !animation.load(commandLine.animationPath)){
+        return 1;
+    }
+
+    //what checkpoints get keyed by (only worth hashing the files for when something renders progressively)
+    bool progressive = false;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        progressive |= jobs[i].progressive;
+    }
+    uint64_t sceneKey = progressive ? hashScene(commandLine.scene) : 0;
 
+    //the scene (meshes and their BVHs) is loaded once for every job
+    string sceneType = commandLine.scene;
+    Scene::setSceneCacheEnabled(commandLine.sceneCache);
     Scene scene;
     scene.setupScene(sceneType);
 
-    RayTracer rayTracer(superSampling,width,height,bounceDepth,scene,false);
-    rayTracer.cpuRender(&imageData, camera);
-    //cout<<sceneType<<endl;
+    //every frame of an animation is a job of its own, the objects get moved to where they are before it renders
+    if(animating){
+        if(!animation.checkObjects(scene)){
+            return 1;
+        }
+        jobs.clear();
+        for (int frame = 0; frame < animation.getFrameCount(); ++frame) {
+            RenderJob job = settings;
+            if(animation.hasCameraPath()){
+                animation.cameraAt(frame, job.eye, job.target, job.up);
+            }
+            char frameSuffix[16];
+            snprintf(frameSuffix, sizeof(frameSuffix), "_%04d", frame);
+            job.output = outputName(settings, sceneType) + frameSuffix;
+            jobs.push_back(job);
+        }
+    }
 
-    imageData.writeToPPM(sceneType);
+    RayTracer rayTracer(settings.samples,settings.width,settings.height,settings.bounceDepth,scene,commandLine.threads);
+    //ctrl+c stops a progressive render after the tiles being rendered (saving the checkpoint and the image) and skips
+    //the jobs left in a batch, a single normal render just gets killed like before
+    bool catchStop = jobs.size() > 1 || progressive;
+    if(catchStop){
+        signal(SIGINT, stopRendering);
+        signal(SIGTERM, stopRendering);
+    }
+    bool allWritten = true;
+    for (size_t i = 0; i < jobs.size() && !RayTracer::isStopRequested(); ++i) {
+        auto start = chrono::steady_clock::now();
+        //moved meshes refit their own BVH, the scene BVH gets refit for everything that moved at the start of the render
+        if(animating && animation.apply(scene, (int)i) > 0){
+            rayTracer.markModelsMoved();
+        }
+        //the objects are somewhere else every frame
+        uint64_t jobSceneKey = animating ? Checkpoint::hashKey(sceneKey, &i, sizeof(i)) : sceneKey;
+        bool written = renderJob(rayTracer, jobs[i], sceneType, jobSceneKey);
+        allWritten &= written;
+        if(jobs.size() > 1){
+            cout<<"Job "<<i + 1<<"/"<<jobs.size()<<" ("<<outputName(jobs[i], sceneType)<<", "<<jobs[i].width<<"x"
+                <<jobs[i].height<<") "<<(written ? "done" : "FAILED")<<" in "
+                <<chrono::duration<double>(chrono::steady_clock::now() - start).count()<<" s"<<endl;
+        }
+    }
 
     //return mainOpenGL(argc,argv);
-    return 0;
+    return allWritten ? 0 : 1;
+}
+
+string outputName(const RenderJob &job, const string &sceneType) {
+    return job.output.empty() ? sceneType : job.output;
+}
+
+//The built in scenes are made in code so their name is enough, a config is its hash with every OBJ it names
+uint64_t hashScene(const string &scene) {
+    if(scene == "--default" || scene == "--yours"){
+        return Checkpoint::hashKey(Checkpoint::keyStart, scene.c_str(), scene.size());
+    }
+    return SceneCache::hashConfig(scene);
+}
+
+uint64_t checkpointKey(const RenderJob &job, uint64_t sceneKey) {
+    uint64_t key = Checkpoint::hashKey(Checkpoint::keyStart, &sceneKey, sizeof(sceneKey));
+    vec3 camera[3] = {job.eye, job.target, job.up};
+    key = Checkpoint::hashKey(key, camera, sizeof(camera));
+    key = Checkpoint::hashKey(key, &job.fieldOfView, sizeof(job.fieldOfView));
+    key = Checkpoint::hashKey(key, &job.sampler, sizeof(job.sampler));
+    key = Checkpoint::hashKey(key, &job.noiseThreshold, sizeof(job.noiseThreshold));
+    key = Checkpoint::hashKey(key, &job.lightSamples, sizeof(job.lightSamples));
+    key = Checkpoint::hashKey(key, &job.branchThreshold, sizeof(job.branchThreshold));
+    return Checkpoint::hashKey(key, &job.russianRoulette, sizeof(job.russianRoulette));
+}
+
+bool renderJob(RayTracer &rayTracer, const RenderJob &job, const string &sceneType, uint64_t sceneKey) {
+    string output = outputName(job, sceneType);
+    //Setup the camera
+    Camera camera(job.eye,job.target,job.up,job.fieldOfView,(float)job.height/(float)job.width);
+    rayTracer.setRenderSettings(job.samples, job.width, job.height, job.bounceDepth);
+    rayTracer.setNoiseThreshold(job.noiseThreshold);
+    rayTracer.setLightSamples(job.lightSamples);
+    rayTracer.setSampler(job.sampler);
+    rayTracer.setBranchThreshold(job.branchThreshold);
+    rayTracer.setRussianRoulette(job.russianRoulette);
+    rayTracer.setWavefront(job.wavefront);
+    rayTracer.setSortedDepths(job.sortedDepths);
+
+    //writes the image a band at a time as the render goes and never keeps the whole thing in memory
+    if(job.bandRows > 0){
+        if(job.progressive){
+            cout<<"Streamed output can't be progressive, rendering it normally"<<endl;
+        }
+        if(job.denoise || job.writeAovs){
+            cout<<"Streamed output can't be denoised or have AOVs, rendering it without"<<endl;
+        }
+        ImageStream stream(output, job.format, job.width, job.height, rayTracer.getTileSize());
+        if(!stream.isOpen() || !rayTracer.streamRender(stream, camera, job.bandRows)){
+            cout<<"Couldn't write \""<<output<<ImageStream::extension(job.format)<<"\""<<endl;
+            return false;
+        }
+        return true;
+    }
+
+    //Setup final output image
+    ImageData imageData(job.width, job.height);
+    //the G-buffer only lives for this job
+    bool needGBuffer = job.denoise || job.writeAovs;
+    GBuffer gBuffer(needGBuffer ? job.width : 0, needGBuffer ? job.height : 0);
+    rayTracer.setGBuffer(needGBuffer ? &gBuffer : nullptr);
+    DenoiseSettings denoiseSettings;
+    auto writeAovs = [&]() {
+        if(!job.writeAovs || gBuffer.write(output, job.aovLayout)){
+            return true;
+        }
+        cout<<"Couldn't write the AOVs of \""<<output<<"\""<<endl;
+        return false;
+    };
+    if(job.progressive){
+        ProgressiveSettings progressiveSettings = job.progressiveSettings;
+        if(progressiveSettings.checkpointPath.empty()){
+            progressiveSettings.checkpointPath = output + ".checkpoint";
+        }
+        progressiveSettings.key = checkpointKey(job, sceneKey);
+        bool written = true, aovsWritten = true;
+        //every pass puts the checkpoint's pixels back into the image first, so denoising the written one is fine
+        rayTracer.progressiveRender(&imageData, camera, progressiveSettings, [&]() {
+            if(job.denoise){
+                rayTracer.denoise(&imageData, denoiseSettings);
+            }
+            written = imageData.write(output, job.format);
+            aovsWritten = writeAovs();
+        });
+        rayTracer.setGBuffer(nullptr);
+        if(!written){
+            cout<<"Couldn't write \""<<output<<ImageStream::extension(job.format)<<"\""<<endl;
+        }
+        return written && aovsWritten;
+    }
+
+    rayTracer.cpuRender(&imageData, camera);
+    //cout<<sceneType<<endl;
+    if(job.denoise){
+        rayTracer.denoise(&imageData, denoiseSettings);
+    }
+    rayTracer.setGBuffer(nullptr);
+
+    if(!imageData.write(output, job.format)){
+        cout<<"Couldn't write \""<<output<<ImageStream::extension(job.format)<<"\""<<endl;
+        return false;
+    }
+    return writeAovs();
 }
 
-void setupUserDefinedVars(int &width, int &height, int &fieldOfView, int &bounceDepth, int &samples) {
+void setupUserDefinedVars(int &width, int &height, int &fieldOfView, int &bounceDepth, int &samples, int &threads) {
     cout<<"The user can specify a bunch of values by typing them into the console and pressing enter following each prompt. "
             "\nNotes: "
             "\n\t- Pressing enter will use a default value. "
@@ -64,9 +249,12 @@ void setupUserDefinedVars(int &width, int &height, int &fieldOfView, int &bounce
     cout<<"Enter tracing depth: \n\t(Integer value greater than 0; \n\tDefault = 4)\n> ";
     getUserInput(bounceDepth,4);
 
-    cout<<"Enter square root of the number of samples per pixel: \n\t(Integer value greater than 0; \n\tDefault = 2; \n\t'square root' meaning enter 2 if you want 4 sample per pixel, 3 if you want 9, 4 if 16, etc.)\n> ";
+    cout<<"Enter square root of the most samples a pixel can get: \n\t(Integer value greater than 0; \n\tDefault = 2; \n\t'square root' meaning enter 2 if you want 4 sample per pixel, 3 if you want 9, 4 if 16, etc.; \n\tflat areas stop after 4, noisy ones and edges keep going up to this)\n> ";
     getUserInput(samples,2);
 
+    cout<<"Enter number of render threads: \n\t(Integer value greater than or equal to 0; \n\tDefault = 0; \n\t0 uses every hardware thread, 1 renders on a single thread)\n> ";
+    getUserInput(threads,0);
+
 }
 
 void getUserInput(int &newValue, int defaultValue) {
@@ -79,4 +267,8 @@ void getUserInput(int &newValue, int defaultValue) {
         stringstream potentialWidth(userInput);
         potentialWidth >> newValue;
     }
-}
\ No newline at end of file
+}
+
+void stopRendering(int) {
+    RayTracer::requestStop();
+}
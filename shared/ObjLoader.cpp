@@ -0,0 +1,441 @@
+//
+// OBJ loader shared by Assignment3's Model and Assignment4's Mesh
+//
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "ObjLoader.h"
+
+//a chunk smaller than this isn't worth starting a thread for
+static const size_t minimumChunkBytes = 256 * 1024;
+
+//one corner of a face, indices into the whole file's arrays (-1 if the face doesn't give one)
+struct ObjCorner {
+    int position;
+    int uv;
+    int normal;
+};
+
+//A run of whole lines, parsed by one thread
+struct ObjChunk {
+    const char *begin;
+    const char *end;
+    //how many of each it has (the first pass) and where they go in the whole file's arrays (the running totals)
+    size_t positionCount = 0, uvCount = 0, normalCount = 0, triangleCount = 0;
+    size_t firstPosition = 0, firstUV = 0, firstNormal = 0, firstTriangle = 0;
+    //corners that point at something that isn't in the file
+    size_t badIndices = 0;
+};
+
+//The whole file mapped read only (read into memory where there's no mmap)
+class ObjFile {
+private:
+#ifdef _WIN32
+    vector<char> contents;
+#endif
+
+public:
+    const char *data = nullptr;
+    size_t size = 0;
+
+    bool open(const string &path) {
+#ifdef _WIN32
+        ifstream file(path, ios::binary | ios::ate);
+        if(!file){
+            return false;
+        }
+        size = (size_t)file.tellg();
+        contents.resize(size);
+        file.seekg(0);
+        file.read(contents.data(), size);
+        data = contents.data();
+        return (bool)file;
+#else
+        int file = ::open(path.c_str(), O_RDONLY);
+        if(file < 0){
+            return false;
+        }
+        struct stat status;
+        if(fstat(file, &status) != 0){
+            close(file);
+            return false;
+        }
+        size = (size_t)status.st_size;
+        if(size == 0){
+            close(file);
+            return true;
+        }
+        void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+        close(file);
+        if(mapping == MAP_FAILED){
+            return false;
+        }
+        //read front to back once per pass
+        madvise(mapping, size, MADV_SEQUENTIAL);
+        data = (const char *)mapping;
+        return true;
+#endif
+    }
+
+    ~ObjFile() {
+#ifndef _WIN32
+        if(data != nullptr){
+            munmap((void *)data, size);
+        }
+#endif
+    }
+};
+
+static bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static const char *skipSpaces(const char *p, const char *end) {
+    while(p < end && isSpace(*p)){
+        p++;
+    }
+    return p;
+}
+
+static const char *lineEnd(const char *p, const char *end) {
+    const char *found = (const char *)memchr(p, '\n', (size_t)(end - p));
+    return found == nullptr ? end : found;
+}
+
+//Numbers with at most 7 significant digits and 10 decimals (everything an exporter writes with %f) are exact as float
+//mantissa / power of ten, so one correctly rounded division gives the same float sscanf's %f does. Anything else
+//(exponents, long numbers, inf/nan) goes through strtof.
+static const char *parseFloat(const char *p, const char *end, float &value) {
+    static const float powersOf10[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+    p = skipSpaces(p, end);
+    const char *start = p;
+    bool negative = p < end && *p == '-';
+    if(p < end && (*p == '-' || *p == '+')){
+        p++;
+    }
+    uint64_t mantissa = 0;
+    int digits = 0, decimals = 0;
+    bool fast = true;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p, ++digits) {
+        mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+        fast &= digits < 18;
+    }
+    if(p < end && *p == '.'){
+        for (++p; p < end && *p >= '0' && *p <= '9'; ++p, ++digits, ++decimals) {
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            fast &= digits < 18;
+        }
+    }
+    bool ended = p == end || isSpace(*p) || *p == '\n';
+    if(fast && ended && digits > 0 && mantissa <= (1u << 24) && decimals <= 10){
+        value = (float)mantissa / powersOf10[decimals];
+        value = negative ? -value : value;
+        return p;
+    }
+
+    char token[64];
+    size_t length = 0;
+    for (p = start; p < end && !isSpace(*p) && *p != '\n' && length < sizeof(token) - 1; ++p) {
+        token[length++] = *p;
+    }
+    token[length] = '\0';
+    char *parsedEnd;
+    value = strtof(token, &parsedEnd);
+    return start + (parsedEnd - token);
+}
+
+//false if there's no number here
+static bool parseIndex(const char *&p, const char *end, int &value) {
+    bool negative = p < end && *p == '-';
+    if(negative){
+        p++;
+    }
+    if(p == end || *p < '0' || *p > '9'){
+        return false;
+    }
+    long long parsed = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+        parsed = std::min(parsed * 10 + (*p - '0'), (long long)INT32_MAX);
+    }
+    value = negative ? -(int)parsed : (int)parsed;
+    return true;
+}
+
+//1 based from the front or negative from the last one read (count of them so far), -1 if it isn't anything
+static int resolveIndex(int index, size_t countSoFar) {
+    if(index > 0){
+        return index - 1;
+    }
+    if(index < 0 && (size_t)(-(long long)index) <= countSoFar){
+        return (int)((long long)countSoFar + index);
+    }
+    return -1;
+}
+
+//Reads "v", "v/vt", "v//vn" or "v/vt/vn", false at the end of the line
+static bool parseCorner(const char *&p, const char *end, int index[3]) {
+    p = skipSpaces(p, end);
+    index[0] = index[1] = index[2] = 0;
+    if(p == end || *p == '\n' || !parseIndex(p, end, index[0])){
+        return false;
+    }
+    for (int i = 1; i < 3 && p < end && *p == '/'; ++i) {
+        p++;
+        parseIndex(p, end, index[i]);
+    }
+    //skip anything this doesn't understand up to the next corner
+    while(p < end && !isSpace(*p) && *p != '\n'){
+        p++;
+    }
+    return true;
+}
+
+static int countCorners(const char *p, const char *end) {
+    int corners = 0;
+    int index[3];
+    while(parseCorner(p, end, index)){
+        corners++;
+    }
+    return corners;
+}
+
+static void countChunk(ObjChunk &chunk) {
+    for (const char *line = chunk.begin; line < chunk.end;) {
+        const char *next = lineEnd(line, chunk.end);
+        const char *p = skipSpaces(line, next);
+        if(next - p > 2 && p[0] == 'v' && isSpace(p[1])){
+            chunk.positionCount++;
+        }
+        else if(next - p > 2 && p[0] == 'v' && p[1] == 't' && isSpace(p[2])){
+            chunk.uvCount++;
+        }
+        else if(next - p > 2 && p[0] == 'v' && p[1] == 'n' && isSpace(p[2])){
+            chunk.normalCount++;
+        }
+        else if(next - p > 1 && p[0] == 'f' && isSpace(p[1])){
+            chunk.triangleCount += std::max(countCorners(p + 2, next) - 2, 0);
+        }
+        line = next + 1;
+    }
+}
+
+static void parseChunk(ObjChunk &chunk, ObjData &data, vector<ObjCorner> &corners) {
+    size_t positions = chunk.firstPosition, uvs = chunk.firstUV, normals = chunk.firstNormal;
+    size_t corner = chunk.firstTriangle * 3;
+    for (const char *line = chunk.begin; line < chunk.end;) {
+        const char *next = lineEnd(line, chunk.end);
+        const char *p = skipSpaces(line, next);
+        if(next - p > 2 && p[0] == 'v' && isSpace(p[1])){
+            vec3 &position = data.positions[positions++];
+            p = parseFloat(p + 2, next, position.x);
+            p = parseFloat(p, next, position.y);
+            parseFloat(p, next, position.z);
+        }
+        else if(next - p > 2 && p[0] == 'v' && p[1] == 't' && isSpace(p[2])){
+            vec2 &uv = data.uvs[uvs++];
+            p = parseFloat(p + 3, next, uv.x);
+            parseFloat(p, next, uv.y);
+        }
+        else if(next - p > 2 && p[0] == 'v' && p[1] == 'n' && isSpace(p[2])){
+            vec3 &normal = data.normals[normals++];
+            p = parseFloat(p + 3, next, normal.x);
+            p = parseFloat(p, next, normal.y);
+            parseFloat(p, next, normal.z);
+        }
+        else if(next - p > 1 && p[0] == 'f' && isSpace(p[1])){
+            //a fan around the first corner: 0 1 2, 0 2 3, ...
+            ObjCorner first = {}, previous = {};
+            int count = 0;
+            int index[3];
+            for (p += 2; parseCorner(p, next, index); ++count) {
+                ObjCorner current = {resolveIndex(index[0], positions), resolveIndex(index[1], uvs),
+                                     resolveIndex(index[2], normals)};
+                if(count >= 2){
+                    corners[corner++] = first;
+                    corners[corner++] = previous;
+                    corners[corner++] = current;
+                }
+                if(count == 0){
+                    first = current;
+                }
+                previous = current;
+            }
+        }
+        line = next + 1;
+    }
+}
+
+//Corners to vertices, any index past the end of its array was only found out now that all the chunks are read
+static void buildTriangles(ObjChunk &chunk, const ObjData &data, const vector<ObjCorner> &corners,
+                           vector<ObjVertex> &triangleVertices) {
+    size_t positionCount = data.positions.size(), uvCount = data.uvs.size(), normalCount = data.normals.size();
+    for (size_t triangle = chunk.firstTriangle; triangle < chunk.firstTriangle + chunk.triangleCount; ++triangle) {
+        ObjVertex *vertex = &triangleVertices[triangle * 3];
+        const ObjCorner *corner = &corners[triangle * 3];
+        bool flatNormal = false;
+        for (int i = 0; i < 3; ++i) {
+            if(corner[i].position >= 0 && (size_t)corner[i].position < positionCount){
+                vertex[i].Position = data.positions[corner[i].position];
+            }
+            else{
+                vertex[i].Position = vec3(0);
+                chunk.badIndices++;
+            }
+            bool hasUV = corner[i].uv >= 0 && (size_t)corner[i].uv < uvCount;
+            vertex[i].uvCoords = hasUV ? data.uvs[corner[i].uv] : vec2(0);
+            bool hasNormal = corner[i].normal >= 0 && (size_t)corner[i].normal < normalCount;
+            vertex[i].Normal = hasNormal ? data.normals[corner[i].normal] : vec3(0);
+            flatNormal |= !hasNormal;
+        }
+        if(flatNormal){
+            vec3 normal = cross(vertex[1].Position - vertex[0].Position, vertex[2].Position - vertex[0].Position);
+            //no area means it gets left out anyway
+            normal = length(normal) > 0 ? normalize(normal) : normal;
+            for (int i = 0; i < 3; ++i) {
+                if(corner[i].normal < 0 || (size_t)corner[i].normal >= normalCount){
+                    vertex[i].Normal = normal;
+                }
+            }
+        }
+    }
+}
+
+static const uint32_t emptySlot = UINT32_MAX;
+
+//Hash table of the vertices welded so far, open addressing over indices into vertices
+class VertexWelder {
+private:
+    vector<uint32_t> slots;
+    size_t mask;
+
+    static size_t hashVertex(const ObjVertex &vertex) {
+        uint32_t words[sizeof(ObjVertex) / 4];
+        memcpy(words, &vertex, sizeof(ObjVertex));
+        uint64_t hash = 14695981039346656037ULL;
+        for (uint32_t word : words) {
+            hash = (hash ^ word) * 1099511628211ULL;
+        }
+        return (size_t)(hash ^ (hash >> 32));
+    }
+
+public:
+    explicit VertexWelder(size_t cornerCount) {
+        size_t size = 16;
+        while(size < cornerCount * 2){
+            size *= 2;
+        }
+        slots.assign(size, emptySlot);
+        mask = size - 1;
+    }
+
+    //index of the vertex with exactly these bytes, added to the end of vertices if it's new
+    uint32_t weld(const ObjVertex &vertex, vector<ObjVertex> &vertices) {
+        for (size_t slot = hashVertex(vertex) & mask;; slot = (slot + 1) & mask) {
+            if(slots[slot] == emptySlot){
+                slots[slot] = (uint32_t)vertices.size();
+                vertices.push_back(vertex);
+                return slots[slot];
+            }
+            if(memcmp(&vertices[slots[slot]], &vertex, sizeof(ObjVertex)) == 0){
+                return slots[slot];
+            }
+        }
+    }
+};
+
+//Runs function(chunk) for every chunk, one thread each
+template<typename Function>
+static void forEachChunk(vector<ObjChunk> &chunks, Function function) {
+    vector<thread> threads;
+    for (size_t i = 1; i < chunks.size(); ++i) {
+        threads.emplace_back([&, i]() { function(chunks[i]); });
+    }
+    function(chunks[0]);
+    for (thread &running : threads) {
+        running.join();
+    }
+}
+
+bool loadOBJ(const string &path, ObjData &data, int threads) {
+    ObjFile file;
+    if(!file.open(path)){
+        cout << "ERROR: OBJ loader: Couldn't load \"" << path << "\"." << endl;
+        return false;
+    }
+
+    if(threads <= 0){
+        threads = std::max((int)thread::hardware_concurrency(), 1);
+    }
+    size_t chunkCount = std::max<size_t>(std::min<size_t>((size_t)threads, file.size / minimumChunkBytes), 1);
+    //split evenly, moving every split forward to the start of the next line
+    vector<ObjChunk> chunks(chunkCount);
+    const char *fileEnd = file.data + file.size;
+    const char *begin = file.data;
+    for (size_t i = 0; i < chunkCount; ++i) {
+        const char *end = i + 1 == chunkCount ? fileEnd : file.data + file.size * (i + 1) / chunkCount;
+        end = std::max(end, begin);
+        end = end == fileEnd ? end : std::min(lineEnd(end, fileEnd) + 1, fileEnd);
+        chunks[i].begin = begin;
+        chunks[i].end = end;
+        begin = end;
+    }
+
+    forEachChunk(chunks, countChunk);
+    size_t positionCount = 0, uvCount = 0, normalCount = 0, triangleCount = 0;
+    for (ObjChunk &chunk : chunks) {
+        chunk.firstPosition = positionCount;
+        chunk.firstUV = uvCount;
+        chunk.firstNormal = normalCount;
+        chunk.firstTriangle = triangleCount;
+        positionCount += chunk.positionCount;
+        uvCount += chunk.uvCount;
+        normalCount += chunk.normalCount;
+        triangleCount += chunk.triangleCount;
+    }
+
+    data.positions.resize(positionCount);
+    data.uvs.resize(uvCount);
+    data.normals.resize(normalCount);
+    vector<ObjCorner> corners(triangleCount * 3);
+    forEachChunk(chunks, [&](ObjChunk &chunk) { parseChunk(chunk, data, corners); });
+    vector<ObjVertex> triangleVertices(triangleCount * 3);
+    forEachChunk(chunks, [&](ObjChunk &chunk) { buildTriangles(chunk, data, corners, triangleVertices); });
+
+    //welding goes through the triangles in order so the vertices come out in the order they're first used
+    VertexWelder welder(triangleVertices.size());
+    data.vertices.clear();
+    data.indices.clear();
+    data.indices.reserve(triangleVertices.size());
+    for (size_t triangle = 0; triangle < triangleCount; ++triangle) {
+        const ObjVertex *vertex = &triangleVertices[triangle * 3];
+        if(cross(vertex[1].Position - vertex[0].Position, vertex[2].Position - vertex[0].Position) == vec3(0)){
+            continue;
+        }
+        for (int i = 0; i < 3; ++i) {
+            data.indices.push_back(welder.weld(vertex[i], data.vertices));
+        }
+    }
+
+    size_t badIndices = 0;
+    for (ObjChunk &chunk : chunks) {
+        badIndices += chunk.badIndices;
+    }
+    if(badIndices > 0){
+        cout << "WARNING: \"" << path << "\" has " << badIndices << " face corners that point at vertices it doesn't have"
+             << endl;
+    }
+    return true;
+}
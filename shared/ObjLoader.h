@@ -0,0 +1,46 @@
+//
+// OBJ loader shared by Assignment3's Model and Assignment4's Mesh
+// The file is mapped in and split into chunks at line breaks that are parsed on their own threads: one pass counts the
+// v/vt/vn lines and triangles of every chunk so the second can write straight into the final arrays at its chunk's
+// offset, and a third puts the triangle corners together. Faces can have any number of corners (split into a fan
+// around the first one) and any of the v, v/vt, v//vn and v/vt/vn forms, negative indices count back from the end.
+// Corners with the same position, normal and uv are then welded into one vertex that the triangles index.
+//
+
+#ifndef SHARED_OBJLOADER_H
+#define SHARED_OBJLOADER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+using namespace std;
+using namespace glm;
+
+//same layout as the vertices both assignments already draw/trace
+struct ObjVertex {
+    vec3 Position;
+    vec3 Normal;
+    vec2 uvCoords;
+};
+
+struct ObjData {
+    //every v, vt and vn line of the file in order
+    vector<vec3> positions;
+    vector<vec2> uvs;
+    vector<vec3> normals;
+    //every distinct corner the faces use, numbered in the order the triangles first use them so neighbouring
+    //triangles read neighbouring vertices. Corners without a vt get uv 0,0 and ones without a vn get the triangle's
+    //flat normal
+    vector<ObjVertex> vertices;
+    //three a triangle into vertices in the order the faces come in, triangles without any area are left out
+    vector<uint32_t> indices;
+};
+
+//Reads the OBJ into data, false (after saying why) if it can't be read. threads 0 uses every hardware thread, small
+//files use fewer since a chunk isn't worth a thread below a few hundred kilobytes
+bool loadOBJ(const string &path, ObjData &data, int threads = 0);
+
+#endif //SHARED_OBJLOADER_H